@@ -0,0 +1,256 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "w25qxx.h"
+#include "w25qxx_sim.h"
+
+/*
+    Driver benchmark on the simulated chip. Time is the simulator's virtual
+    clock: every callback, CS cycle and clocked byte is charged with the SPI
+    cost model and program/erase instructions with the part's busy times.
+    CPU time is what the host really spent in driver and simulator.
+
+    Output is CSV on stdout, one line per chip type, operation and size:
+        type,op,size,count,us_per_op,mb_per_s,bus_efficiency,cpu_ns_per_op
+    bus_efficiency is payload bytes / all bytes clocked on the bus.
+*/
+
+#define BENCH_TARGET_BYTES      (256 * 1024)    // data moved per measurement
+#define BENCH_MIN_COUNT         8
+#define BENCH_MAX_COUNT         1024
+
+typedef bool (*bench_fn_t)(w25qxx_dev_t *dev, uint32_t addr, uint8_t *buff, uint32_t len);
+
+typedef enum{
+    BENCH_READ = 0,
+    BENCH_WRITE,
+    BENCH_ERASE,
+}bench_kind_t;
+
+typedef struct
+{
+    const char   *name;
+    bench_kind_t kind;
+    uint32_t     unit;      // addressing unit of the function, largest size it takes
+    bench_fn_t   fn;
+
+}bench_op_t;
+
+
+static bool bench_readByte(w25qxx_dev_t *dev, uint32_t addr, uint8_t *buff, uint32_t len)
+{
+	(void)len;
+	return w25qxx_dev_readByte(dev, buff, addr);
+}
+
+static bool bench_readPage(w25qxx_dev_t *dev, uint32_t addr, uint8_t *buff, uint32_t len)
+{
+	return w25qxx_dev_readPage(dev, buff, addr / dev->page_size, 0, len);
+}
+
+static bool bench_readSector(w25qxx_dev_t *dev, uint32_t addr, uint8_t *buff, uint32_t len)
+{
+	return w25qxx_dev_readSector(dev, buff, addr / dev->sector_size, 0, len);
+}
+
+static bool bench_readBlock(w25qxx_dev_t *dev, uint32_t addr, uint8_t *buff, uint32_t len)
+{
+	return w25qxx_dev_readBlock(dev, buff, addr / dev->block_size, 0, len);
+}
+
+static bool bench_writeByte(w25qxx_dev_t *dev, uint32_t addr, uint8_t *buff, uint32_t len)
+{
+	(void)len;
+	return w25qxx_dev_writeByte(dev, buff, addr);
+}
+
+static bool bench_writePage(w25qxx_dev_t *dev, uint32_t addr, uint8_t *buff, uint32_t len)
+{
+	return w25qxx_dev_writePage(dev, buff, addr / dev->page_size, 0, len);
+}
+
+static bool bench_writeSector(w25qxx_dev_t *dev, uint32_t addr, uint8_t *buff, uint32_t len)
+{
+	return w25qxx_dev_writeSector(dev, buff, addr / dev->sector_size, 0, len);
+}
+
+static bool bench_writeBlock(w25qxx_dev_t *dev, uint32_t addr, uint8_t *buff, uint32_t len)
+{
+	return w25qxx_dev_writeBlock(dev, buff, addr / dev->block_size, 0, len);
+}
+
+static bool bench_eraseSector(w25qxx_dev_t *dev, uint32_t addr, uint8_t *buff, uint32_t len)
+{
+	(void)buff;
+	(void)len;
+	return w25qxx_dev_eraseSector(dev, addr / dev->sector_size);
+}
+
+static bool bench_eraseBlock32K(w25qxx_dev_t *dev, uint32_t addr, uint8_t *buff, uint32_t len)
+{
+	(void)buff;
+	(void)len;
+	return w25qxx_dev_eraseBlock32K(dev, addr / (dev->block_size / 2));
+}
+
+static bool bench_eraseBlock(w25qxx_dev_t *dev, uint32_t addr, uint8_t *buff, uint32_t len)
+{
+	(void)buff;
+	(void)len;
+	return w25qxx_dev_eraseBlock(dev, addr / dev->block_size);
+}
+
+static bool bench_eraseChip(w25qxx_dev_t *dev, uint32_t addr, uint8_t *buff, uint32_t len)
+{
+	(void)addr;
+	(void)buff;
+	(void)len;
+	return w25qxx_dev_eraseChip(dev);
+}
+
+
+static const bench_op_t bench_ops[] = {
+	{ "readByte",       BENCH_READ,  1,         bench_readByte      },
+	{ "readPage",       BENCH_READ,  0x100,     bench_readPage      },
+	{ "readSector",     BENCH_READ,  0x1000,    bench_readSector    },
+	{ "readBlock",      BENCH_READ,  0x10000,   bench_readBlock     },
+	{ "writeByte",      BENCH_WRITE, 1,         bench_writeByte     },
+	{ "writePage",      BENCH_WRITE, 0x100,     bench_writePage     },
+	{ "writeSector",    BENCH_WRITE, 0x1000,    bench_writeSector   },
+	{ "writeBlock",     BENCH_WRITE, 0x10000,   bench_writeBlock    },
+	{ "eraseSector",    BENCH_ERASE, 0x1000,    bench_eraseSector   },
+	{ "eraseBlock32K",  BENCH_ERASE, 0x8000,    bench_eraseBlock32K },
+	{ "eraseBlock",     BENCH_ERASE, 0x10000,   bench_eraseBlock    },
+	{ "eraseChip",      BENCH_ERASE, 0,         bench_eraseChip     },
+};
+
+static const uint32_t bench_sizes[] = { 1, 4, 16, 64, 256, 1024, 4096, 16384, 65536 };
+
+static const char *bench_type_names[] = {
+	[W25Q10] = "W25Q10",   [W25Q20] = "W25Q20",   [W25Q40] = "W25Q40",   [W25Q80] = "W25Q80",
+	[W25Q16] = "W25Q16",   [W25Q32] = "W25Q32",   [W25Q64] = "W25Q64",   [W25Q128] = "W25Q128",
+	[W25Q256] = "W25Q256", [W25Q512] = "W25Q512",
+};
+
+static uint8_t bench_buf[0x10000];
+
+
+static uint64_t bench_cpuNs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+
+/* Run count calls of one operation, unit apart from address 0, and print a CSV line */
+static bool bench_run(w25qxx_sim_t *sim, w25qxx_dev_t *dev, const bench_op_t *op, uint32_t size)
+{
+	uint32_t capacity = dev->capacity_kb * 1024;
+	uint32_t stride = op->unit ? op->unit : capacity;
+	uint32_t count = BENCH_TARGET_BYTES / size;
+	uint64_t t0, cpu0, data0, clocked0;
+	uint64_t ns, cpu, data, clocked;
+	double   bytes;
+
+	if (count < BENCH_MIN_COUNT)
+		count = BENCH_MIN_COUNT;
+	if (count > BENCH_MAX_COUNT)
+		count = BENCH_MAX_COUNT;
+	if (count > capacity / stride)
+		count = capacity / stride;
+
+	// writes start from erased flash, erases from written flash, neither is measured
+	if (op->kind == BENCH_WRITE){
+		if (!w25qxx_dev_erase(dev, 0, ((count * stride + dev->sector_size - 1) / dev->sector_size) * dev->sector_size))
+			return false;
+	}
+
+	t0 = w25qxx_sim_nowNs(sim);
+	cpu0 = bench_cpuNs();
+	data0 = sim->stats.data_bytes;
+	clocked0 = sim->stats.clocked_bytes;
+
+	for (uint32_t i = 0; i < count; ++i){
+		if (!op->fn(dev, i * stride, bench_buf, size))
+			return false;
+	}
+
+	ns = w25qxx_sim_nowNs(sim) - t0;
+	cpu = bench_cpuNs() - cpu0;
+	data = sim->stats.data_bytes - data0;
+	clocked = sim->stats.clocked_bytes - clocked0;
+	bytes = (double)count * size;
+
+	printf("%s,%s,%u,%u,%.3f,%.4f,%.4f,%.0f\n", bench_type_names[dev->type], op->name, size, count,
+			ns / 1e3 / count, bytes / (ns / 1e9) / 1e6, clocked ? (double)data / clocked : 0.0, (double)cpu / count);
+
+	return true;
+}
+
+
+static bool bench_type(w25qxx_t type)
+{
+	w25qxx_sim_t sim;
+	w25qxx_dev_t dev;
+	bool ok = true;
+
+	if (!w25qxx_sim_open(&sim, type, NULL, NULL))
+		return false;
+
+	memset(&dev, 0, sizeof(dev));
+	w25qxx_sim_attach(&sim, &dev);
+
+	if (!w25qxx_dev_init(&dev)){
+		w25qxx_sim_close(&sim);
+		return false;
+	}
+
+	for (uint32_t o = 0; ok && (o < sizeof(bench_ops) / sizeof(bench_ops[0])); ++o){
+		const bench_op_t *op = &bench_ops[o];
+
+		// erases have a fixed size, byte functions a single one
+		if (op->kind == BENCH_ERASE){
+			ok = bench_run(&sim, &dev, op, op->unit ? op->unit : dev.capacity_kb * 1024);
+			continue;
+		}
+
+		for (uint32_t s = 0; ok && (s < sizeof(bench_sizes) / sizeof(bench_sizes[0])); ++s){
+			if (bench_sizes[s] <= op->unit)
+				ok = bench_run(&sim, &dev, op, bench_sizes[s]);
+		}
+	}
+
+	w25qxx_sim_close(&sim);
+
+	return ok;
+}
+
+
+int main(void)
+{
+	int res = 0;
+
+	for (uint32_t i = 0; i < sizeof(bench_buf); ++i)
+		bench_buf[i] = (uint8_t)(i * 7 + 3);
+
+	printf("type,op,size,count,us_per_op,mb_per_s,bus_efficiency,cpu_ns_per_op\n");
+
+	for (w25qxx_t type = W25Q10; type <= W25Q512; ++type){
+#ifdef W25QXX_FIXED_TYPE
+		// the library only drives its one part
+		if (type != W25QXX_FIXED_TYPE)
+			continue;
+#endif
+		if (!bench_type(type)){
+			fprintf(stderr, "%s: benchmark failed\n", bench_type_names[type]);
+			res = 1;
+		}
+	}
+
+	return res;
+}
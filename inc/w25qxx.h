@@ -12,8 +12,143 @@ typedef uint8_t (*w25qxx_interface_write_byte_t)(char data);
 typedef void    (*w25qxx_interface_enable_t)(bool en);
 typedef int32_t (*w25qxx_get_time_t)(void);
 typedef void    (*w25qxx_delay_t)(uint32_t ms);
+typedef void    (*w25qxx_delay_us_t)(uint32_t us);
+typedef uint32_t (*w25qxx_get_time_us_t)(void);
 
+
+#define W25QXX_HEADER_MAX   8
+#define W25QXX_WRAP_UNKNOWN 0xFF
+#define W25QXX_OP_TYPE_COUNT 5      // entries of w25qxx_op_type_t
+
+#define W25QXX_MAX_PAGE_SIZE 256     // largest page accepted from SFDP
+
+#ifndef W25QXX_STREAM_CHUNK
+#define W25QXX_STREAM_CHUNK 256     // stack buffer of read-back verify and flash CRC
+#endif
+
+/*
+    One bus transaction: CS low, header, data phase, CS high.
+    The header holds opcode, address and dummy bytes exactly as clocked on the bus.
+    The first cmd_len header bytes go out on one line, the rest of the header on
+    addr_lines and the data phase on data_lines (1, 2 or 4).
+*/
 typedef struct
+{
+    uint8_t        header[W25QXX_HEADER_MAX];
+    uint8_t        header_len;
+    uint8_t        cmd_len;     // 1, 0 in Quad I/O continuous read mode
+    uint8_t        addr_lines;
+    uint8_t        data_lines;
+    const uint8_t  *tx;     // data to send, NULL for reads
+    uint8_t        *rx;     // data to receive, NULL for writes
+    uint32_t       len;     // data phase length
+    void           *user;   // w25qxx_dev_t.user of the issuing device
+
+}w25qxx_transfer_t;
+
+/*
+    Build for one part only: define W25QXX_FIXED_TYPE as a w25qxx_t value
+    (e.g. -DW25QXX_FIXED_TYPE=W25Q64). Geometry, address length and opcodes
+    become constants, SFDP discovery and the unused address width are compiled
+    out and init fails on any other part.
+*/
+#ifdef W25QXX_FIXED_TYPE
+#define W25QXX_FIXED_PAGE_SIZE      256u
+#define W25QXX_FIXED_SECTOR_SIZE    0x1000u
+#define W25QXX_FIXED_BLOCK_SIZE     0x10000u
+#define W25QXX_FIXED_CAPACITY_KB    (128u << (W25QXX_FIXED_TYPE - W25Q10))
+#define W25QXX_FIXED_ADDR_4BYTE     (W25QXX_FIXED_TYPE >= W25Q256)
+#endif
+
+/* Capabilities: erase sizes and addressing of parts above 16MB */
+#define W25QXX_ERASE_4K     0x01
+#define W25QXX_ERASE_32K    0x02
+#define W25QXX_ERASE_64K    0x04
+
+typedef enum{
+    W25QXX_ADDR_3BYTE = 0,
+    W25QXX_ADDR_4BYTE_OPCODES,  // dedicated 4-byte address instructions (0Ch, 12h, 21h, ...)
+    W25QXX_ADDR_4BYTE_MODE,     // B7h entered, standard instructions take 4 address bytes
+}w25qxx_addr_mode_t;
+
+
+/* Optional, handles CS itself and returns 0 on success */
+typedef uint8_t (*w25qxx_interface_transfer_t)(const w25qxx_transfer_t *xfer);
+
+
+/* Latency classes of the histograms */
+typedef enum{
+    W25QXX_LAT_READ = 0,
+    W25QXX_LAT_PAGE_PROGRAM,
+    W25QXX_LAT_SECTOR_ERASE,
+    W25QXX_LAT_BLOCK_ERASE,     // 32KB and 64KB
+    W25QXX_LAT_CHIP_ERASE,
+    W25QXX_LAT_COUNT,
+}w25qxx_latency_t;
+
+/* Bucket i counts latencies of 2^i ~ 2^(i+1)-1 us, bucket 0 also 0 us, the last one everything above */
+#define W25QXX_HIST_BUCKETS 28
+
+/*
+    Performance counters, kept per device when the library is built with
+    W25QXX_STATS defined, otherwise compiled out.
+*/
+typedef struct
+{
+    uint32_t commands[256];     // transactions per opcode, continuous Quad I/O reads count as EBh/ECh
+    uint32_t transactions;      // CS cycles
+    uint64_t bytes_read;        // data phase, chip to host
+    uint64_t bytes_written;     // data phase, host to chip
+    uint32_t sr1_polls;         // busy polls of SR1
+    uint32_t timeouts;
+    uint32_t verify_errors;     // read-back mismatches
+    uint32_t latency[W25QXX_LAT_COUNT][W25QXX_HIST_BUCKETS];
+
+}w25qxx_stats_t;
+
+/* Datasheet program/erase times of a part, typical and maximum */
+typedef struct
+{
+    uint32_t t_pp_us;       // page program
+    uint32_t t_se_ms;       // 4KB sector erase
+    uint32_t t_be32_ms;     // 32KB block erase
+    uint32_t t_be64_ms;     // 64KB block erase
+    uint32_t t_ce_ms;       // chip erase
+
+    uint32_t t_pp_max_us;
+    uint32_t t_se_max_ms;
+    uint32_t t_be32_max_ms;
+    uint32_t t_be64_max_ms;
+    uint32_t t_ce_max_ms;
+
+}w25qxx_timing_t;
+
+
+/* Outcome of smart writes, counted since the last reset by the caller */
+typedef struct
+{
+    uint32_t pages_unchanged;   // skipped, flash already holds the data
+    uint32_t pages_programmed;  // only 1->0 transitions, programmed without erase
+    uint32_t pages_rewritten;   // programmed again after a sector erase
+    uint32_t sectors_erased;
+
+}w25qxx_smart_stats_t;
+
+
+/*
+    Program/erase listener. changed() runs right after the instruction is
+    issued, erase: [addr, addr + len) is being erased, else programmed.
+*/
+typedef struct w25qxx_notify
+{
+    void (*changed)(struct w25qxx_notify *n, uint32_t addr, uint32_t len, bool erase);
+    void *user;             // free for the listener
+    struct w25qxx_notify *next;
+
+}w25qxx_notify_t;
+
+
+typedef struct w25qxx_dev
 {
     w25qxx_interface_write_byte_t interface_write_byte;
     // Function pointers
@@ -22,6 +157,10 @@ typedef struct
     w25qxx_interface_enable_t interface_enable;
     w25qxx_get_time_t         get_time;
     w25qxx_delay_t            delay;
+    w25qxx_interface_transfer_t interface_transfer;   // NULL: byte-wise callbacks
+    void                      *user;    // backend context, handed over in w25qxx_transfer_t
+    w25qxx_delay_us_t         delay_us; // optional, suspend guard times fall back to delay(1)
+    w25qxx_get_time_us_t      get_time_us;  // optional, latency histograms fall back to get_time()
 
 
     w25qxx_t type;
@@ -37,13 +176,247 @@ typedef struct
     uint32_t block_count;
     uint32_t capacity_kb;// kilobyte
 
+    w25qxx_read_mode_t read_mode;
+    bool     quad_program;
+    bool     continuous_read;   // chip holds Quad I/O continuous read mode
+    uint8_t  burst_wrap;        // wrap length of Quad I/O reads, 0: linear, W25QXX_WRAP_UNKNOWN after init
+
+    uint8_t  *smart_scratch;    // sector_size bytes, not NULL: smart write mode
+    bool     verify;            // read back blocking programs
+    w25qxx_smart_stats_t smart_stats;
+
+    struct w25qxx_op *pending;  // non-blocking operation in flight
+    uint8_t  suspend_limit;     // suspends allowed per erase/program, 0: reads wait
+    int32_t  suspend_time;      // get_time() of the last suspend
+    int32_t  resume_time;       // get_time() of the last resume
+
+    uint32_t busy_est_us[W25QXX_OP_TYPE_COUNT];  // learned program/erase times, index w25qxx_op_type_t
+
+    w25qxx_notify_t *notify;    // program/erase listeners, caches and erase maps
+
+    /* Capabilities, from the SFDP table when the part has one, else the W25Qxx values of type */
+    bool     sfdp;              // parsed from SFDP
+    uint8_t  bus_lines;         // data lines the backend wires (1, 2, 4), init picks the fastest read up to it
+    uint8_t  addr_mode;         // w25qxx_addr_mode_t
+    uint8_t  erase_sizes;       // W25QXX_ERASE_xxx
+    uint8_t  read_modes;        // bit (1 << w25qxx_read_mode_t) per supported read mode
+    uint8_t  read_cmd[4];       // FAST, DUAL_OUTPUT, QUAD_OUTPUT, QUAD_IO opcodes with 3 address bytes
+    uint8_t  read_dummy[4];     // mode + dummy bytes clocked on the address lines
+    w25qxx_timing_t timing;
+
+#ifdef W25QXX_STATS
+    w25qxx_stats_t stats;
+#endif
+
 }w25q32_init_t;
 
+/* Device handle, one per chip */
+typedef w25q32_init_t w25qxx_dev_t;
+
+/* Sequential writer, buffers at most the partial page at the current position */
+typedef struct
+{
+    w25qxx_dev_t *dev;
+    uint32_t addr;                  // flash address of buf[0]
+    uint16_t fill;
+    uint8_t  buf[W25QXX_MAX_PAGE_SIZE];
+
+}w25qxx_writer_t;
+
+
+
+typedef enum{
+    W25QXX_OP_ERASE_SECTOR = 0,
+    W25QXX_OP_ERASE_BLOCK,
+    W25QXX_OP_ERASE_BLOCK_32K,
+    W25QXX_OP_ERASE_CHIP,
+    W25QXX_OP_WRITE,
+}w25qxx_op_type_t;
+
+typedef enum{
+    W25QXX_OP_BUSY = 0,
+    W25QXX_OP_DONE,
+    W25QXX_OP_ERROR,
+}w25qxx_op_status_t;
+
+typedef struct w25qxx_op w25qxx_op_t;
+
+typedef void (*w25qxx_op_callback_t)(w25qxx_op_t *op);
+
+/* Non-blocking operation, advanced by w25qxx_opPoll, one per device at a time */
+struct w25qxx_op
+{
+    w25qxx_dev_t         *dev;
+    w25qxx_op_type_t     type;
+    w25qxx_op_status_t   status;
+    uint8_t              state;
+    uint32_t             addr;      // next byte address
+    uint32_t             range_start;   // bytes [range_start, range_end) the operation changes,
+    uint32_t             range_end;     // reads inside wait for it instead of suspending
+    const uint8_t        *buff;     // next source byte of a write
+    uint32_t             remain;    // bytes left to program
+    int32_t              start_time;
+    uint8_t              suspends;  // times a read suspended this operation
+    w25qxx_op_callback_t callback;
+    void                 *user;     // free for the caller
+#ifdef W25QXX_STATS
+    uint32_t             issue_us;  // last instruction issued, for the latency histograms
+#endif
+};
+
+
+/*
+    Handle based API. Every call works on the given device only, separate
+    devices can be driven from separate threads.
+*/
 
 /* Read Functions */
 
+bool w25qxx_dev_read(w25qxx_dev_t *dev, uint32_t addr, uint8_t *buff, uint32_t len);
+
+bool w25qxx_dev_readByte(w25qxx_dev_t *dev, uint8_t *buff, uint32_t bytes_addr);
+
+/* Line fill: the len byte aligned line holding addr, starting at addr and wrapping to the line start */
+bool w25qxx_dev_readWrap(w25qxx_dev_t *dev, uint32_t addr, uint8_t *buff, uint8_t len);
+
+bool w25qxx_dev_readPage(w25qxx_dev_t *dev, uint8_t *buff, uint32_t page_addr, 
+                            uint32_t OffsetInByte, uint32_t NumByteToRead_up_to_PageSize);
+
+bool w25qxx_dev_readSector(w25qxx_dev_t *dev, uint8_t *buff, uint32_t sector_addr, 
+                            uint32_t OffsetInByte, uint32_t NumByteToRead_up_to_SectorSize);
+
+bool w25qxx_dev_readBlock(w25qxx_dev_t *dev, uint8_t *buff, uint32_t block_addr, 
+                            uint32_t OffsetInByte, uint32_t NumByteToRead_up_to_BlockSize);
+
+
+/* Write Functions */
+
+bool w25qxx_dev_writeByte(w25qxx_dev_t *dev, const uint8_t* buff, uint32_t WriteAddr_inBytes);
+
+bool w25qxx_dev_writePage(w25qxx_dev_t *dev, const uint8_t *buff, uint32_t page_addr, 
+                            uint32_t OffsetInByte, uint32_t NumByteToWrite_up_to_PageSize);
+
+bool w25qxx_dev_writeSector(w25qxx_dev_t *dev, const uint8_t *buff, uint32_t sector_addr, 
+                            uint32_t OffsetInByte, uint32_t NumByteToWrite_up_to_SectorSize);
+
+bool w25qxx_dev_writeBlock(w25qxx_dev_t *dev, const uint8_t *buff, uint32_t block_addr, 
+                            uint32_t OffsetInByte, uint32_t NumByteToWrite_up_to_BlockSize);
+
+/* Skip unchanged pages, program 1->0 only pages, erase a sector only when needed */
+bool w25qxx_dev_writeSmart(w25qxx_dev_t *dev, uint32_t addr, const uint8_t *buff, uint32_t len);
+
+/* Any address and length, one program per touched page, no boundary clamping */
+bool w25qxx_dev_write(w25qxx_dev_t *dev, uint32_t addr, const uint8_t *buff, uint32_t len);
+
+/* Stream writer: appends are collected into whole pages, close programs the tail */
+bool w25qxx_dev_writerOpen(w25qxx_dev_t *dev, w25qxx_writer_t *w, uint32_t addr);
+
+bool w25qxx_dev_writerAppend(w25qxx_writer_t *w, const uint8_t *buff, uint32_t len);
+
+bool w25qxx_dev_writerClose(w25qxx_writer_t *w);
+
+
+/* Erease Functions */
+
+bool w25qxx_dev_eraseBlock(w25qxx_dev_t *dev, uint32_t block_addr);
+
+bool w25qxx_dev_eraseSector(w25qxx_dev_t *dev, uint32_t sector_addr);
+
+bool w25qxx_dev_eraseBlock32K(w25qxx_dev_t *dev, uint32_t block32_addr);
+
+bool w25qxx_dev_eraseChip(w25qxx_dev_t *dev);
+
+bool w25qxx_dev_erase(w25qxx_dev_t *dev, uint32_t addr, uint32_t len);
+
+const w25qxx_timing_t* w25qxx_getTiming(w25qxx_t type);
+
+
+/* Non-blocking Functions */
+
+bool w25qxx_dev_eraseSectorStart(w25qxx_dev_t *dev, w25qxx_op_t *op, uint32_t sector_addr,
+                                    w25qxx_op_callback_t callback);
+
+bool w25qxx_dev_eraseBlockStart(w25qxx_dev_t *dev, w25qxx_op_t *op, uint32_t block_addr,
+                                    w25qxx_op_callback_t callback);
+
+bool w25qxx_dev_eraseChipStart(w25qxx_dev_t *dev, w25qxx_op_t *op, w25qxx_op_callback_t callback);
+
+bool w25qxx_dev_writePageStart(w25qxx_dev_t *dev, w25qxx_op_t *op, const uint8_t *buff, uint32_t page_addr,
+                                uint32_t OffsetInByte, uint32_t NumByteToWrite_up_to_PageSize,
+                                w25qxx_op_callback_t callback);
+
+bool w25qxx_dev_writeStart(w25qxx_dev_t *dev, w25qxx_op_t *op, uint32_t addr, const uint8_t *buff, uint32_t len,
+                            w25qxx_op_callback_t callback);
+
+w25qxx_op_status_t w25qxx_opPoll(w25qxx_op_t *op);
+
+
+/* Init Function */
+bool w25qxx_dev_init(w25qxx_dev_t *dev);
+
+/* Read Register */
+
+uint8_t w25qxx_dev_readRegX(w25qxx_dev_t *dev, uint8_t reg_x);
+
+
+/* Dual / Quad SPI */
+
+bool w25qxx_dev_setQuadEnable(w25qxx_dev_t *dev, bool en);
+
+bool w25qxx_dev_setReadMode(w25qxx_dev_t *dev, w25qxx_read_mode_t mode);
+
+bool w25qxx_dev_setQuadProgram(w25qxx_dev_t *dev, bool en);
+
+/* Wrap length 8/16/32/64 of Quad I/O reads, 0: linear. Needs a Quad I/O read mode, sent only on change */
+bool w25qxx_dev_setBurstWrap(w25qxx_dev_t *dev, uint8_t len);
+
+/* scratch of sector_size bytes routes writePage/writeSector through writeSmart, NULL turns it off */
+void w25qxx_dev_setSmartWrite(w25qxx_dev_t *dev, uint8_t *scratch);
+
+/* Reads during a non-blocking erase/program suspend it at most limit times, 0: reads wait */
+void w25qxx_dev_setSuspendLimit(w25qxx_dev_t *dev, uint8_t limit);
+
+/* Read back every blocking program (writeByte/Page/Sector/Block/Smart), a mismatch fails the write */
+void w25qxx_dev_setVerify(w25qxx_dev_t *dev, bool en);
+
+
+/* Integrity */
+
+/* Streamed compare of flash with buff, no buffer of len bytes needed */
+bool w25qxx_dev_verify(w25qxx_dev_t *dev, uint32_t addr, const uint8_t *buff, uint32_t len);
+
+/* CRC-32 of a flash range, streamed through W25QXX_STREAM_CHUNK bytes */
+bool w25qxx_dev_crc32(w25qxx_dev_t *dev, uint32_t addr, uint32_t len, uint32_t *crc);
+
+/* CRC-32 (zlib crc32()) of RAM data, start with crc 0 and feed the result back to continue */
+uint32_t w25qxx_crc32Update(uint32_t crc, const uint8_t *data, uint32_t len);
+
+/* Program/erase listeners, several per device */
+void w25qxx_dev_addNotify(w25qxx_dev_t *dev, w25qxx_notify_t *n);
+
+void w25qxx_dev_removeNotify(w25qxx_dev_t *dev, w25qxx_notify_t *n);
+
+
+/* Instrumentation, false / no-op when the library is built without W25QXX_STATS */
+
+bool w25qxx_dev_getStats(w25qxx_dev_t *dev, w25qxx_stats_t *snapshot);
+
+void w25qxx_dev_resetStats(w25qxx_dev_t *dev);
+
+
+
+/*
+    Compatibility API, works on the default instance returned by w25qxx_getStruct()
+*/
+
+/* Read Functions */
+
+bool w25qxx_read(uint32_t addr, uint8_t *buff, uint32_t len);
+
 bool w25qxx_readByte(uint8_t *buff, uint32_t bytes_addr);
 
+bool w25qxx_readWrap(uint32_t addr, uint8_t *buff, uint8_t len);
+
 bool w25qxx_readPage(uint8_t *buff, uint32_t page_addr, 
 						uint32_t OffsetInByte, uint32_t NumByteToRead_up_to_PageSize);
 
@@ -67,6 +440,12 @@ bool w25qxx_writeSector(const uint8_t *buff, uint32_t sector_addr,
 bool w25qxx_writeBlock(const uint8_t *buff, uint32_t block_addr, 
 							uint32_t OffsetInByte, uint32_t NumByteToWrite_up_to_BlockSize);
 
+bool w25qxx_writeSmart(uint32_t addr, const uint8_t *buff, uint32_t len);
+
+bool w25qxx_write(uint32_t addr, const uint8_t *buff, uint32_t len);
+
+bool w25qxx_writerOpen(w25qxx_writer_t *w, uint32_t addr);
+
 
 /* Erease Functions */
 
@@ -74,9 +453,28 @@ bool w25qxx_eraseBlock(uint32_t block_addr);
 
 bool w25q32_eraseSector(uint32_t sector_addr);
 
+bool w25qxx_eraseBlock32K(uint32_t block32_addr);
+
+bool w25qxx_erase(uint32_t addr, uint32_t len);
+
 int8_t w25q32_eraseChip(void);
 
 
+/* Non-blocking Functions */
+
+bool w25qxx_eraseSectorStart(w25qxx_op_t *op, uint32_t sector_addr, w25qxx_op_callback_t callback);
+
+bool w25qxx_eraseBlockStart(w25qxx_op_t *op, uint32_t block_addr, w25qxx_op_callback_t callback);
+
+bool w25qxx_eraseChipStart(w25qxx_op_t *op, w25qxx_op_callback_t callback);
+
+bool w25qxx_writePageStart(w25qxx_op_t *op, const uint8_t *buff, uint32_t page_addr,
+                            uint32_t OffsetInByte, uint32_t NumByteToWrite_up_to_PageSize,
+                            w25qxx_op_callback_t callback);
+
+bool w25qxx_writeStart(w25qxx_op_t *op, uint32_t addr, const uint8_t *buff, uint32_t len,
+                        w25qxx_op_callback_t callback);
+
 /* Init Function */
 bool w25qxx_init(void);
 
@@ -85,8 +483,37 @@ bool w25qxx_init(void);
 uint8_t w25qxx_readRegX(uint8_t reg_x);
 
 
+/* Dual / Quad SPI */
+
+bool w25qxx_setQuadEnable(bool en);
+
+bool w25qxx_setReadMode(w25qxx_read_mode_t mode);
+
+bool w25qxx_setQuadProgram(bool en);
+
+bool w25qxx_setBurstWrap(uint8_t len);
+
+void w25qxx_setSmartWrite(uint8_t *scratch);
+
+void w25qxx_setSuspendLimit(uint8_t limit);
+
+void w25qxx_setVerify(bool en);
+
+
+/* Integrity */
+
+bool w25qxx_verify(uint32_t addr, const uint8_t *buff, uint32_t len);
+
+bool w25qxx_crc32(uint32_t addr, uint32_t len, uint32_t *crc);
+
+
 /*  */
 
 w25q32_init_t* w25qxx_getStruct(void);
 
+/* Copy of the counters, false when the library is built without W25QXX_STATS */
+bool w25qxx_getStats(w25qxx_stats_t *snapshot);
+
+void w25qxx_resetStats(void);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,73 @@
+#ifndef __W25QXX_ARRAY__
+#define __W25QXX_ARRAY__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "w25qxx.h"
+
+#define W25QXX_ARRAY_MAX_MEMBERS    4
+
+/*
+    STRIPED:  logical pages are dealt round robin over the members, page P lives
+              on member P % n at page P / n. A logical sector is the same sector
+              on every member, so its erase runs on all chips at once and page
+              programs of consecutive pages overlap their tPP.
+    MIRRORED: every member holds the full volume. Programs go to all members in
+              parallel, erases are staggered member by member and reads are served
+              by a member that is not busy.
+*/
+typedef enum{
+    W25QXX_ARRAY_STRIPED = 0,
+    W25QXX_ARRAY_MIRRORED,
+}w25qxx_array_mode_t;
+
+
+typedef struct
+{
+    w25qxx_array_mode_t mode;
+    uint8_t       member_count;
+    w25qxx_dev_t  *member[W25QXX_ARRAY_MAX_MEMBERS];
+    w25qxx_op_t   op[W25QXX_ARRAY_MAX_MEMBERS];     // outstanding operation per member
+    bool          busy[W25QXX_ARRAY_MAX_MEMBERS];
+    bool          error;
+
+    /* Mirrored erase in progress, logical range already reads as 0xFF */
+    w25qxx_op_type_t erase_type;
+    uint32_t      erase_addr;
+    uint32_t      erase_len;
+    uint8_t       erase_next;                       // next member to start
+    uint8_t       read_next;                        // round robin over idle mirrors
+
+    /* Logical geometry, same meaning as in w25q32_init_t */
+    uint16_t page_size;
+    uint32_t page_count;
+    uint32_t sector_size;
+    uint32_t sector_count;
+    uint32_t block_size;
+    uint32_t block_count;
+    uint32_t capacity_kb;// kilobyte
+
+}w25qxx_array_t;
+
+
+bool w25qxx_array_init(w25qxx_array_t *arr, w25qxx_array_mode_t mode,
+                        w25qxx_dev_t **members, uint8_t member_count);
+
+bool w25qxx_array_read(w25qxx_array_t *arr, uint32_t addr, uint8_t *buff, uint32_t len);
+
+/* Program erased space, returns once every member finished */
+bool w25qxx_array_write(w25qxx_array_t *arr, uint32_t addr, const uint8_t *buff, uint32_t len);
+
+/* Erases return once started, w25qxx_array_poll / w25qxx_array_sync complete them */
+bool w25qxx_array_eraseSector(w25qxx_array_t *arr, uint32_t sector_addr);
+
+bool w25qxx_array_eraseBlock(w25qxx_array_t *arr, uint32_t block_addr);
+
+/* Advance outstanding member operations, true when the array is idle */
+bool w25qxx_array_poll(w25qxx_array_t *arr);
+
+/* Wait for all outstanding operations, false if any of them failed */
+bool w25qxx_array_sync(w25qxx_array_t *arr);
+
+#endif
@@ -0,0 +1,129 @@
+#ifndef __W25QXX_BUS__
+#define __W25QXX_BUS__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "w25qxx.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define W25QXX_BUS_PTHREAD
+#include <pthread.h>
+#endif
+
+#ifndef W25QXX_BUS_QUEUE_LEN
+#define W25QXX_BUS_QUEUE_LEN        8       // queued reads, and queued writes/erases, each
+#endif
+
+/*
+    Shared access to one device from several threads.
+
+    Callers queue requests instead of driving the chip. Whoever finds the bus
+    free while waiting for a request (or a thread in w25qxx_bus_run) becomes
+    the executor for one step and serves the queue for everyone: reads first,
+    then one page of the oldest write or one erase of the oldest erase. A read
+    overlapping a write/erase queued before it waits for that one to finish,
+    so it sees the data in submission order. Erases run as non-blocking
+    operations, so disjoint reads are served (and suspend them with a suspend
+    limit set) while the erase is busy, and a long write lets queued reads in
+    between its pages. Only the executor touches the device.
+
+    Locking goes through w25qxx_bus_sync_t, pthreads by default on Linux.
+*/
+
+/* lock/unlock a mutex, wait: unlock, sleep until signal, lock again, signal: wake all waiters */
+typedef struct
+{
+    void (*lock)(void *ctx);
+    void (*unlock)(void *ctx);
+    void (*wait)(void *ctx);
+    void (*signal)(void *ctx);
+    void *ctx;
+
+}w25qxx_bus_sync_t;
+
+
+typedef enum{
+    W25QXX_BUS_READ = 0,
+    W25QXX_BUS_WRITE,       // programs erased space, any alignment
+    W25QXX_BUS_ERASE,       // sector aligned range
+}w25qxx_bus_kind_t;
+
+typedef struct w25qxx_bus_req w25qxx_bus_req_t;
+
+typedef void (*w25qxx_bus_callback_t)(w25qxx_bus_req_t *req);
+
+struct w25qxx_bus_req
+{
+    w25qxx_bus_kind_t    kind;
+    uint32_t             addr;
+    uint8_t              *rx;       // read destination
+    const uint8_t        *tx;       // write source, must stay valid until done
+    uint32_t             len;
+    w25qxx_bus_callback_t callback; // runs in the executing thread before status leaves BUSY,
+                                    // done == len on success, NULL: none
+    void                 *user;     // free for the caller
+
+    /* Owned by the bus until status leaves W25QXX_OP_BUSY */
+    w25qxx_op_status_t   status;
+    uint32_t             done;      // bytes completed
+    uint32_t             seq;       // submission order
+    w25qxx_bus_req_t     *next;
+};
+
+
+typedef struct
+{
+    w25qxx_dev_t      *dev;
+    w25qxx_bus_sync_t sync;
+
+    w25qxx_bus_req_t  *reads;       // FIFO of queued reads
+    w25qxx_bus_req_t  *writes;      // FIFO of queued writes and erases
+    uint8_t           read_count;
+    uint8_t           write_count;
+    uint32_t          seq;          // next submission number
+    w25qxx_bus_req_t  *active;      // write/erase in progress
+    w25qxx_op_t       op;           // erase step of active
+    uint32_t          op_size;      // bytes erased by op
+    bool              op_running;
+    bool              owned;        // a thread is executing a step
+    bool              stop;
+
+#ifdef W25QXX_BUS_PTHREAD
+    pthread_mutex_t   mutex;
+    pthread_cond_t    cond;
+#endif
+
+}w25qxx_bus_t;
+
+
+/* sync NULL: pthreads (Linux / macOS only) */
+bool w25qxx_bus_init(w25qxx_bus_t *bus, w25qxx_dev_t *dev, const w25qxx_bus_sync_t *sync);
+
+void w25qxx_bus_deinit(w25qxx_bus_t *bus);
+
+/* Queue a request, blocks (serving the bus if it is free) while the queue of its kind is full */
+bool w25qxx_bus_submit(w25qxx_bus_t *bus, w25qxx_bus_req_t *req);
+
+/* Block until req completed, serving the bus meanwhile if no other thread does */
+bool w25qxx_bus_wait(w25qxx_bus_t *bus, w25qxx_bus_req_t *req);
+
+/* Status of req without blocking */
+w25qxx_op_status_t w25qxx_bus_poll(w25qxx_bus_t *bus, w25qxx_bus_req_t *req);
+
+/* Run one step if the bus is free, true while requests are pending */
+bool w25qxx_bus_process(w25qxx_bus_t *bus);
+
+/* Executor loop for a dedicated thread, returns after w25qxx_bus_stop */
+void w25qxx_bus_run(w25qxx_bus_t *bus);
+
+void w25qxx_bus_stop(w25qxx_bus_t *bus);
+
+/* Blocking helpers: submit and wait */
+bool w25qxx_bus_read(w25qxx_bus_t *bus, uint32_t addr, uint8_t *buff, uint32_t len);
+
+bool w25qxx_bus_write(w25qxx_bus_t *bus, uint32_t addr, const uint8_t *buff, uint32_t len);
+
+bool w25qxx_bus_erase(w25qxx_bus_t *bus, uint32_t addr, uint32_t len);
+
+#endif
@@ -22,13 +22,53 @@
 #define CMD_Unique_ID       			0x4B
 #define CMD_Erase_Chip      			0xC7
 #define CMD_Erase_Sector				0x20
+#define CMD_Erase_Block_32K 			0x52
 #define CMD_Erase_Block_64K 			0xD8
 
 #define CMD_Erase_Sector_4_Byte_Addr 	0x21
+#define CMD_Erase_Block_32K_4_Byte_Addr 0x5C
 #define CMD_Erase_Block_64K_4_Byte_Addr 0xDC
 #define CMD_Page_Program_4_Byte_Addr	0x12
 #define CMD_Fast_Read_4_Byte_Addr       0x0C
 
+#define CMD_Fast_Read_Dual_Output			0x3B
+#define CMD_Fast_Read_Quad_Output			0x6B
+#define CMD_Fast_Read_Quad_IO				0xEB
+#define CMD_Quad_Page_Program				0x32
+#define CMD_Fast_Read_Dual_Output_4_Byte_Addr	0x3C
+#define CMD_Fast_Read_Quad_Output_4_Byte_Addr	0x6C
+#define CMD_Fast_Read_Quad_IO_4_Byte_Addr		0xEC
+#define CMD_Quad_Page_Program_4_Byte_Addr		0x34
+
+#define CMD_Erase_Program_Suspend			0x75
+#define CMD_Erase_Program_Resume			0x7A
+
+/* Suspend to ready (max) and resume to next suspend (min) */
+#define W25QXX_T_SUS_US						20
+#define W25QXX_T_RS_US						20
+
+/* Busy polling: first and largest back-off step of waits without a timing model, slack on datasheet maxima */
+#define W25QXX_POLL_MIN_US					8
+#define W25QXX_POLL_MAX_US					1000
+#define W25QXX_TIMEOUT_MARGIN_MS			10
+
+#define CMD_Set_Burst_With_Wrap				0x77
+
+#define CMD_Read_SFDP						0x5A
+#define CMD_Enter_4_Byte_Mode				0xB7
+#define CMD_Exit_4_Byte_Mode				0xE9
+
+/* SFDP: signature "SFDP" and the Basic Flash Parameter Table ID */
+#define W25QXX_SFDP_SIGNATURE				0x50444653
+#define W25QXX_SFDP_BFPT_ID					0xFF00
+#define W25QXX_SFDP_BFPT_MAX				16			// dwords of the BFPT used (JESD216B)
+
+/* W6-4 of Set Burst with Wrap: W4 = 1 linear, W6-5 = wrap length 8/16/32/64 */
+#define W25QXX_WRAP_DISABLE					0x10
+
+/* M7-0 of Quad I/O read, M5-4 = 10b keeps continuous read mode */
+#define W25QXX_CONTINUOUS_READ_MODE			0xA0
+
 
 #define SR1_S0_BUSY			(unsigned char)(1<<0)
 #define SR1_S1_WEL  		(unsigned char)(1<<1)
@@ -54,4 +94,13 @@ typedef enum{
 }w25qxx_t;
 
 
+typedef enum{
+	W25QXX_READ_FAST = 0,			// 0Bh
+	W25QXX_READ_DUAL_OUTPUT,		// 3Bh
+	W25QXX_READ_QUAD_OUTPUT,		// 6Bh
+	W25QXX_READ_QUAD_IO,			// EBh
+	W25QXX_READ_QUAD_IO_CONTINUOUS,	// EBh, M7-0 = Ax
+}w25qxx_read_mode_t;
+
+
 #endif
\ No newline at end of file
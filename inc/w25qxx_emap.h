@@ -0,0 +1,78 @@
+#ifndef __W25QXX_EMAP__
+#define __W25QXX_EMAP__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "w25qxx.h"
+
+#define W25QXX_EMAP_BYTES(sectors)  (((sectors) + 3) / 4)     // map storage, 2 bits per sector
+
+typedef enum{
+    W25QXX_EMAP_DIRTY = 0,      // holds data or unknown
+    W25QXX_EMAP_ERASED,         // all 0xFF, programs need no erase
+    W25QXX_EMAP_FREE,           // discarded, erased in the background
+}w25qxx_emap_state_t;
+
+/*
+    Erase state of every sector. The map is rebuilt at mount by a blank scan
+    (a sector stops being read at its first programmed byte) or taken from a
+    copy saved by the application. It follows every program and erase issued
+    on the device through a w25qxx_notify_t listener, w25qxx_emap_discard()
+    marks whole sectors free and w25qxx_emap_idle() erases free sectors with
+    non-blocking operations, a whole 64KB block where the block is all free.
+    w25qxx_emap_prepare() then erases only what is not erased already, taking
+    the erase time out of the write path.
+*/
+typedef struct
+{
+    w25qxx_notify_t notify;     // first member, the listener is the map
+    w25qxx_dev_t *dev;
+    uint8_t  *map;              // W25QXX_EMAP_BYTES(sector_count) bytes
+    uint32_t cursor;            // next sector looked at by idle
+    uint32_t free_count;
+    bool     changed;           // map differs from the last saved copy
+    w25qxx_op_t op;             // background erase
+    bool     op_running;
+    uint32_t op_sector;         // first sector of op
+    uint32_t op_sectors;
+
+    uint32_t pre_erased;        // sectors erased by idle
+    uint32_t erases_skipped;    // sectors found erased by prepare
+    uint32_t stale_erased;      // sectors marked erased that prepare found programmed
+    uint32_t erase_errors;      // background erases that failed
+
+}w25qxx_emap_t;
+
+
+/*
+    Attach a map to an initialized device. saved: W25QXX_EMAP_BYTES(sector_count)
+    bytes from w25qxx_emap_save(), NULL: blank scan of the chip. A saved copy is
+    taken as is and should be saved again after every change (see changed), a
+    copy holding the unused value 3 is rejected. A stale copy costs no data:
+    w25qxx_emap_prepare() blank-checks the sectors it would skip.
+*/
+bool w25qxx_emap_mount(w25qxx_emap_t *m, w25qxx_dev_t *dev, uint8_t *map, const uint8_t *saved);
+
+/* Detach from the device, finishing a background erase */
+bool w25qxx_emap_unmount(w25qxx_emap_t *m);
+
+/* Copy of the map to persist, clears changed */
+void w25qxx_emap_save(w25qxx_emap_t *m, uint8_t *saved);
+
+w25qxx_emap_state_t w25qxx_emap_state(w25qxx_emap_t *m, uint32_t sector);
+
+/* Mark the sectors fully inside [addr, addr + len) free, their contents are dropped */
+bool w25qxx_emap_discard(w25qxx_emap_t *m, uint32_t addr, uint32_t len);
+
+/*
+    Advance the background erase of free sectors: W25QXX_OP_BUSY while free
+    sectors remain, W25QXX_OP_DONE when none is left, W25QXX_OP_ERROR when an
+    erase failed, its sectors are then dirty (and no longer free).
+*/
+w25qxx_op_status_t w25qxx_emap_idle(w25qxx_emap_t *m);
+
+/* Make a sector aligned range erased, erasing only sectors that are not (checked on the chip) */
+bool w25qxx_emap_prepare(w25qxx_emap_t *m, uint32_t addr, uint32_t len);
+
+#endif
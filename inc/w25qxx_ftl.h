@@ -0,0 +1,130 @@
+#ifndef __W25QXX_FTL__
+#define __W25QXX_FTL__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "w25qxx.h"
+
+#define W25QXX_FTL_DATA_PAGES       15          // data pages per physical sector, page 0 holds the header
+#define W25QXX_FTL_NONE             0xFFFFFFFF
+
+/* Start background/foreground garbage collection below this many free sectors */
+#ifndef W25QXX_FTL_GC_LOW
+#define W25QXX_FTL_GC_LOW           3
+#endif
+
+/* Move cold data off the least worn sector when erase counts drift further apart */
+#ifndef W25QXX_FTL_WEAR_DELTA
+#define W25QXX_FTL_WEAR_DELTA       16
+#endif
+
+/* Sector opens between two static wear leveling checks during writes */
+#ifndef W25QXX_FTL_WEAR_INTERVAL
+#define W25QXX_FTL_WEAR_INTERVAL    32
+#endif
+
+/* RAM the caller provides for a region of n physical sectors */
+#define W25QXX_FTL_MAP_ENTRIES(n)   ((n) * W25QXX_FTL_DATA_PAGES)
+
+/*
+    Page mapped, log structured translation layer.
+
+    Logical 4KB sectors are split in pages, every write of a logical page is
+    appended to an open physical sector (write head), so small random writes
+    become sequential page programs and erases move over the whole region.
+    Host writes go to the hot head, pages moved by garbage collection to the
+    cold head. Physical sector layout:
+
+        page 0:     magic, erase count, open sequence, next sector of the head,
+                    then per data page {logical page, write sequence}
+        page 1-15:  data
+
+    Every program gets a new write sequence, the newest copy of a logical page
+    wins. A head chooses its successor when it opens a sector, so after a
+    checkpoint (map and erase counts) mount replays only the sectors chained
+    from the checkpointed heads. Without a valid checkpoint all headers are
+    scanned. The last sectors of the region hold two checkpoint slots.
+*/
+
+typedef struct
+{
+    uint32_t erase_count;
+    uint32_t min_wseq;      // write sequence range of the programmed pages
+    uint32_t max_wseq;
+    uint8_t  valid;         // pages holding the current copy of a logical page
+    uint8_t  flags;
+
+}w25qxx_ftl_sector_t;
+
+
+typedef struct
+{
+    uint32_t sector;        // open sector, W25QXX_FTL_NONE before the first write
+    uint32_t page;          // next data page, 1 ~ W25QXX_FTL_DATA_PAGES
+    uint32_t next;          // reserved successor
+
+}w25qxx_ftl_head_t;
+
+
+typedef struct
+{
+    uint32_t host_pages;    // pages programmed for the host
+    uint32_t gc_pages;      // pages moved by garbage collection
+    uint32_t erases;        // data sector erases
+    uint32_t wear_moves;    // static wear leveling relocations
+
+}w25qxx_ftl_stats_t;
+
+
+typedef struct
+{
+    w25qxx_dev_t *dev;
+    uint32_t first_sector;      // region on the chip
+    uint32_t data_sectors;      // physical sectors holding pages
+    uint32_t ckpt_sectors;      // sectors per checkpoint slot
+
+    uint32_t *map;              // logical page -> sector * 16 + page
+    w25qxx_ftl_sector_t *sector;
+    w25qxx_ftl_head_t head[2];  // hot, cold
+
+    uint32_t wseq;
+    uint32_t ckpt_seq;
+    uint8_t  ckpt_slot;
+    uint32_t opens;             // sector opens since the last wear leveling check
+    w25qxx_ftl_stats_t stats;
+
+    uint8_t  page_buf[256];
+
+    /* Logical geometry */
+    uint32_t page_count;
+    uint32_t sector_count;      // 4KB logical sectors
+    uint32_t capacity_kb;
+
+}w25qxx_ftl_t;
+
+
+/*
+    Mount the region [first_sector, first_sector + sector_count) of an initialized
+    device. map holds W25QXX_FTL_MAP_ENTRIES(sector_count) entries, sectors holds
+    sector_count entries. A region never used before mounts empty.
+*/
+bool w25qxx_ftl_mount(w25qxx_ftl_t *ftl, w25qxx_dev_t *dev, uint32_t first_sector, uint32_t sector_count,
+                        uint32_t *map, w25qxx_ftl_sector_t *sectors);
+
+/* Erase the region and mount it empty */
+bool w25qxx_ftl_format(w25qxx_ftl_t *ftl, w25qxx_dev_t *dev, uint32_t first_sector, uint32_t sector_count,
+                        uint32_t *map, w25qxx_ftl_sector_t *sectors);
+
+/* Byte addressed logical space, never written pages read as 0xFF */
+bool w25qxx_ftl_read(w25qxx_ftl_t *ftl, uint32_t addr, uint8_t *buff, uint32_t len);
+
+bool w25qxx_ftl_write(w25qxx_ftl_t *ftl, uint32_t addr, const uint8_t *buff, uint32_t len);
+
+/* Write a checkpoint, the next mount only replays what was written after it */
+bool w25qxx_ftl_sync(w25qxx_ftl_t *ftl);
+
+/* One background garbage collection or wear leveling step, 1: work done  0: nothing to do or failed */
+bool w25qxx_ftl_idle(w25qxx_ftl_t *ftl);
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef __W25QXX_KV__
+#define __W25QXX_KV__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "w25qxx.h"
+
+#ifndef W25QXX_KV_MAX_SEGMENTS
+#define W25QXX_KV_MAX_SEGMENTS      32
+#endif
+
+#define W25QXX_KV_KEY_MAX           64
+#define W25QXX_KV_RECORD_HEADER     8
+#define W25QXX_KV_NO_SEGMENT        0xFF
+
+/*
+    Log structured key-value store.
+
+    Every sector of the region is a segment: an 8 byte header {magic, sequence}
+    followed by records {key length, type, value length, crc, key, value}.
+    A record never crosses a page, so a set is one page program and a lookup
+    one read. Records are only appended; a newer record of a key supersedes
+    the older ones and a delete appends a tombstone. One segment is always kept
+    free: when the log reaches it, the live records of the oldest segment are
+    copied there and the oldest segment is erased to become the next spare.
+
+    The RAM index is an open addressing hash table {key hash, record address,
+    record length} rebuilt at mount by replaying the segments in sequence order.
+*/
+
+typedef enum{
+    W25QXX_KV_OK = 0,
+    W25QXX_KV_NOT_FOUND,
+    W25QXX_KV_ERROR,        // chip access failed or the record is corrupt, the key may still exist
+}w25qxx_kv_status_t;
+
+
+typedef struct
+{
+    uint32_t hash;
+    uint32_t addr;          // record address on the chip
+    uint16_t len;           // record length
+
+}w25qxx_kv_entry_t;
+
+
+typedef struct
+{
+    w25qxx_dev_t *dev;
+    uint32_t first_sector;
+    uint8_t  segment_count;
+    uint32_t seg_seq[W25QXX_KV_MAX_SEGMENTS];
+    uint8_t  seg_state[W25QXX_KV_MAX_SEGMENTS];
+
+    uint8_t  active;        // segment taking appends, W25QXX_KV_NO_SEGMENT before the first set
+    uint32_t write_addr;    // next free byte of the active segment
+    uint32_t seq;
+
+    w25qxx_kv_entry_t *index;
+    uint32_t index_size;    // power of two
+    uint32_t count;         // live keys
+    uint32_t used;          // live keys and deleted slots
+
+    uint32_t compactions;
+    uint8_t  buf[256];
+
+}w25qxx_kv_t;
+
+
+/*
+    Mount the region [first_sector, first_sector + sector_count), 2 ~ W25QXX_KV_MAX_SEGMENTS
+    sectors. index holds index_size entries, a power of two larger than the key count.
+*/
+bool w25qxx_kv_mount(w25qxx_kv_t *kv, w25qxx_dev_t *dev, uint32_t first_sector, uint8_t sector_count,
+                        w25qxx_kv_entry_t *index, uint32_t index_size);
+
+/* Erase the region and mount it empty */
+bool w25qxx_kv_format(w25qxx_kv_t *kv, w25qxx_dev_t *dev, uint32_t first_sector, uint8_t sector_count,
+                        w25qxx_kv_entry_t *index, uint32_t index_size);
+
+/* key up to W25QXX_KV_KEY_MAX chars, key and value together fit in one page with the record header */
+bool w25qxx_kv_set(w25qxx_kv_t *kv, const char *key, const void *value, uint16_t len);
+
+/* *len: [in] size of value  [out] stored length, value is truncated to the given size */
+w25qxx_kv_status_t w25qxx_kv_get(w25qxx_kv_t *kv, const char *key, void *value, uint16_t *len);
+
+w25qxx_kv_status_t w25qxx_kv_delete(w25qxx_kv_t *kv, const char *key);
+
+#endif
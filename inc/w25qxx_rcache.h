@@ -0,0 +1,65 @@
+#ifndef __W25QXX_RCACHE__
+#define __W25QXX_RCACHE__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "w25qxx.h"
+
+#define W25QXX_RCACHE_MAX_LINES     64
+#define W25QXX_RCACHE_MAX_AHEAD     16
+#define W25QXX_RCACHE_EMPTY         0xFFFFFFFF
+
+/*
+    Read cache of page sized lines. A page maps to set (page % set_count) and
+    may sit in any of its ways, the least recently used way is replaced.
+    A miss on the page right after the last fetched window counts as a
+    sequential stream and fetches the next pages too, the window doubling up
+    to the read-ahead limit. Reads of several whole pages go to the chip
+    without allocating lines. Programs and erases issued on the device drop
+    the lines they touch through a w25qxx_notify_t listener.
+*/
+typedef struct
+{
+    uint32_t page;          // page index, W25QXX_RCACHE_EMPTY when unused
+    uint32_t stamp;         // last use, the smallest one of a set is replaced
+    uint8_t  *data;         // page_size bytes
+
+}w25qxx_rcache_line_t;
+
+
+typedef struct
+{
+    w25qxx_notify_t notify;     // first member, the listener is the cache
+    w25qxx_dev_t *dev;
+    w25qxx_rcache_line_t line[W25QXX_RCACHE_MAX_LINES];     // set s, way w: line[s * ways + w]
+    uint8_t  set_count;         // power of two
+    uint8_t  ways;
+    uint8_t  ahead_max;         // read-ahead limit in pages, 0: off
+    uint8_t  window;            // current read-ahead window
+    uint32_t next_page;         // first page after the last fetched window
+    uint32_t clock;
+
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t prefetched;        // pages fetched ahead of a miss
+
+}w25qxx_rcache_t;
+
+
+/*
+    pool holds set_count * ways * dev->page_size bytes and must outlive the cache,
+    set_count * ways up to W25QXX_RCACHE_MAX_LINES, ahead up to W25QXX_RCACHE_MAX_AHEAD
+*/
+bool w25qxx_rcache_init(w25qxx_rcache_t *rc, w25qxx_dev_t *dev, uint8_t *pool, uint8_t set_count,
+                            uint8_t ways, uint8_t ahead);
+
+/* Detach from the device */
+void w25qxx_rcache_deinit(w25qxx_rcache_t *rc);
+
+bool w25qxx_rcache_read(w25qxx_rcache_t *rc, uint32_t addr, uint8_t *buff, uint32_t len);
+
+/* Drop all lines, needed only when the chip is changed behind the driver */
+void w25qxx_rcache_invalidate(w25qxx_rcache_t *rc);
+
+#endif
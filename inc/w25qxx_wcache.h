@@ -0,0 +1,63 @@
+#ifndef __W25QXX_WCACHE__
+#define __W25QXX_WCACHE__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "w25qxx.h"
+
+#define W25QXX_WCACHE_MAX_LINES     8
+#define W25QXX_WCACHE_EMPTY         0xFFFFFFFF
+
+/*
+    Write-back sector cache. Writes land in RAM copies of whole sectors, a
+    sector is erased and programmed once when its line is evicted or flushed,
+    so many small updates of one sector cost a single erase/program pass.
+    Reads of cached sectors are served from RAM, other reads go to the chip
+    without allocating a line. Programs and erases issued on the device by
+    other code drop the clean lines they touch through a w25qxx_notify_t
+    listener, a dirty line is kept (it still holds writes not on the chip)
+    and counted in conflicts.
+*/
+typedef struct
+{
+    uint32_t sector;        // sector index, W25QXX_WCACHE_EMPTY when unused
+    uint32_t stamp;         // last use, the smallest one is evicted first
+    bool     dirty;
+    uint8_t  *data;         // sector_size bytes
+
+}w25qxx_wcache_line_t;
+
+
+typedef struct
+{
+    w25qxx_notify_t notify;     // first member, the listener is the cache
+    w25qxx_dev_t *dev;
+    w25qxx_wcache_line_t line[W25QXX_WCACHE_MAX_LINES];
+    uint8_t  line_count;
+    uint32_t clock;
+    bool     writing;           // write back running, its changes are the cache's own
+
+    uint32_t conflicts;         // programs/erases by other code that hit a dirty line
+
+}w25qxx_wcache_t;
+
+
+/* pool holds line_count * dev->sector_size bytes and must outlive the cache */
+bool w25qxx_wcache_init(w25qxx_wcache_t *wc, w25qxx_dev_t *dev, uint8_t *pool, uint8_t line_count);
+
+/* Detach from the device, dirty lines are not written back */
+void w25qxx_wcache_deinit(w25qxx_wcache_t *wc);
+
+bool w25qxx_wcache_read(w25qxx_wcache_t *wc, uint32_t addr, uint8_t *buff, uint32_t len);
+
+/* Any alignment, the chip is touched only to load a partially written sector */
+bool w25qxx_wcache_write(w25qxx_wcache_t *wc, uint32_t addr, const uint8_t *buff, uint32_t len);
+
+/* Write back every dirty line, lines stay cached clean */
+bool w25qxx_wcache_flush(w25qxx_wcache_t *wc);
+
+/* Drop all lines without writing them back */
+void w25qxx_wcache_invalidate(w25qxx_wcache_t *wc);
+
+#endif
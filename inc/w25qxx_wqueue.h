@@ -0,0 +1,64 @@
+#ifndef __W25QXX_WQUEUE__
+#define __W25QXX_WQUEUE__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "w25qxx.h"
+
+#define W25QXX_WQUEUE_MAX_EXTENTS   32
+
+/*
+    Write coalescing queue. Writes are kept in RAM as extents sorted by
+    address, overlapping and adjacent writes merge into one extent. A flush
+    walks the extents in address order one sector at a time: the sector is
+    read once, erased only when a queued byte needs a 0 -> 1 change (and then
+    at most once), and every changed page is written with one page program.
+    Flushes run when the pool or the extent table is full, when the oldest
+    queued write reaches the age limit, and on w25qxx_wqueue_sync().
+*/
+typedef struct
+{
+    uint32_t addr;
+    uint32_t len;
+    uint32_t offset;        // data in pool
+}w25qxx_wqueue_extent_t;
+
+
+typedef struct
+{
+    w25qxx_dev_t *dev;
+    w25qxx_wqueue_extent_t extent[W25QXX_WQUEUE_MAX_EXTENTS];     // sorted, disjoint, not adjacent
+    uint8_t  count;
+    uint8_t  *pool;
+    uint32_t pool_size;
+    uint32_t used;              // pool bytes handed out, merges leave holes until compacted
+    uint32_t queued;            // bytes held by the extents
+    uint8_t  *scratch;          // sector_size bytes for the flush
+    uint32_t max_age_ms;        // 0: no age limit
+    int32_t  first_time;        // get_time() of the oldest queued write
+
+    uint32_t flushes;
+    uint32_t erases;
+    uint32_t programs;
+
+}w25qxx_wqueue_t;
+
+
+/* pool and scratch (sector_size bytes) must outlive the queue */
+bool w25qxx_wqueue_init(w25qxx_wqueue_t *q, w25qxx_dev_t *dev, uint8_t *pool, uint32_t pool_size,
+                            uint8_t *scratch, uint32_t max_age_ms);
+
+/* Any alignment, returns after queueing unless the write forced a flush */
+bool w25qxx_wqueue_write(w25qxx_wqueue_t *q, uint32_t addr, const uint8_t *buff, uint32_t len);
+
+/* Chip contents with the queued writes applied */
+bool w25qxx_wqueue_read(w25qxx_wqueue_t *q, uint32_t addr, uint8_t *buff, uint32_t len);
+
+/* Flush when the oldest queued write reached max_age_ms, call periodically */
+bool w25qxx_wqueue_poll(w25qxx_wqueue_t *q);
+
+/* Flush everything queued */
+bool w25qxx_wqueue_sync(w25qxx_wqueue_t *q);
+
+#endif
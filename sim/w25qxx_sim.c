@@ -0,0 +1,883 @@
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "w25qxx_sim.h"
+
+#define SIM_MAN_ID_WINBOND		0xEF
+#define SIM_MEM_TYPE			0x40
+#define SIM_PAGE_SIZE			256
+#define SIM_SECTOR_SIZE			0x1000
+#define SIM_BLOCK_32K_SIZE		0x8000
+#define SIM_BLOCK_SIZE			0x10000
+
+#define CMD_Read_Data			0x03
+#define CMD_Read_Data_4_Byte	0x13
+
+#define SR1_WRITABLE			(unsigned char)0xFC
+#define SR2_WRITABLE			(unsigned char)0x43
+#define SR3_WRITABLE			(unsigned char)0x64
+
+
+/* Simulator bound to the context free driver callbacks of the calling thread */
+static __thread w25qxx_sim_t *sim_active;
+
+
+void w25qxx_sim_defaultTiming(w25qxx_t type, w25qxx_sim_timing_t *timing)
+{
+	const w25qxx_timing_t *t = w25qxx_getTiming(type);
+
+	timing->spi_clock_hz = 50000000;
+	timing->call_overhead_ns = 2000;
+	timing->cs_overhead_ns = 100;
+
+	timing->t_w_us = 10000;
+	timing->t_pp_us = t->t_pp_us;
+	timing->t_se_us = t->t_se_ms * 1000;
+	timing->t_be32_us = t->t_be32_ms * 1000;
+	timing->t_be64_us = t->t_be64_ms * 1000;
+	timing->t_ce_ms = t->t_ce_ms;
+	timing->t_sus_us = W25QXX_T_SUS_US;
+	timing->t_rs_us = W25QXX_T_RS_US;
+}
+
+
+static uint8_t sim_jedecCapacity(w25qxx_t type)
+{
+	return (type == W25Q512) ? 0x20 : (uint8_t)(0x10 + type);
+}
+
+
+static uint8_t sim_deviceID(w25qxx_t type)
+{
+	return (uint8_t)(0x10 + type - 1);
+}
+
+
+/* BFPT time field covering value: count bits and the unit bits, *actual is what the driver reads back */
+static uint32_t sim_sfdpTime(uint32_t value, const uint32_t *units, uint8_t unit_count, uint8_t count_bits,
+								uint32_t *actual)
+{
+	uint32_t max = 1u << count_bits;
+	uint32_t count = 1;
+	uint8_t  u;
+
+	for (u = 0; u < unit_count; ++u){
+		count = (value + units[u] - 1) / units[u];
+		if (count <= max)
+			break;
+	}
+
+	if (u == unit_count){
+		u--;
+		count = max;
+	}
+	if (count == 0)
+		count = 1;
+
+	*actual = count * units[u];
+
+	return (count - 1) | ((uint32_t)u << count_bits);
+}
+
+
+/* Multiplier field, maximum = 2 * (multiplier + 1) * typical */
+static uint32_t sim_sfdpMultiplier(uint32_t typ, uint32_t max)
+{
+	uint32_t mul = (max + 2 * typ - 1) / (2 * typ);
+
+	return (mul == 0) ? 0 : (mul > 16) ? 15 : mul - 1;
+}
+
+
+/*
+	JESD216B table of a Winbond part: SFDP header with one parameter header,
+	Basic Flash Parameter Table at 80h. Times are the simulated ones, the
+	maxima those of the datasheet table.
+*/
+static void sim_buildSfdp(w25qxx_sim_t *sim)
+{
+	static const uint8_t hdr[16] = {
+		'S', 'F', 'D', 'P', 0x06, 0x01, 0x00, 0xFF,		// rev 1.6, one parameter header
+		0x00, 0x06, 0x01, 16, 0x80, 0x00, 0x00, 0xFF,	// BFPT rev 1.6, 16 dwords at 80h
+	};
+	static const uint32_t erase_units[4] = { 1, 16, 128, 1000 };
+	static const uint32_t pp_units[2] = { 8, 64 };
+	static const uint32_t byte_units[2] = { 1, 8 };
+	static const uint32_t ce_units[4] = { 16, 256, 4000, 64000 };
+	const w25qxx_timing_t *max = w25qxx_getTiming(sim->type);
+	const w25qxx_sim_timing_t *t = &sim->timing;
+	bool large = sim->capacity > 0x1000000;
+	uint32_t bfpt[16];
+	uint32_t se, be32, be64, pp, ce, byte;
+	uint32_t dw10, dw11;
+
+	memset(sim->sfdp, 0xFF, sizeof(sim->sfdp));
+	memcpy(sim->sfdp, hdr, sizeof(hdr));
+
+	dw10 = sim_sfdpTime((t->t_se_us + 999) / 1000, erase_units, 4, 5, &se) << 4;
+	dw10 |= sim_sfdpTime((t->t_be32_us + 999) / 1000, erase_units, 4, 5, &be32) << 11;
+	dw10 |= sim_sfdpTime((t->t_be64_us + 999) / 1000, erase_units, 4, 5, &be64) << 18;
+	dw10 |= sim_sfdpMultiplier(se, max->t_se_max_ms);
+
+	dw11 = sim_sfdpTime(t->t_pp_us, pp_units, 2, 5, &pp) << 8;
+	dw11 |= sim_sfdpTime(30, byte_units, 2, 4, &byte) << 14;		// first byte program, datasheet typical
+	dw11 |= sim_sfdpTime(3, byte_units, 2, 4, &byte) << 19;		// additional byte program
+	dw11 |= sim_sfdpTime(t->t_ce_ms, ce_units, 4, 5, &ce) << 24;
+	dw11 |= 8 << 4;		// 256 byte pages
+	dw11 |= sim_sfdpMultiplier(pp, max->t_pp_max_us);
+
+	bfpt[0] = large ? 0xFFFB20E5 : 0xFFF920E5;	// 4KB erase 20h, 1-1-2, 1-2-2, 1-4-4, 1-1-4, 3/4 byte addresses above 16MB
+	bfpt[1] = sim->capacity * 8 - 1;
+	bfpt[2] = 0x6B08EB44;	// 1-1-4 6Bh 8 dummy, 1-4-4 EBh 2 mode + 4 dummy
+	bfpt[3] = 0xBB423B08;	// 1-1-2 3Bh 8 dummy, 1-2-2 BBh 2 mode
+	bfpt[4] = 0xFFFFFFEE;	// no 2-2-2 / 4-4-4
+	bfpt[5] = 0xFF00FFFF;
+	bfpt[6] = 0xFF00FFFF;
+	bfpt[7] = 0x520F200C;	// 4KB 20h, 32KB 52h
+	bfpt[8] = 0x0000D810;	// 64KB D8h
+	bfpt[9] = dw10;
+	bfpt[10] = dw11;
+	bfpt[11] = 0;			// suspend, QE and reset details are not modelled
+	bfpt[12] = 0;
+	bfpt[13] = 0;
+	bfpt[14] = 0;
+	bfpt[15] = large ? ((1u << 29) | (1u << 24) | (1u << 14)) : 0;	// 4-byte opcodes or B7h, exit with E9h
+
+	for (uint8_t i = 0; i < 16; ++i){
+		for (uint8_t b = 0; b < 4; ++b)
+			sim->sfdp[0x80 + i * 4 + b] = (bfpt[i] >> (b * 8)) & 0xFF;
+	}
+}
+
+
+static void sim_charge(w25qxx_sim_t *sim, uint64_t ns)
+{
+	*sim->now_ns += ns;
+}
+
+
+static void sim_refresh(w25qxx_sim_t *sim)
+{
+	if ((sim->sr[0] & SR1_S0_BUSY) && (*sim->now_ns >= sim->busy_until_ns)){
+		// a suspended instruction keeps WEL until it is resumed and completes
+		if (sim->sr[1] & SR2_S15_SUS)
+			sim->sr[0] &= (uint8_t)~SR1_S0_BUSY;
+		else
+			sim->sr[0] &= (uint8_t)~(SR1_S0_BUSY | SR1_S1_WEL);
+	}
+}
+
+
+static void sim_startBusy(w25qxx_sim_t *sim, uint64_t us)
+{
+	sim->busy_until_ns = *sim->now_ns + us * 1000;
+	sim->stats.busy_ns += us * 1000;
+	sim->sr[0] |= SR1_S0_BUSY;
+	sim->suspendable = false;
+}
+
+
+static bool sim_writeEnabled(w25qxx_sim_t *sim)
+{
+	return (sim->sr[0] & SR1_S1_WEL) == SR1_S1_WEL;
+}
+
+
+/*
+	Header layout of every supported opcode, data phase starts at hdr_len.
+	Returns false for opcodes the simulator does not know.
+*/
+static bool sim_decode(w25qxx_sim_t *sim, uint8_t opcode)
+{
+	uint8_t addr = sim->addr_4byte ? 4 : 3;
+
+	sim->addr_len = 0;
+	sim->hdr_len = 1;
+
+	switch (opcode)
+	{
+		case CMD_Read_Data:
+		case CMD_Page_Program:
+		case CMD_Erase_Sector:
+		case CMD_Erase_Block_32K:
+		case CMD_Erase_Block_64K:
+			sim->addr_len = addr;
+			break;
+		case CMD_Fast_Read:
+			sim->addr_len = addr;
+			break;
+		case CMD_Fast_Read_Dual_Output:
+		case CMD_Fast_Read_Quad_Output:
+		case CMD_Quad_Page_Program:
+			sim->addr_len = addr;
+			break;
+		case CMD_Fast_Read_Quad_IO:
+			sim->addr_len = addr;
+			sim->hdr_len += 3;	// M7-0 + 4 dummy clocks on four lines
+			break;
+		case CMD_Fast_Read_Quad_IO_4_Byte_Addr:
+			sim->addr_len = 4;
+			sim->hdr_len += 3;
+			break;
+		case CMD_Fast_Read_Dual_Output_4_Byte_Addr:
+		case CMD_Fast_Read_Quad_Output_4_Byte_Addr:
+		case CMD_Quad_Page_Program_4_Byte_Addr:
+		case CMD_Read_Data_4_Byte:
+		case CMD_Page_Program_4_Byte_Addr:
+		case CMD_Erase_Sector_4_Byte_Addr:
+		case CMD_Erase_Block_32K_4_Byte_Addr:
+		case CMD_Erase_Block_64K_4_Byte_Addr:
+		case CMD_Fast_Read_4_Byte_Addr:
+			sim->addr_len = 4;
+			break;
+		case CMD_Manufacture_ID:
+			sim->addr_len = 3;
+			break;
+		case CMD_Read_SFDP:
+			sim->addr_len = 3;	// 3 address bytes in every address mode, 8 dummy clocks
+			sim->hdr_len += 1;
+			break;
+		case CMD_Device_ID:
+			sim->hdr_len = 4;
+			break;
+		case CMD_Unique_ID:
+			sim->hdr_len = 5;
+			break;
+		case CMD_Set_Burst_With_Wrap:
+			sim->hdr_len = 4;	// 3 dummy bytes, W7-0 is the data phase
+			break;
+		case CMD_Reg_1_Read:
+		case CMD_Reg_2_Read:
+		case CMD_Reg_3_Read:
+		case CMD_Reg_1_Write:
+		case CMD_Reg_2_Write:
+		case CMD_Reg_3_Write:
+		case CMD_Write_Enable:
+		case CMD_Write_Disable:
+		case CMD_Write_Enable_SR:
+		case CMD_JEDEC_ID:
+		case CMD_Erase_Chip:
+		case CMD_Enter_4_Byte_Mode:
+		case CMD_Exit_4_Byte_Mode:
+		case CMD_Erase_Program_Suspend:
+		case CMD_Erase_Program_Resume:
+			break;
+		default:
+			return false;
+	}
+
+	sim->hdr_len += sim->addr_len;
+	switch (opcode)
+	{
+		case CMD_Fast_Read:
+		case CMD_Fast_Read_4_Byte_Addr:
+		case CMD_Fast_Read_Dual_Output:
+		case CMD_Fast_Read_Dual_Output_4_Byte_Addr:
+		case CMD_Fast_Read_Quad_Output:
+		case CMD_Fast_Read_Quad_Output_4_Byte_Addr:
+			sim->hdr_len += 1;
+			break;
+		default:
+			break;
+	}
+
+	return true;
+}
+
+
+/* Quad instructions are ignored unless QE is set */
+static bool sim_needsQuad(uint8_t opcode)
+{
+	switch (opcode)
+	{
+		case CMD_Fast_Read_Quad_Output:
+		case CMD_Fast_Read_Quad_Output_4_Byte_Addr:
+		case CMD_Fast_Read_Quad_IO:
+		case CMD_Fast_Read_Quad_IO_4_Byte_Addr:
+		case CMD_Quad_Page_Program:
+		case CMD_Quad_Page_Program_4_Byte_Addr:
+		case CMD_Set_Burst_With_Wrap:
+			return true;
+		default:
+			return false;
+	}
+}
+
+
+static bool sim_isQuadIORead(uint8_t opcode)
+{
+	return (opcode == CMD_Fast_Read_Quad_IO) || (opcode == CMD_Fast_Read_Quad_IO_4_Byte_Addr);
+}
+
+
+/* While BUSY only the status registers can be read */
+static bool sim_allowedWhileBusy(uint8_t opcode)
+{
+	return (opcode == CMD_Reg_1_Read) || (opcode == CMD_Reg_2_Read) || (opcode == CMD_Reg_3_Read) ||
+			(opcode == CMD_Erase_Program_Suspend);
+}
+
+
+/* Instructions rejected while an erase/program is suspended */
+static bool sim_blockedWhileSuspended(uint8_t opcode)
+{
+	switch (opcode)
+	{
+		case CMD_Page_Program:
+		case CMD_Page_Program_4_Byte_Addr:
+		case CMD_Quad_Page_Program:
+		case CMD_Quad_Page_Program_4_Byte_Addr:
+		case CMD_Erase_Sector:
+		case CMD_Erase_Sector_4_Byte_Addr:
+		case CMD_Erase_Block_32K:
+		case CMD_Erase_Block_32K_4_Byte_Addr:
+		case CMD_Erase_Block_64K:
+		case CMD_Erase_Block_64K_4_Byte_Addr:
+		case CMD_Erase_Chip:
+		case CMD_Reg_1_Write:
+		case CMD_Reg_2_Write:
+		case CMD_Reg_3_Write:
+			return true;
+		default:
+			return false;
+	}
+}
+
+
+static uint8_t sim_dataPhase(w25qxx_sim_t *sim, uint32_t idx, uint8_t out)
+{
+	switch (sim->opcode)
+	{
+		case CMD_Reg_1_Read:
+			sim_refresh(sim);
+			return sim->sr[0];
+		case CMD_Reg_2_Read:
+			return sim->sr[1];
+		case CMD_Reg_3_Read:
+			return sim->sr[2];
+		case CMD_JEDEC_ID:
+		{
+			const uint8_t id[3] = {SIM_MAN_ID_WINBOND, SIM_MEM_TYPE, sim_jedecCapacity(sim->type)};
+			return id[idx % 3];
+		}
+		case CMD_Device_ID:
+			return sim_deviceID(sim->type);
+		case CMD_Manufacture_ID:
+			return (((idx + sim->addr) & 1) == 0) ? SIM_MAN_ID_WINBOND : sim_deviceID(sim->type);
+		case CMD_Unique_ID:
+			return sim->uniq_id[idx % 8];
+		case CMD_Read_SFDP:
+			return ((sim->addr + idx) < W25QXX_SIM_SFDP_SIZE) ? sim->sfdp[sim->addr + idx] : 0xFF;
+		case CMD_Read_Data:
+		case CMD_Read_Data_4_Byte:
+		case CMD_Fast_Read:
+		case CMD_Fast_Read_4_Byte_Addr:
+		case CMD_Fast_Read_Dual_Output:
+		case CMD_Fast_Read_Dual_Output_4_Byte_Addr:
+		case CMD_Fast_Read_Quad_Output:
+		case CMD_Fast_Read_Quad_Output_4_Byte_Addr:
+			sim->stats.data_bytes++;
+			return sim->mem[(sim->addr + idx) % sim->capacity];
+		case CMD_Fast_Read_Quad_IO:
+		case CMD_Fast_Read_Quad_IO_4_Byte_Addr:
+			sim->stats.data_bytes++;
+			if (sim->wrap)
+				return sim->mem[((sim->addr & ~(uint32_t)(sim->wrap - 1)) | ((sim->addr + idx) & (sim->wrap - 1))) % sim->capacity];
+			return sim->mem[(sim->addr + idx) % sim->capacity];
+		case CMD_Page_Program:
+		case CMD_Page_Program_4_Byte_Addr:
+		case CMD_Quad_Page_Program:
+		case CMD_Quad_Page_Program_4_Byte_Addr:
+			// address counter wraps inside the page, the last 256 bytes win
+			sim->page_buf[(sim->addr + idx) % SIM_PAGE_SIZE] = out;
+			sim->page_loaded = true;
+			sim->stats.data_bytes++;
+			return 0xFF;
+		case CMD_Reg_1_Write:
+			if (idx < 3)
+				sim->page_buf[idx] = out;
+			return 0xFF;
+		case CMD_Reg_2_Write:
+		case CMD_Reg_3_Write:
+		case CMD_Set_Burst_With_Wrap:
+			if (idx == 0)
+				sim->page_buf[0] = out;
+			return 0xFF;
+		default:
+			return 0xFF;
+	}
+}
+
+
+static uint8_t sim_clock(w25qxx_sim_t *sim, uint8_t out, uint8_t lines)
+{
+	uint32_t pos;
+
+	sim_charge(sim, (8ull / lines) * 1000000000ull / sim->timing.spi_clock_hz);
+	sim->stats.clocked_bytes++;
+
+	if (!sim->selected)
+		return 0xFF;
+
+	pos = sim->pos++;
+
+	if (pos == 0){
+		sim_refresh(sim);
+		sim->opcode = out;
+		sim->addr = 0;
+		sim->page_loaded = false;
+		memset(sim->page_buf, 0xFF, sizeof(sim->page_buf));
+		sim->ignored = !sim_decode(sim, out) ||
+						(((sim->sr[0] & SR1_S0_BUSY) != 0) && !sim_allowedWhileBusy(out)) ||
+						(((sim->sr[1] & SR2_S15_SUS) != 0) && sim_blockedWhileSuspended(out)) ||
+						(sim_needsQuad(out) && ((sim->sr[1] & SR2_S9_QE) == 0));
+		return 0xFF;
+	}
+
+	if (sim->ignored)
+		return 0xFF;
+
+	if (pos <= sim->addr_len){
+		sim->addr = (sim->addr << 8) | out;
+		return 0xFF;
+	}
+
+	if (pos < sim->hdr_len){
+		// M7-0 of Quad I/O read, M5-4 = 10b keeps continuous read mode
+		if (sim_isQuadIORead(sim->opcode) && (pos == (uint32_t)sim->addr_len + 1))
+			sim->continuous = ((out & 0x30) == 0x20);
+		return 0xFF;
+	}
+
+	return sim_dataPhase(sim, pos - sim->hdr_len, out);
+}
+
+
+uint8_t w25qxx_sim_xfer(w25qxx_sim_t *sim, uint8_t out)
+{
+	return sim_clock(sim, out, 1);
+}
+
+
+static void sim_program(w25qxx_sim_t *sim)
+{
+	uint32_t base;
+
+	if (!sim->page_loaded || !sim_writeEnabled(sim))
+		return;
+
+	base = (sim->addr % sim->capacity) & ~(uint32_t)(SIM_PAGE_SIZE - 1);
+
+	// NOR rule: programming can only clear bits
+	for (uint32_t i = 0; i < SIM_PAGE_SIZE; ++i)
+		sim->mem[base + i] &= sim->page_buf[i];
+
+	sim_startBusy(sim, sim->timing.t_pp_us);
+	sim->suspendable = true;
+}
+
+
+static void sim_erase(w25qxx_sim_t *sim, uint32_t size, uint32_t t_us)
+{
+	uint32_t base;
+
+	if ((sim->pos != sim->hdr_len) || !sim_writeEnabled(sim))
+		return;
+
+	base = (sim->addr % sim->capacity) & ~(size - 1);
+	memset(sim->mem + base, 0xFF, size);
+
+	sim_startBusy(sim, t_us);
+	sim->suspendable = true;
+}
+
+
+/* 75h: the running erase/program stops within tSUS, BUSY clears and SUS is set */
+static void sim_suspend(w25qxx_sim_t *sim)
+{
+	uint64_t now = *sim->now_ns;
+
+	sim_refresh(sim);
+
+	if (!(sim->sr[0] & SR1_S0_BUSY) || !sim->suspendable || (sim->sr[1] & SR2_S15_SUS) ||
+		(now < sim->resume_ns + (uint64_t)sim->timing.t_rs_us * 1000))
+		return;
+
+	sim->suspended_ns = sim->busy_until_ns - now;
+	sim->stats.busy_ns -= sim->suspended_ns;
+
+	sim->busy_until_ns = now + (uint64_t)sim->timing.t_sus_us * 1000;
+	sim->stats.busy_ns += (uint64_t)sim->timing.t_sus_us * 1000;
+	sim->sr[1] |= SR2_S15_SUS;
+}
+
+
+/* 7Ah: continue the suspended instruction where it stopped */
+static void sim_resume(w25qxx_sim_t *sim)
+{
+	sim_refresh(sim);
+
+	if (!(sim->sr[1] & SR2_S15_SUS) || (sim->sr[0] & SR1_S0_BUSY))
+		return;
+
+	sim->sr[1] &= (uint8_t)~SR2_S15_SUS;
+	sim->sr[0] |= SR1_S0_BUSY;
+	sim->busy_until_ns = *sim->now_ns + sim->suspended_ns;
+	sim->stats.busy_ns += sim->suspended_ns;
+	sim->resume_ns = *sim->now_ns;
+}
+
+
+static void sim_writeStatus(w25qxx_sim_t *sim)
+{
+	uint32_t count = sim->pos - 1;
+	bool     volatile_write = sim->wel_volatile && !sim_writeEnabled(sim);
+
+	if ((count == 0) || (!sim_writeEnabled(sim) && !sim->wel_volatile))
+		return;
+
+	switch (sim->opcode)
+	{
+		case CMD_Reg_1_Write:
+			sim->sr[0] = (sim->sr[0] & ~SR1_WRITABLE) | (sim->page_buf[0] & SR1_WRITABLE);
+			if (count > 1)
+				sim->sr[1] = (sim->sr[1] & ~SR2_WRITABLE) | (sim->page_buf[1] & SR2_WRITABLE);
+			if (count > 2)
+				sim->sr[2] = (sim->sr[2] & ~SR3_WRITABLE) | (sim->page_buf[2] & SR3_WRITABLE);
+			break;
+		case CMD_Reg_2_Write:
+			sim->sr[1] = (sim->sr[1] & ~SR2_WRITABLE) | (sim->page_buf[0] & SR2_WRITABLE);
+			break;
+		case CMD_Reg_3_Write:
+			sim->sr[2] = (sim->sr[2] & ~SR3_WRITABLE) | (sim->page_buf[0] & SR3_WRITABLE);
+			break;
+		default:
+			break;
+	}
+
+	sim->wel_volatile = false;
+	if (volatile_write)
+		return;
+
+	sim_startBusy(sim, sim->timing.t_w_us);
+}
+
+
+/* Instructions execute when CS goes high */
+static void sim_commit(w25qxx_sim_t *sim)
+{
+	if ((sim->pos == 0) || sim->ignored)
+		return;
+
+	switch (sim->opcode)
+	{
+		case CMD_Write_Enable:
+			sim->sr[0] |= SR1_S1_WEL;
+			break;
+		case CMD_Write_Disable:
+			sim->sr[0] &= (uint8_t)~SR1_S1_WEL;
+			break;
+		case CMD_Write_Enable_SR:
+			sim->wel_volatile = true;
+			break;
+		case CMD_Enter_4_Byte_Mode:
+			sim->addr_4byte = true;
+			sim->sr[2] |= SR3_S16_ADS;
+			break;
+		case CMD_Exit_4_Byte_Mode:
+			sim->addr_4byte = false;
+			sim->sr[2] &= (uint8_t)~SR3_S16_ADS;
+			break;
+		case CMD_Page_Program:
+		case CMD_Page_Program_4_Byte_Addr:
+		case CMD_Quad_Page_Program:
+		case CMD_Quad_Page_Program_4_Byte_Addr:
+			sim_program(sim);
+			break;
+		case CMD_Erase_Sector:
+		case CMD_Erase_Sector_4_Byte_Addr:
+			sim_erase(sim, SIM_SECTOR_SIZE, sim->timing.t_se_us);
+			break;
+		case CMD_Erase_Block_32K:
+		case CMD_Erase_Block_32K_4_Byte_Addr:
+			sim_erase(sim, SIM_BLOCK_32K_SIZE, sim->timing.t_be32_us);
+			break;
+		case CMD_Erase_Block_64K:
+		case CMD_Erase_Block_64K_4_Byte_Addr:
+			sim_erase(sim, SIM_BLOCK_SIZE, sim->timing.t_be64_us);
+			break;
+		case CMD_Erase_Chip:
+			if ((sim->pos == 1) && sim_writeEnabled(sim)){
+				memset(sim->mem, 0xFF, sim->capacity);
+				sim_startBusy(sim, (uint64_t)sim->timing.t_ce_ms * 1000);
+			}
+			break;
+		case CMD_Reg_1_Write:
+		case CMD_Reg_2_Write:
+		case CMD_Reg_3_Write:
+			sim_writeStatus(sim);
+			break;
+		case CMD_Erase_Program_Suspend:
+			sim_suspend(sim);
+			break;
+		case CMD_Erase_Program_Resume:
+			sim_resume(sim);
+			break;
+		case CMD_Set_Burst_With_Wrap:
+			// W4 = 0 enables the wrap, W6-5 select 8/16/32/64 bytes
+			if (sim->pos > sim->hdr_len)
+				sim->wrap = (sim->page_buf[0] & W25QXX_WRAP_DISABLE) ? 0 : (uint8_t)(8 << ((sim->page_buf[0] >> 5) & 3));
+			break;
+		default:
+			break;
+	}
+}
+
+
+void w25qxx_sim_select(w25qxx_sim_t *sim, bool en)
+{
+	if (en == sim->selected)
+		return;
+
+	sim_charge(sim, sim->timing.cs_overhead_ns);
+
+	if (en){
+		sim->selected = true;
+		sim->pos = 0;
+		sim->ignored = false;
+		sim->stats.transactions++;
+
+		if (sim->continuous){
+			// opcode phase skipped, the first byte is the address
+			sim->pos = 1;
+			sim->addr = 0;
+			sim_decode(sim, sim->opcode);
+		}
+	}else{
+		sim_commit(sim);
+		sim->selected = false;
+	}
+}
+
+
+uint64_t w25qxx_sim_nowNs(const w25qxx_sim_t *sim)
+{
+	return *sim->now_ns;
+}
+
+
+void w25qxx_sim_advanceNs(w25qxx_sim_t *sim, uint64_t ns)
+{
+	sim_charge(sim, ns);
+}
+
+
+bool w25qxx_sim_isBusy(w25qxx_sim_t *sim)
+{
+	sim_refresh(sim);
+	return (sim->sr[0] & SR1_S0_BUSY) == SR1_S0_BUSY;
+}
+
+
+void w25qxx_sim_resetStats(w25qxx_sim_t *sim)
+{
+	memset(&sim->stats, 0, sizeof(sim->stats));
+}
+
+
+bool w25qxx_sim_open(w25qxx_sim_t *sim, w25qxx_t type, const char *image_path,
+						const w25qxx_sim_timing_t *timing)
+{
+	struct stat st;
+	bool blank = true;
+	void *map;
+
+	if ((type < W25Q10) || (type > W25Q512))
+		return false;
+
+	memset(sim, 0, sizeof(*sim));
+	sim->type = type;
+	sim->capacity = (uint32_t)SIM_BLOCK_SIZE << type;
+	sim->fd = -1;
+	sim->now_ns = &sim->clock_ns;
+
+	if (timing)
+		sim->timing = *timing;
+	else
+		w25qxx_sim_defaultTiming(type, &sim->timing);
+
+	sim_buildSfdp(sim);
+
+	if (image_path){
+		sim->fd = open(image_path, O_RDWR | O_CREAT, 0644);
+		if (sim->fd < 0)
+			return false;
+
+		if ((fstat(sim->fd, &st) == 0) && (st.st_size == (off_t)sim->capacity)){
+			blank = false;
+		}else if (ftruncate(sim->fd, sim->capacity) != 0){
+			close(sim->fd);
+			return false;
+		}
+		map = mmap(NULL, sim->capacity, PROT_READ | PROT_WRITE, MAP_SHARED, sim->fd, 0);
+	}else{
+		map = mmap(NULL, sim->capacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	}
+
+	if (map == MAP_FAILED){
+		if (sim->fd >= 0)
+			close(sim->fd);
+		return false;
+	}
+
+	sim->mem = map;
+	if (blank)
+		memset(sim->mem, 0xFF, sim->capacity);
+
+	for (uint8_t i = 0; i < 8; ++i)
+		sim->uniq_id[i] = (uint8_t)(0xA0 + i + type);
+
+	return true;
+}
+
+
+void w25qxx_sim_close(w25qxx_sim_t *sim)
+{
+	if (sim->mem){
+		if (sim->fd >= 0)
+			msync(sim->mem, sim->capacity, MS_SYNC);
+		munmap(sim->mem, sim->capacity);
+		sim->mem = NULL;
+	}
+	if (sim->fd >= 0){
+		close(sim->fd);
+		sim->fd = -1;
+	}
+	if (sim_active == sim)
+		sim_active = NULL;
+}
+
+
+/* Driver callbacks */
+
+static uint8_t sim_interfaceRead(char *buffer, int len)
+{
+	sim_charge(sim_active, sim_active->timing.call_overhead_ns);
+	sim_active->stats.calls++;
+
+	for (int i = 0; i < len; ++i)
+		buffer[i] = (char)w25qxx_sim_xfer(sim_active, CMD_DUMMY);
+
+	return 0;
+}
+
+
+static uint8_t sim_interfaceWrite(char *data, int len)
+{
+	sim_charge(sim_active, sim_active->timing.call_overhead_ns);
+	sim_active->stats.calls++;
+
+	for (int i = 0; i < len; ++i)
+		w25qxx_sim_xfer(sim_active, (uint8_t)data[i]);
+
+	return 0;
+}
+
+
+static uint8_t sim_interfaceWriteByte(char data)
+{
+	sim_charge(sim_active, sim_active->timing.call_overhead_ns);
+	sim_active->stats.calls++;
+
+	return w25qxx_sim_xfer(sim_active, (uint8_t)data);
+}
+
+
+static void sim_interfaceEnable(bool en)
+{
+	// CS is active low, enable(true) selects the chip
+	w25qxx_sim_select(sim_active, en);
+}
+
+
+/* Context aware, the device user pointer selects the simulator instance */
+static uint8_t sim_interfaceTransfer(const w25qxx_transfer_t *xfer)
+{
+	w25qxx_sim_t *sim = xfer->user ? (w25qxx_sim_t*)xfer->user : sim_active;
+
+	sim_charge(sim, sim->timing.call_overhead_ns);
+	sim->stats.calls++;
+
+	w25qxx_sim_select(sim, true);
+
+	for (uint8_t i = 0; i < xfer->header_len; ++i)
+		sim_clock(sim, xfer->header[i], (i < xfer->cmd_len) ? 1 : xfer->addr_lines);
+
+	for (uint32_t i = 0; i < xfer->len; ++i){
+		uint8_t in = sim_clock(sim, xfer->tx ? xfer->tx[i] : CMD_DUMMY, xfer->data_lines);
+		if (xfer->rx)
+			xfer->rx[i] = in;
+	}
+
+	w25qxx_sim_select(sim, false);
+
+	return 0;
+}
+
+
+static int32_t sim_getTime(void)
+{
+	// reading the clock costs like any callback, so polling loops see time pass
+	sim_charge(sim_active, sim_active->timing.call_overhead_ns);
+
+	return (int32_t)(*sim_active->now_ns / 1000000ull);
+}
+
+
+static uint32_t sim_getTimeUs(void)
+{
+	sim_charge(sim_active, sim_active->timing.call_overhead_ns);
+
+	return (uint32_t)(*sim_active->now_ns / 1000ull);
+}
+
+
+static void sim_delay(uint32_t ms)
+{
+	sim_charge(sim_active, (uint64_t)ms * 1000000ull);
+}
+
+
+static void sim_delayUs(uint32_t us)
+{
+	sim_charge(sim_active, (uint64_t)us * 1000ull);
+}
+
+
+void w25qxx_sim_attach(w25qxx_sim_t *sim, w25qxx_dev_t *dev)
+{
+	sim_active = sim;
+
+	dev->interface_read = sim_interfaceRead;
+	dev->interface_write = sim_interfaceWrite;
+	dev->interface_write_byte = sim_interfaceWriteByte;
+	dev->interface_enable = sim_interfaceEnable;
+	dev->interface_transfer = sim_interfaceTransfer;
+	dev->get_time = sim_getTime;
+	dev->get_time_us = sim_getTimeUs;
+	dev->delay = sim_delay;
+	dev->delay_us = sim_delayUs;
+
+	dev->user = sim;
+	dev->type = sim->type;
+}
+
+
+void w25qxx_sim_shareClock(w25qxx_sim_t *sim, w25qxx_sim_t *master)
+{
+	sim->now_ns = master->now_ns;
+}
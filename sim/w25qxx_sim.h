@@ -0,0 +1,122 @@
+#ifndef __W25QXX_SIM__
+#define __W25QXX_SIM__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "w25qxx.h"
+
+/*
+	Host side NOR flash simulator.
+
+	The simulator decodes the SPI byte stream the driver clocks through the
+	w25q32_init_t callbacks and keeps the flash contents in an mmap'd image
+	file. Time is virtual: every callback, CS cycle and clocked byte advances
+	the simulated clock according to the timing model, and delay() / get_time()
+	are served from the same clock, so a full chip can be timed on a CI box
+	without waiting for real erase times.
+*/
+
+#define W25QXX_SIM_SFDP_SIZE    0xC0    // header at 0, BFPT of 16 dwords at 80h
+
+typedef struct
+{
+    uint32_t spi_clock_hz;      // SCK frequency
+    uint32_t call_overhead_ns;  // cost of one interface_* callback (driver/HAL setup)
+    uint32_t cs_overhead_ns;    // cost of one CS assert/deassert cycle
+
+    uint32_t t_w_us;            // write status register
+    uint32_t t_pp_us;           // page program
+    uint32_t t_se_us;           // 4KB sector erase
+    uint32_t t_be32_us;         // 32KB block erase
+    uint32_t t_be64_us;         // 64KB block erase
+    uint32_t t_ce_ms;           // chip erase
+    uint32_t t_sus_us;          // suspend to ready
+    uint32_t t_rs_us;           // resume to next accepted suspend
+
+}w25qxx_sim_timing_t;
+
+
+typedef struct
+{
+    uint64_t calls;             // interface_* callback invocations
+    uint64_t transactions;      // CS cycles
+    uint64_t clocked_bytes;     // bytes clocked on the bus (header + data)
+    uint64_t data_bytes;        // payload bytes of reads and programs
+    uint64_t busy_ns;           // time the array spent busy
+
+}w25qxx_sim_stats_t;
+
+
+typedef struct
+{
+    w25qxx_t type;
+    uint32_t capacity;          // byte
+    uint8_t  *mem;
+    int      fd;
+    w25qxx_sim_timing_t timing;
+    w25qxx_sim_stats_t  stats;
+
+    uint64_t clock_ns;
+    uint64_t *now_ns;           // own clock or the one shared with other instances
+    uint64_t busy_until_ns;
+
+    uint8_t  sr[3];
+    uint8_t  uniq_id[8];
+    uint8_t  sfdp[W25QXX_SIM_SFDP_SIZE];    // JESD216 header and BFPT served by 5Ah
+    bool     wel_volatile;      // 0x50 volatile SR write enable
+    bool     addr_4byte;        // 0xB7 / 0xE9
+    bool     continuous;        // Quad I/O continuous read mode
+    uint8_t  wrap;              // 77h wrap length of Quad I/O reads, 0: linear
+    bool     suspendable;       // running instruction is an erase or program
+    uint64_t suspended_ns;      // time left of the suspended instruction
+    uint64_t resume_ns;         // last resume
+
+    /* Current CS transaction */
+    bool     selected;
+    bool     ignored;
+    uint32_t pos;
+    uint8_t  opcode;
+    uint8_t  addr_len;
+    uint8_t  hdr_len;
+    uint32_t addr;
+    uint8_t  page_buf[256];
+    bool     page_loaded;
+
+}w25qxx_sim_t;
+
+
+/* Fill timing with typical datasheet values for the given part */
+void w25qxx_sim_defaultTiming(w25qxx_t type, w25qxx_sim_timing_t *timing);
+
+/* Open a simulated chip, image_path NULL keeps the contents in anonymous memory */
+bool w25qxx_sim_open(w25qxx_sim_t *sim, w25qxx_t type, const char *image_path,
+                        const w25qxx_sim_timing_t *timing);
+
+void w25qxx_sim_close(w25qxx_sim_t *sim);
+
+/*
+    Bind the simulator to the driver callbacks (including interface_transfer) and
+    set the expected type. interface_transfer finds the instance through dev->user,
+    the context free callbacks use the instance attached last by the calling thread.
+*/
+void w25qxx_sim_attach(w25qxx_sim_t *sim, w25qxx_dev_t *dev);
+
+/* Run several chips on one timeline, e.g. chips sharing a host */
+void w25qxx_sim_shareClock(w25qxx_sim_t *sim, w25qxx_sim_t *master);
+
+/* Clock one byte in full duplex, the building block of all callbacks */
+uint8_t w25qxx_sim_xfer(w25qxx_sim_t *sim, uint8_t out);
+
+void w25qxx_sim_select(w25qxx_sim_t *sim, bool en);
+
+/* Virtual clock */
+uint64_t w25qxx_sim_nowNs(const w25qxx_sim_t *sim);
+
+void w25qxx_sim_advanceNs(w25qxx_sim_t *sim, uint64_t ns);
+
+bool w25qxx_sim_isBusy(w25qxx_sim_t *sim);
+
+void w25qxx_sim_resetStats(w25qxx_sim_t *sim);
+
+#endif
@@ -1,4 +1,6 @@
 #include <stdint.h>
+#include <stddef.h>
+#include <string.h>
 #include "w25qxx.h"
 
 #define SIZE_1_BYTE sizeof(char)
@@ -9,22 +11,234 @@
 	}					  \
 })
 
+#ifdef W25QXX_STATS
+#define W25QXX_STAT(x)	do { x; } while (0)
+#else
+#define W25QXX_STAT(x)	do { } while (0)
+#endif
 
-w25q32_init_t w25qxx;
 
-static void w25qxx_powerUp(void)
+
+
+/* Geometry, constants in a W25QXX_FIXED_TYPE build so splits and offsets become shifts and masks */
+#ifdef W25QXX_FIXED_TYPE
+#define W25QXX_PAGE_SIZE(dev)		((void)(dev), W25QXX_FIXED_PAGE_SIZE)
+#define W25QXX_SECTOR_SIZE(dev)		((void)(dev), W25QXX_FIXED_SECTOR_SIZE)
+#define W25QXX_BLOCK_SIZE(dev)		((void)(dev), W25QXX_FIXED_BLOCK_SIZE)
+#else
+#define W25QXX_PAGE_SIZE(dev)		((dev)->page_size)
+#define W25QXX_SECTOR_SIZE(dev)		((dev)->sector_size)
+#define W25QXX_BLOCK_SIZE(dev)		((dev)->block_size)
+#endif
+
+
+static uint8_t w25qxx_addrLen(w25qxx_dev_t *dev)
+{
+#ifdef W25QXX_FIXED_TYPE
+	(void)dev;
+	return W25QXX_FIXED_ADDR_4BYTE ? 4 : 3;
+#else
+	return (dev->addr_mode != W25QXX_ADDR_3BYTE) ? 4 : 3;
+#endif
+}
+
+
+/* Parts above 16MB without B7h use the 4-byte address instructions */
+static bool w25qxx_use4ByteOpcodes(w25qxx_dev_t *dev)
+{
+#ifdef W25QXX_FIXED_TYPE
+	(void)dev;
+	return W25QXX_FIXED_ADDR_4BYTE;
+#else
+	return dev->addr_mode == W25QXX_ADDR_4BYTE_OPCODES;
+#endif
+}
+
+
+static void w25qxx_exitContinuousRead(w25qxx_dev_t *dev);
+
+
+/* Tell the listeners that a program/erase was issued on [addr, addr + len) */
+static void w25qxx_notify(w25qxx_dev_t *dev, uint32_t addr, uint32_t len, bool erase)
+{
+	for (w25qxx_notify_t *n = dev->notify; n; n = n->next)
+		n->changed(n, addr, len, erase);
+}
+static bool w25qxx_waitForOp(w25qxx_dev_t *dev, w25qxx_op_type_t type);
+
+
+#ifdef W25QXX_STATS
+static uint32_t w25qxx_timeUs(w25qxx_dev_t *dev)
+{
+	return dev->get_time_us ? dev->get_time_us() : (uint32_t)dev->get_time() * 1000;
+}
+
+
+/* Count the time since start_us in its log2 bucket */
+static void w25qxx_statLatency(w25qxx_dev_t *dev, w25qxx_latency_t kind, uint32_t start_us)
+{
+	uint32_t us = w25qxx_timeUs(dev) - start_us;
+	uint8_t bucket = 0;
+
+	while ((us >>= 1) && (bucket < (W25QXX_HIST_BUCKETS - 1)))
+		bucket++;
+
+	dev->stats.latency[kind][bucket]++;
+}
+
+
+static w25qxx_latency_t w25qxx_opLatency(w25qxx_op_type_t type)
+{
+	switch (type)
+	{
+		case W25QXX_OP_ERASE_SECTOR:	return W25QXX_LAT_SECTOR_ERASE;
+		case W25QXX_OP_ERASE_BLOCK:
+		case W25QXX_OP_ERASE_BLOCK_32K:	return W25QXX_LAT_BLOCK_ERASE;
+		case W25QXX_OP_ERASE_CHIP:		return W25QXX_LAT_CHIP_ERASE;
+		case W25QXX_OP_WRITE:
+		default:						return W25QXX_LAT_PAGE_PROGRAM;
+	}
+}
+
+
+static void w25qxx_statTransfer(w25qxx_dev_t *dev, const w25qxx_transfer_t *xfer)
+{
+	dev->stats.transactions++;
+
+	if (xfer->cmd_len)
+		dev->stats.commands[xfer->header[0]]++;
+	else if (dev->continuous_read)
+		dev->stats.commands[w25qxx_use4ByteOpcodes(dev) ? CMD_Fast_Read_Quad_IO_4_Byte_Addr : dev->read_cmd[W25QXX_READ_QUAD_IO]]++;
+
+	if (xfer->tx)
+		dev->stats.bytes_written += xfer->len;
+	if (xfer->rx)
+		dev->stats.bytes_read += xfer->len;
+}
+#endif
+
+
+/** 
+  * @brief  run one bus transaction, through interface_transfer when the backend
+  *         provides it, otherwise with the byte-wise callbacks
+  * @param  *xfer: [in] header and data phase
+  * @retval status 1:passed  0:failed
+  */
+static bool w25qxx_transfer(w25qxx_dev_t *dev, const w25qxx_transfer_t *xfer)
+{
+	// an opcode would be taken as address while Quad I/O continuous read is active
+	if (dev->continuous_read && xfer->cmd_len)
+		w25qxx_exitContinuousRead(dev);
+
+	W25QXX_STAT(w25qxx_statTransfer(dev, xfer));
+
+	if (dev->interface_transfer)
+		return dev->interface_transfer(xfer) == 0;
+
+	// byte-wise callbacks are single line only
+	if ((xfer->addr_lines != 1) || (xfer->data_lines != 1))
+		return false;
+
+	dev->interface_enable(true);
+
+	for (uint8_t i = 0; i < xfer->header_len; ++i)
+		dev->interface_write_byte(xfer->header[i]);
+
+	if (xfer->tx && xfer->len)
+		dev->interface_write((char*)xfer->tx, xfer->len);
+
+	if (xfer->rx && xfer->len)
+		dev->interface_read((char*)xfer->rx, xfer->len);
+
+	dev->interface_enable(false);
+
+	return true;
+}
+
+
+/** 
+  * @brief  fill the opcode + address + dummy header, all phases single line
+  * @param  *xfer: [out] transaction to build
+  * @param  cmd: [in] opcode
+  * @param  addr: [in] address, sent MSB first
+  * @param  addr_len: [in] 0, 3 or 4 address bytes
+  * @param  dummy_len: [in] dummy bytes after the address
+  */
+static void w25qxx_buildHeader(w25qxx_dev_t *dev, w25qxx_transfer_t *xfer, uint8_t cmd, uint32_t addr,
+								uint8_t addr_len, uint8_t dummy_len)
+{
+	xfer->header_len = 0;
+	xfer->header[xfer->header_len++] = cmd;
+
+	for (uint8_t i = addr_len; i > 0; --i)
+		xfer->header[xfer->header_len++] = (addr >> ((i - 1) * 8)) & 0xFF;
+
+	while (dummy_len--)
+		xfer->header[xfer->header_len++] = CMD_DUMMY;
+
+	xfer->user = dev->user;
+	xfer->cmd_len = 1;
+	xfer->addr_lines = 1;
+	xfer->data_lines = 1;
+	xfer->tx = NULL;
+	xfer->rx = NULL;
+	xfer->len = 0;
+}
+
+
+/** 
+  * @brief  build the opcode + address + dummy header and run the transaction
+  * @param  cmd: [in] opcode
+  * @param  addr: [in] address, sent MSB first
+  * @param  addr_len: [in] 0, 3 or 4 address bytes
+  * @param  dummy_len: [in] dummy bytes after the address
+  * @param  *tx, *rx: [in/out] data phase, at most one of them is used
+  * @param  len: [in] data phase length
+  * @retval status 1:passed  0:failed
+  */
+static bool w25qxx_command(w25qxx_dev_t *dev, uint8_t cmd, uint32_t addr, uint8_t addr_len, uint8_t dummy_len,
+							const uint8_t *tx, uint8_t *rx, uint32_t len)
+{
+	w25qxx_transfer_t xfer;
+
+	w25qxx_buildHeader(dev, &xfer, cmd, addr, addr_len, dummy_len);
+
+	xfer.tx = tx;
+	xfer.rx = rx;
+	xfer.len = len;
+
+	return w25qxx_transfer(dev, &xfer);
+}
+
+
+/** 
+  * @brief  leave Quad I/O continuous read mode, address and M7-0 clocked as all ones
+  */
+static void w25qxx_exitContinuousRead(w25qxx_dev_t *dev)
 {
-	char dummy = CMD_DUMMY;
+	w25qxx_transfer_t xfer;
 
-    w25qxx.interface_enable(true);
+	dev->continuous_read = false;
 
-	w25qxx.interface_write_byte(CMD_Device_ID);
+	xfer.header_len = w25qxx_addrLen(dev) + 1;
+	for (uint8_t i = 0; i < xfer.header_len; ++i)
+		xfer.header[i] = 0xFF;
 
-	for(int i=0; i<3; ++i) w25qxx.interface_write_byte(CMD_DUMMY);
+	xfer.user = dev->user;
+	xfer.cmd_len = 0;
+	xfer.addr_lines = 4;
+	xfer.data_lines = 4;
+	xfer.tx = NULL;
+	xfer.rx = NULL;
+	xfer.len = 0;
+
+	w25qxx_transfer(dev, &xfer);
+}
 
-	w25qxx.interface_read(&w25qxx.device_id, SIZE_1_BYTE);
 
-	w25qxx.interface_enable(false);
+static void w25qxx_powerUp(w25qxx_dev_t *dev)
+{
+	w25qxx_command(dev, CMD_Device_ID, 0, 0, 3, NULL, &dev->device_id, SIZE_1_BYTE);
 	/*
 		   POWER UP INSTRUCTION 
 		|-----------------------|
@@ -36,43 +250,30 @@ static void w25qxx_powerUp(void)
 }
 
 
-static uint16_t w25qxx_getManDeviceID(void)
+static uint16_t w25qxx_getManDeviceID(w25qxx_dev_t *dev)
 {
-	char id;
-
-	w25qxx.interface_enable(true);
-
-	w25qxx.interface_write_byte(CMD_Device_ID);
-	for(int i=0; i<3; ++i) w25qxx.interface_write_byte(CMD_DUMMY);
-
-	w25qxx.interface_read(&id, SIZE_1_BYTE);
+	uint8_t id[2];
 
-	w25qxx.interface_enable(false);
+	w25qxx_command(dev, CMD_Manufacture_ID, 0, 3, 0, NULL, id, SIZE_1_BYTE*2);
 
-	return (CMD_Manufacture_ID << 8) | id;
+	return (id[0] << 8) | id[1];
 	/*
 		Read Manufacturer Device INSTRUCTION 
 		|-----------------------|
 		|BYTE1|BYTE2|BYTE3|BYTE4|
 		|-----------------------|
-		|0x90 |DUMMY|DUMMY|DUMMY|
+		|0x90 |0x00 |0x00 |0x00 |
 		|-----------------------| 
 	*/
 }
 
 
 
-static uint32_t w25qxx_getJedecID(void)
+static uint32_t w25qxx_getJedecID(w25qxx_dev_t *dev)
 {
-	char buffer[3];
+	uint8_t buffer[3];
 
-	w25qxx.interface_enable(true);
-
-	w25qxx.interface_write_byte(CMD_JEDEC_ID);
-
-	w25qxx.interface_read(buffer, SIZE_1_BYTE*3);
-
-	w25qxx.interface_enable(false);
+	w25qxx_command(dev, CMD_JEDEC_ID, 0, 0, 0, NULL, buffer, SIZE_1_BYTE*3);
 	
 	return (buffer[0] << 16) | (buffer[1] << 8) | buffer[2];
 
@@ -86,135 +287,137 @@ static uint32_t w25qxx_getJedecID(void)
 	*/
 }
 
-static void w25qxx_getUniqID(void)
+static void w25qxx_getUniqID(w25qxx_dev_t *dev)
 {
-	w25qxx.interface_enable(true);
-
-	w25qxx.interface_write_byte(CMD_Unique_ID);
-	for (uint8_t i = 0; i < 4; i++) w25qxx.interface_write_byte(CMD_DUMMY);
-
-	w25qxx.interface_read(w25qxx.uniq_id, SIZE_1_BYTE*8);
-
-	w25qxx.interface_enable(false);
+	w25qxx_command(dev, CMD_Unique_ID, 0, 0, 4, NULL, dev->uniq_id, SIZE_1_BYTE*8);
 	/*
 		Read Manufacturer Device INSTRUCTION 
 		|-----------------------------|
 		|BYTE1|BYTE2|BYTE3|BYTE4|BYTE5|
 		|-----------------------------|
-		|0x90 |DUMMY|DUMMY|DUMMY|DUMMY|
+		|0x4B |DUMMY|DUMMY|DUMMY|DUMMY|
 		|-----------------------------| 
 	*/
 }
 
 
 
-static void w25qxx_enableWrite(void)
+static void w25qxx_enableWrite(w25qxx_dev_t *dev)
 {
-	w25qxx.interface_enable(true);
-
-	w25qxx.interface_write_byte(CMD_Write_Enable);
-
-	w25qxx.interface_enable(false);
+	w25qxx_command(dev, CMD_Write_Enable, 0, 0, 0, NULL, NULL, 0);
 }
 
 
-static void w25qxx_enableWriteSR(void)
+static void w25qxx_enableWriteSR(w25qxx_dev_t *dev)
 {
-	w25qxx.interface_enable(true);
+	w25qxx_command(dev, CMD_Write_Enable_SR, 0, 0, 0, NULL, NULL, 0);
+}
 
-	w25qxx.interface_write_byte(CMD_Write_Enable_SR);
 
-	w25qxx.interface_enable(false);
-}
 
+static void w25qxx_disableWrite(w25qxx_dev_t *dev)
+{
+	w25qxx_command(dev, CMD_Write_Disable, 0, 0, 0, NULL, NULL, 0);
+}
 
 
-static void w25qxx_disableWrite(void)
+/* Sleep without touching the bus, whole milliseconds through delay, returns the time actually slept */
+static uint32_t w25qxx_sleepUs(w25qxx_dev_t *dev, uint32_t us)
 {
-	w25qxx.interface_enable(true);
+	uint32_t slept = (us / 1000) * 1000;
 
-	w25qxx.interface_write_byte(CMD_Write_Enable);
+	if (slept)
+		dev->delay(us / 1000);
 
-	w25qxx.interface_enable(false);
+	if ((us % 1000) && dev->delay_us){
+		dev->delay_us(us % 1000);
+		slept += us % 1000;
+	}
+
+	return slept;
 }
 
 
-static bool w25qxx_waitForWriteEnd(void)
+static bool w25qxx_isBusy(w25qxx_dev_t *dev)
 {
-	w25qxx.interface_enable(true);
+	W25QXX_STAT(dev->stats.sr1_polls++);
 
-	uint32_t current_time = w25qxx.get_time();
-	uint32_t useTime = 0;
-	uint8_t reg_res;
-	w25qxx.interface_write_byte(CMD_Reg_1_Read);
-	do
-	{
-		reg_res = w25qxx.interface_write_byte(CMD_DUMMY);
+	return (w25qxx_dev_readRegX(dev, 1) & SR1_S0_BUSY) == SR1_S0_BUSY;
+}
 
-		useTime = w25qxx.get_time() - current_time;
-	} while (((reg_res & SR1_S0_BUSY) == SR1_S0_BUSY) && (useTime < SPI_FLASH_TIMEOUT));
 
-	w25qxx.interface_enable(true);
+/* Wait for whatever runs on the chip, SR1 polled with a doubling interval */
+static bool w25qxx_waitForWriteEnd(w25qxx_dev_t *dev)
+{
+	int32_t  start = dev->get_time();
+	uint32_t step = W25QXX_POLL_MIN_US;
 
-	if (useTime >= SPI_FLASH_TIMEOUT)	// timeOut return 1
-		return false;
-	return true;	// passed return 0
+	while (w25qxx_isBusy(dev)){
+		if ((uint32_t)(dev->get_time() - start) >= SPI_FLASH_TIMEOUT){
+			W25QXX_STAT(dev->stats.timeouts++);
+			return false;
+		}
+
+		w25qxx_sleepUs(dev, step);
+		if (step < W25QXX_POLL_MAX_US)
+			step *= 2;
+	}
+
+	return true;
 }
 
 
-static uint32_t w25qxx_pageToSector(uint32_t page_addr)
+static uint32_t w25qxx_pageToSector(w25qxx_dev_t *dev, uint32_t page_addr)
 {
-	return ((page_addr * w25qxx.page_size) / w25qxx.sector_size);
+	return ((page_addr * W25QXX_PAGE_SIZE(dev)) / W25QXX_SECTOR_SIZE(dev));
 }
 
 
-static uint32_t w25qxx_pageToBlock(uint32_t page_addr)
+static uint32_t w25qxx_pageToBlock(w25qxx_dev_t *dev, uint32_t page_addr)
 {
-	return ((page_addr * w25qxx.page_size) / w25qxx.block_size);
+	return ((page_addr * W25QXX_PAGE_SIZE(dev)) / W25QXX_BLOCK_SIZE(dev));
 }
 
 
-static uint32_t w25qxx_sectorToPage(uint32_t sector_addr)
+static uint32_t w25qxx_sectorToPage(w25qxx_dev_t *dev, uint32_t sector_addr)
 {
-	return (sector_addr * w25qxx.sector_size) / w25qxx.page_size;
+	return (sector_addr * W25QXX_SECTOR_SIZE(dev)) / W25QXX_PAGE_SIZE(dev);
 }
 
 
-static uint32_t w25qxx_blockToPage(uint32_t bloack_addr)
+static uint32_t w25qxx_blockToPage(w25qxx_dev_t *dev, uint32_t bloack_addr)
 {
-	return (bloack_addr * w25qxx.block_size) / w25qxx.page_size;
+	return (bloack_addr * W25QXX_BLOCK_SIZE(dev)) / W25QXX_PAGE_SIZE(dev);
 }
 
 
 
 /**
   * @brief  Read Status Register-1, 2, 3(05h, 35h, 15h)
+  * @param  *dev: [in] device handle
   * @param  reg_x: [in] 1,2,3
   * @retval retrun SR_x value [Byte]
   */
-uint8_t w25qxx_readRegX(uint8_t reg_x)
+uint8_t w25qxx_dev_readRegX(w25qxx_dev_t *dev, uint8_t reg_x)
 {
-	uint8_t buff;
-	
-	w25qxx.interface_enable(true);
+	uint8_t buff = 0;
+	uint8_t cmd;
 
 	switch(reg_x)
 	{
 		case 1:	// reg 1
-			w25qxx.interface_write_byte(CMD_Reg_1_Read);
+			cmd = CMD_Reg_1_Read;
 			break;
 		case 2:	// reg 2
-			w25qxx.interface_write_byte(CMD_Reg_2_Read);
+			cmd = CMD_Reg_2_Read;
 			break;
 		case 3:	// reg 3
-			w25qxx.interface_write_byte(CMD_Reg_3_Read);
+			cmd = CMD_Reg_3_Read;
 			break;
 		default:
-			break;
+			return buff;
 	}
-	w25qxx.interface_read(&buff, SIZE_1_BYTE);
-
-	w25qxx.interface_enable(false);
+	w25qxx_command(dev, cmd, 0, 0, 0, NULL, &buff, SIZE_1_BYTE);
 
 	return buff;
 }
@@ -224,284 +427,326 @@ uint8_t w25qxx_readRegX(uint8_t reg_x)
   * @param reg_x: [in] reg_1,2,3
   * @param data:  [in] input reg_x data
   */
-static void w25qxx_writeRegX(uint8_t reg_x, uint8_t data)
+static void w25qxx_writeRegX(w25qxx_dev_t *dev, uint8_t reg_x, uint8_t data)
 {
-	w25qxx.interface_enable(true);
+	uint8_t cmd;
 
 	switch (reg_x)
 	{
 		case 1:
-			w25qxx.interface_write_byte(CMD_Reg_1_Write);
+			cmd = CMD_Reg_1_Write;
 			break;
 		case 2:
-			w25qxx.interface_write_byte(CMD_Reg_2_Write);
+			cmd = CMD_Reg_2_Write;
 			break;
 		case 3:
-			w25qxx.interface_write_byte(CMD_Reg_3_Write);
+			cmd = CMD_Reg_3_Write;
 			break;
 		default:
-			break;
+			return;
 	}
-	w25qxx.interface_write_byte(data);
-
-	w25qxx.interface_enable(false);
+	w25qxx_command(dev, cmd, 0, 0, 0, &data, NULL, SIZE_1_BYTE);
 }
 
 
-int8_t w25q32_eraseChip(void)
+/** 
+  * @brief  set or clear the Quad Enable bit (SR2 S9), read-modify-write of SR2
+  *         with a fallback to the two byte 01h write for parts without 31h
+  * @param  *dev: [in] device handle
+  * @param  en: [in] QE value
+  * @retval status 1:passed  0:failed
+  */
+bool w25qxx_dev_setQuadEnable(w25qxx_dev_t *dev, bool en)
 {
-	ERROR_CHECK(w25qxx_waitForWriteEnd());
+	uint8_t sr[2];
 
-	w25qxx_enableWrite();
+	ERROR_CHECK(w25qxx_waitForWriteEnd(dev));
 
-	w25qxx.interface_enable(true);
+	sr[1] = w25qxx_dev_readRegX(dev, 2);
+	if (((sr[1] & SR2_S9_QE) != 0) == en)
+		return true;
 
-	w25qxx.interface_write_byte(CMD_Erase_Chip);
+	sr[1] = en ? (sr[1] | SR2_S9_QE) : (sr[1] & (uint8_t)~SR2_S9_QE);
 
-	w25qxx.interface_enable(false);
+	w25qxx_enableWrite(dev);
+	w25qxx_writeRegX(dev, 2, sr[1]);
+	ERROR_CHECK(w25qxx_waitForWriteEnd(dev));
 
-	ERROR_CHECK(w25qxx_waitForWriteEnd());
+	if (((w25qxx_dev_readRegX(dev, 2) & SR2_S9_QE) != 0) == en)
+		return true;
 
-	return true;
+	sr[0] = w25qxx_dev_readRegX(dev, 1) & (uint8_t)~(SR1_S0_BUSY | SR1_S1_WEL);
+
+	w25qxx_enableWrite(dev);
+	w25qxx_command(dev, CMD_Reg_1_Write, 0, 0, 0, sr, NULL, SIZE_1_BYTE*2);
+	ERROR_CHECK(w25qxx_waitForWriteEnd(dev));
+
+	return ((w25qxx_dev_readRegX(dev, 2) & SR2_S9_QE) != 0) == en;
 }
 
 
 /** 
-  * @brief  Sector erase 4KB
-  * @param  sector_addr: [in] 0 ~ W25Qxxx_SectorCount-1
-  * @retval status 0:passed  1:failed
+  * @brief  select the read command used by w25qxx_read, quad modes set QE first
+  * @param  *dev: [in] device handle
+  * @param  mode: [in] W25QXX_READ_xxx, dual/quad need interface_transfer and a part supporting them
+  * @retval status 1:passed  0:failed
   */
-bool w25q32_eraseSector(uint32_t sector_addr)
+bool w25qxx_dev_setReadMode(w25qxx_dev_t *dev, w25qxx_read_mode_t mode)
 {
-	ERROR_CHECK(w25qxx_waitForWriteEnd());
+	if ((mode != W25QXX_READ_FAST) && !dev->interface_transfer)
+		return false;
 
-	sector_addr = sector_addr * w25qxx.sector_size;
-	w25qxx_enableWrite();
+	if ((mode > W25QXX_READ_QUAD_IO_CONTINUOUS) || !(dev->read_modes & (1 << mode)))
+		return false;
 
-	w25qxx.interface_enable(true);
-	if (w25qxx.type >= W25Q256){
+	if (dev->continuous_read)
+		w25qxx_exitContinuousRead(dev);
 
-		w25qxx.interface_write_byte(CMD_Erase_Sector_4_Byte_Addr);
-		w25qxx.interface_write_byte((sector_addr & 0xFF000000) >> 24);
-	}else{
-		w25qxx.interface_write_byte(CMD_Erase_Sector);
-	}
-	w25qxx.interface_write_byte((sector_addr & 0xFF0000) >> 16);
-	w25qxx.interface_write_byte((sector_addr & 0xFF00) >> 8);
-	w25qxx.interface_write_byte(sector_addr & 0xFF);
+	if (mode >= W25QXX_READ_QUAD_OUTPUT)
+		ERROR_CHECK(w25qxx_dev_setQuadEnable(dev, true));
 
+	dev->read_mode = mode;
+
+	return true;
+}
+
+
+/** 
+  * @brief  use Quad Page Program (32h/34h) for page writes
+  * @param  *dev: [in] device handle
+  * @param  en: [in] enable
+  * @retval status 1:passed  0:failed
+  */
+bool w25qxx_dev_setQuadProgram(w25qxx_dev_t *dev, bool en)
+{
+	if (en && !dev->interface_transfer)
+		return false;
 
-	w25qxx.interface_enable(false);
+	if (en)
+		ERROR_CHECK(w25qxx_dev_setQuadEnable(dev, true));
 
-	ERROR_CHECK(w25qxx_waitForWriteEnd());
+	dev->quad_program = en;
 
 	return true;
 }
 
 
-
 /** 
-  * @brief Erase block 64KB
-  * @param block_addr: [in] 0 ~ W25Qxxx_BlockCount-1
-  * @retval status 0:passed  1:failed
+  * @brief  Set Burst with Wrap (77h), Quad I/O reads wrap inside len byte aligned lines
+  * @param  *dev: [in] device handle
+  * @param  len: [in] 8, 16, 32 or 64, 0: linear reads
+  * @retval status 1:passed  0:failed
   */
-bool w25qxx_eraseBlock(uint32_t block_addr)
+bool w25qxx_dev_setBurstWrap(w25qxx_dev_t *dev, uint8_t len)
 {
-	ERROR_CHECK(w25qxx_waitForWriteEnd());
-
-	block_addr = block_addr * w25qxx.block_size;
-	w25qxx.interface_enable(true);
+	w25qxx_transfer_t xfer;
+	uint8_t bits;
 
-	if (w25qxx.type >= W25Q256){
-		w25qxx.interface_write_byte(CMD_Erase_Block_64K_4_Byte_Addr);
-		w25qxx.interface_write_byte((block_addr & 0xFF000000) >> 24);
-	}else{
-		w25qxx.interface_write_byte(CMD_Erase_Block_64K_4_Byte_Addr);
-		w25qxx.interface_write_byte(CMD_Erase_Block_64K);
+	switch (len)
+	{
+		case 0:		bits = W25QXX_WRAP_DISABLE;	break;
+		case 8:		bits = 0x00;	break;
+		case 16:	bits = 0x20;	break;
+		case 32:	bits = 0x40;	break;
+		case 64:	bits = 0x60;	break;
+		default:	return false;
 	}
-	w25qxx.interface_write_byte((block_addr & 0xFF0000) >> 16);
-	w25qxx.interface_write_byte((block_addr & 0xFF00) >> 8);
-	w25qxx.interface_write_byte(block_addr & 0xFF);
 
-	w25qxx.interface_enable(false);
+	if (len == dev->burst_wrap)
+		return true;
 
-	ERROR_CHECK(w25qxx_waitForWriteEnd());
+	// 77h needs QE, which the Quad I/O read modes have set
+	if (dev->read_mode < W25QXX_READ_QUAD_IO)
+		return false;
+
+	// opcode, then 3 dummy bytes and W7-0 on four lines
+	w25qxx_buildHeader(dev, &xfer, CMD_Set_Burst_With_Wrap, 0, 0, 4);
+	xfer.header[4] = bits;
+	xfer.addr_lines = 4;
+	ERROR_CHECK(w25qxx_transfer(dev, &xfer));
+
+	dev->burst_wrap = len;
 
 	return true;
 }
 
 
-
+/** 
+  * @brief  route writePage/writeSector (and writeBlock) through w25qxx_dev_writeSmart
+  * @param  *dev: [in] device handle
+  * @param  *scratch: [in] sector_size bytes owned by the driver while enabled, NULL: plain writes
+  */
+void w25qxx_dev_setSmartWrite(w25qxx_dev_t *dev, uint8_t *scratch)
+{
+	dev->smart_scratch = scratch;
+}
 
 
 /** 
-  * @brief write one Byte to w25qxxx flash
-  * @param pBuffer: [in] input data
-  * @param WriteAddr_inBytes: [in] indicate address
-  * @retval status 0:passed  1:failed
+  * @brief  read back every blocking program and fail the write on a mismatch
+  * @param  *dev: [in] device handle
+  * @param  en: [in] enable
   */
-bool w25qxx_writeByte(const uint8_t* buff, uint32_t WriteAddr_inBytes)
+void w25qxx_dev_setVerify(w25qxx_dev_t *dev, bool en)
 {
-	ERROR_CHECK(w25qxx_waitForWriteEnd());
+	dev->verify = en;
+}
+
 
-	w25qxx_enableWrite();
+/** 
+  * @brief  let reads suspend (75h) a running non-blocking erase/program
+  * @param  *dev: [in] device handle
+  * @param  limit: [in] suspends allowed per operation, further reads wait for it, 0: never suspend
+  */
+void w25qxx_dev_setSuspendLimit(w25qxx_dev_t *dev, uint8_t limit)
+{
+	dev->suspend_limit = limit;
+}
 
-	w25qxx.interface_enable(true);
 
-	if (w25qxx.type >= W25Q256){
-		w25qxx.interface_write_byte(CMD_Page_Program_4_Byte_Addr);
-		w25qxx.interface_write_byte((WriteAddr_inBytes & 0xFF000000) >> 24);
-	}else{
-		w25qxx.interface_write_byte(CMD_Page_Program);
-	}
+/** 
+  * @brief  get called for every program/erase issued on the device
+  * @param  *dev: [in] device handle
+  * @param  *n: [in] listener with changed set, must stay valid until removed
+  */
+void w25qxx_dev_addNotify(w25qxx_dev_t *dev, w25qxx_notify_t *n)
+{
+	n->next = dev->notify;
+	dev->notify = n;
+}
 
-	w25qxx.interface_write_byte((WriteAddr_inBytes & 0xFF0000) >> 16);
-	w25qxx.interface_write_byte((WriteAddr_inBytes & 0xFF00) >> 8);
-	w25qxx.interface_write_byte(WriteAddr_inBytes & 0xFF);
-	w25qxx.interface_write(buff, SIZE_1_BYTE);
 
-	w25qxx.interface_enable(false);
+void w25qxx_dev_removeNotify(w25qxx_dev_t *dev, w25qxx_notify_t *n)
+{
+	for (w25qxx_notify_t **p = &dev->notify; *p; p = &(*p)->next){
+		if (*p == n){
+			*p = n->next;
+			break;
+		}
+	}
+}
 
-	ERROR_CHECK(w25qxx_waitForWriteEnd());
 
+/** 
+  * @brief  copy the performance counters
+  * @param  *dev: [in] device handle
+  * @param  *snapshot: [out] counters since init or the last reset
+  * @retval status 1:passed  0:built without W25QXX_STATS
+  */
+bool w25qxx_dev_getStats(w25qxx_dev_t *dev, w25qxx_stats_t *snapshot)
+{
+#ifdef W25QXX_STATS
+	memcpy(snapshot, &dev->stats, sizeof(*snapshot));
 	return true;
+#else
+	(void)dev;
+	(void)snapshot;
+	return false;
+#endif
 }
 
 
+void w25qxx_dev_resetStats(w25qxx_dev_t *dev)
+{
+	W25QXX_STAT(memset(&dev->stats, 0, sizeof(dev->stats)));
+	(void)dev;
+}
+
 
 /** 
-  * @brief write Byte data to indicate page address
-  * @param *pBuffer: [in] Byte data array
-  * @param Page_Address: [in] page address (0 - W25Qxxx_PageCount-1)
-  * @param OffsetInByte: [in] offset address
-  * @retval status 0:passed  1:failed
+  * @brief  WREN + erase instruction, returns without waiting for BUSY
+  * @param  type: [in] W25QXX_OP_ERASE_SECTOR / _BLOCK / _CHIP
+  * @param  addr: [in] byte address inside the sector/block, unused for chip erase
+  * @retval status 1:passed  0:failed
   */
-bool w25qxx_writePage(const uint8_t *buff, uint32_t page_addr, 
-						uint32_t OffsetInByte, uint32_t NumByteToWrite_up_to_PageSize)
+static bool w25qxx_issueErase(w25qxx_dev_t *dev, w25qxx_op_type_t type, uint32_t addr)
 {
-	if (((NumByteToWrite_up_to_PageSize + OffsetInByte) > w25qxx.page_size) || (NumByteToWrite_up_to_PageSize == 0))
-		NumByteToWrite_up_to_PageSize = w25qxx.page_size - OffsetInByte;
+	bool addr_4byte = w25qxx_use4ByteOpcodes(dev);
+	uint32_t size;
+	bool res;
 
-	ERROR_CHECK(w25qxx_waitForWriteEnd());
+	w25qxx_enableWrite(dev);
 
-	w25qxx_enableWrite();
+	switch (type)
+	{
+		case W25QXX_OP_ERASE_SECTOR:
+			size = W25QXX_SECTOR_SIZE(dev);
+			res = w25qxx_command(dev, addr_4byte ? CMD_Erase_Sector_4_Byte_Addr : CMD_Erase_Sector,
+									addr, w25qxx_addrLen(dev), 0, NULL, NULL, 0);
+			break;
+		case W25QXX_OP_ERASE_BLOCK:
+			size = W25QXX_BLOCK_SIZE(dev);
+			res = w25qxx_command(dev, addr_4byte ? CMD_Erase_Block_64K_4_Byte_Addr : CMD_Erase_Block_64K,
+									addr, w25qxx_addrLen(dev), 0, NULL, NULL, 0);
+			break;
+		case W25QXX_OP_ERASE_BLOCK_32K:
+			size = W25QXX_BLOCK_SIZE(dev) / 2;
+			res = w25qxx_command(dev, addr_4byte ? CMD_Erase_Block_32K_4_Byte_Addr : CMD_Erase_Block_32K,
+									addr, w25qxx_addrLen(dev), 0, NULL, NULL, 0);
+			break;
+		case W25QXX_OP_ERASE_CHIP:
+			size = dev->capacity_kb * 1024;
+			addr = 0;
+			res = w25qxx_command(dev, CMD_Erase_Chip, 0, 0, 0, NULL, NULL, 0);
+			break;
+		default:
+			return false;
+	}
 
-	w25qxx.interface_enable(true);
+	if (res)
+		w25qxx_notify(dev, addr - (addr % size), size, true);
 
-	page_addr = (page_addr * w25qxx.page_size) + OffsetInByte;
-	if (w25qxx.type >= W25Q256){
-		w25qxx.interface_write_byte(CMD_Page_Program_4_Byte_Addr);
-		w25qxx.interface_write_byte((page_addr & 0xFF000000) >> 24);
-	}else{
-		w25qxx.interface_write_byte(CMD_Page_Program);
-	}
-	w25qxx.interface_write_byte((page_addr & 0xFF0000) >> 16);
-	w25qxx.interface_write_byte((page_addr & 0xFF00) >> 8);
-	w25qxx.interface_write_byte(page_addr & 0xFF);
+	return res;
+}
 
-	//HAL_SPI_Transmit(&hspi_flash, (uint8_t *)pBuffer, NumByteToWrite_up_to_PageSize, SPI_FLASH_TIMEOUT);
-	w25qxx.interface_write((char*)buff, NumByteToWrite_up_to_PageSize);
 
-	w25qxx.interface_enable(false);
+bool w25qxx_dev_eraseChip(w25qxx_dev_t *dev)
+{
+	ERROR_CHECK(w25qxx_waitForWriteEnd(dev));
 
-	ERROR_CHECK(w25qxx_waitForWriteEnd());
+	ERROR_CHECK(w25qxx_issueErase(dev, W25QXX_OP_ERASE_CHIP, 0));
 
-	//TODO delay function
-	w25qxx.delay(1);
-	//HAL_Delay(1);
+	ERROR_CHECK(w25qxx_waitForOp(dev, W25QXX_OP_ERASE_CHIP));
 
 	return true;
 }
 
+
 /** 
-  * @brief write Byte data to indicate sector address  4KB Max based on page Write
-  * @param *pBuffer: [in] Byte data array
-  * @param Page_Address: [in] page address (0 - W25Qxxx_SectorCount-1)
-  * @param OffsetInByte: [in] offset byte number
-  * @param NumByteToWrite_up_to_SectorSize: [in] Byte data number
+  * @brief  Sector erase 4KB
+  * @param  *dev: [in] device handle
+  * @param  sector_addr: [in] 0 ~ W25Qxxx_SectorCount-1
   * @retval status 0:passed  1:failed
   */
-bool w25qxx_writeSector(const uint8_t *buff, uint32_t sector_addr, 
-						uint32_t OffsetInByte, uint32_t NumByteToWrite_up_to_SectorSize)
+bool w25qxx_dev_eraseSector(w25qxx_dev_t *dev, uint32_t sector_addr)
 {
-	uint32_t start_page;
-	int32_t  remain_bytes;
-	uint32_t local_offset;
+	ERROR_CHECK(w25qxx_waitForWriteEnd(dev));
 
-	if ((NumByteToWrite_up_to_SectorSize > w25qxx.sector_size) || 
-											(NumByteToWrite_up_to_SectorSize == 0))
-		NumByteToWrite_up_to_SectorSize = w25qxx.sector_size;
-
-	if (OffsetInByte >= w25qxx.sector_size){
-		return false;
-	}
-
-	if ((OffsetInByte + NumByteToWrite_up_to_SectorSize) > w25qxx.sector_size){
-		remain_bytes = w25qxx.sector_size - OffsetInByte;
-	}else{
-		remain_bytes = NumByteToWrite_up_to_SectorSize;
-	}
-		
+	ERROR_CHECK(w25qxx_issueErase(dev, W25QXX_OP_ERASE_SECTOR, sector_addr * W25QXX_SECTOR_SIZE(dev)));
 
-	start_page = w25qxx_sectorToPage(sector_addr) + (OffsetInByte / w25qxx.page_size);
-	local_offset = OffsetInByte % w25qxx.page_size;
-	
-	do{
-		uint8_t res = w25qxx_writePage(buff, start_page, local_offset, remain_bytes);
-		if (res != 0)
-			return false;
-		start_page++;
-		remain_bytes -= w25qxx.page_size - local_offset;
-		buff += w25qxx.page_size - local_offset;
-		local_offset = 0;
-	}while(remain_bytes > 0);
+	ERROR_CHECK(w25qxx_waitForOp(dev, W25QXX_OP_ERASE_SECTOR));
 
 	return true;
 }
 
 
+
 /** 
-  * @brief write Byte data to indicate block address  64KB Max base on page Write
-  * @param *pBuffer: [in] Byte data array
-  * @param Block_Address: [in] page address (0 - W25Qxxx_BlockCount-1)
-  * @param OffsetInByte: [in] offset byte number
-  * @param NumByteToWrite_up_to_BlockSize: [in] Byte data number
+  * @brief Erase block 64KB
+  * @param  *dev: [in] device handle
+  * @param block_addr: [in] 0 ~ W25Qxxx_BlockCount-1
   * @retval status 0:passed  1:failed
   */
-bool w25qxx_writeBlock(const uint8_t *buff, uint32_t block_addr, 
-							uint32_t OffsetInByte, uint32_t NumByteToWrite_up_to_BlockSize)
+bool w25qxx_dev_eraseBlock(w25qxx_dev_t *dev, uint32_t block_addr)
 {
-	uint32_t start_page;
-	int32_t  bytes_to_write;
-	uint32_t local_offset;
-
-	if ((NumByteToWrite_up_to_BlockSize > w25qxx.block_size) || 
-											(NumByteToWrite_up_to_BlockSize == 0))
-		NumByteToWrite_up_to_BlockSize = w25qxx.block_size;
-
-	if (OffsetInByte >= w25qxx.block_size){
+	if (!(dev->erase_sizes & W25QXX_ERASE_64K))
 		return false;
-	}
 
-	if ((OffsetInByte + NumByteToWrite_up_to_BlockSize) > w25qxx.block_size){
-		bytes_to_write = w25qxx.block_size - OffsetInByte;
-	}else{
-		bytes_to_write = NumByteToWrite_up_to_BlockSize;
-	}
-		
+	ERROR_CHECK(w25qxx_waitForWriteEnd(dev));
 
-	start_page = w25qxx_blockToPage(block_addr) + (OffsetInByte / w25qxx.block_size);
-	local_offset = OffsetInByte % w25qxx.page_size;
+	ERROR_CHECK(w25qxx_issueErase(dev, W25QXX_OP_ERASE_BLOCK, block_addr * W25QXX_BLOCK_SIZE(dev)));
 
-	do{
-		uint8_t res = w25qxx_writePage(buff, start_page, local_offset, bytes_to_write);
-		if (res != 0)
-			return false;
-		start_page++;
-		bytes_to_write -= w25qxx.page_size - local_offset;
-		buff += w25qxx.page_size - local_offset;
-		local_offset = 0;
-	}while(bytes_to_write > 0);
+	ERROR_CHECK(w25qxx_waitForOp(dev, W25QXX_OP_ERASE_BLOCK));
 
 	return true;
 }
@@ -509,242 +754,1542 @@ bool w25qxx_writeBlock(const uint8_t *buff, uint32_t block_addr,
 
 
 
-/** ############################################################################################
-  * @brief  read one Byte data from indicate address
-  * @param  *pBuffer: [out] receive read byte data
-  * @param  Bytes_Address: [in] address 0 ~ (W25Qxxx_CapacityInKiloByte-1)*1024
-  * @retval status 0:passed  1:failed
+
+/** 
+  * @brief Erase block 32KB
+  * @param  *dev: [in] device handle
+  * @param block32_addr: [in] 0 ~ W25Qxxx_BlockCount*2-1
+  * @retval status 1:passed  0:failed
   */
-bool w25qxx_readByte(uint8_t *buff, uint32_t bytes_addr)
+bool w25qxx_dev_eraseBlock32K(w25qxx_dev_t *dev, uint32_t block32_addr)
 {
-	ERROR_CHECK(w25qxx_waitForWriteEnd());
-
-	w25qxx.interface_enable(true);
-
-	if (w25qxx.type >= W25Q256){
-		w25qxx.interface_write_byte(CMD_Fast_Read_4_Byte_Addr);
-		w25qxx.interface_write_byte((bytes_addr & 0xFF000000) >> 24);
-	}else{
-		w25qxx.interface_write_byte(CMD_Fast_Read);
-	}
+	if (!(dev->erase_sizes & W25QXX_ERASE_32K))
+		return false;
 
-	w25qxx.interface_write_byte((bytes_addr & 0xFF0000) >> 16);
-	w25qxx.interface_write_byte((bytes_addr & 0xFF00) >> 8);
-	w25qxx.interface_write_byte(bytes_addr & 0xFF);
-	//TODO
-	w25qxx.interface_write_byte(CMD_DUMMY);
+	ERROR_CHECK(w25qxx_waitForWriteEnd(dev));
 
-	w25qxx.interface_read(buff, SIZE_1_BYTE);
+	ERROR_CHECK(w25qxx_issueErase(dev, W25QXX_OP_ERASE_BLOCK_32K, block32_addr * (W25QXX_BLOCK_SIZE(dev) / 2)));
 
-	w25qxx.interface_enable(false);
+	ERROR_CHECK(w25qxx_waitForOp(dev, W25QXX_OP_ERASE_BLOCK_32K));
 
 	return true;
 }
 
 
+/* Datasheet values, index is w25qxx_t */
+static const w25qxx_timing_t w25qxx_timing[] = {
+	/*            typical:                                      maximum:
+	              tPP us  tSE ms  tBE32 ms  tBE64 ms  tCE ms    tPP us  tSE ms  tBE32 ms  tBE64 ms  tCE ms */
+	[W25Q10]  = { 700,    30,     120,      150,      400,      3000,   400,    800,      1000,     1000   },
+	[W25Q20]  = { 700,    30,     120,      150,      600,      3000,   400,    800,      1000,     1500   },
+	[W25Q40]  = { 700,    30,     120,      150,      1000,     3000,   400,    800,      1000,     3000   },
+	[W25Q80]  = { 700,    30,     120,      150,      2500,     3000,   400,    800,      1000,     6000   },
+	[W25Q16]  = { 400,    45,     120,      150,      5000,     3000,   400,    1600,     2000,     25000  },
+	[W25Q32]  = { 400,    45,     120,      150,      10000,    3000,   400,    1600,     2000,     50000  },
+	[W25Q64]  = { 400,    45,     120,      150,      20000,    3000,   400,    1600,     2000,     100000 },
+	[W25Q128] = { 400,    45,     120,      150,      40000,    3000,   400,    1600,     2000,     200000 },
+	[W25Q256] = { 400,    50,     120,      150,      80000,    3000,   400,    1600,     2000,     400000 },
+	[W25Q512] = { 400,    50,     120,      150,      160000,   3000,   400,    1600,     2000,     800000 },
+};
+
 
 /** 
-  * @brief read a page from indicate page-address
-  * @param *pBuffer: [out] receive bytes
-  * @param Page_Address: [in] page address (0 - W25Qxxx_PageCount-1)
+  * @brief  typical and maximum program/erase times of a part
+  * @param  type: [in] W25Q10 ~ W25Q512, others fall back to W25Q32
+  */
+const w25qxx_timing_t* w25qxx_getTiming(w25qxx_t type)
+{
+	if ((type < W25Q10) || (type > W25Q512))
+		type = W25Q32;
+
+	return &w25qxx_timing[type];
+}
+
+
+static uint32_t w25qxx_typicalUs(w25qxx_dev_t *dev, w25qxx_op_type_t type)
+{
+	const w25qxx_timing_t *t = &dev->timing;
+
+	switch (type)
+	{
+		case W25QXX_OP_ERASE_SECTOR:	return t->t_se_ms * 1000;
+		case W25QXX_OP_ERASE_BLOCK:		return t->t_be64_ms * 1000;
+		case W25QXX_OP_ERASE_BLOCK_32K:	return t->t_be32_ms * 1000;
+		case W25QXX_OP_ERASE_CHIP:		return t->t_ce_ms * 1000;
+		case W25QXX_OP_WRITE:
+		default:						return t->t_pp_us;
+	}
+}
+
+
+/* Datasheet maximum plus margin, an operation still busy after it has failed */
+static uint32_t w25qxx_timeoutMs(w25qxx_dev_t *dev, w25qxx_op_type_t type)
+{
+	const w25qxx_timing_t *t = &dev->timing;
+	uint32_t max_ms;
+
+	switch (type)
+	{
+		case W25QXX_OP_ERASE_SECTOR:	max_ms = t->t_se_max_ms;		break;
+		case W25QXX_OP_ERASE_BLOCK:		max_ms = t->t_be64_max_ms;		break;
+		case W25QXX_OP_ERASE_BLOCK_32K:	max_ms = t->t_be32_max_ms;		break;
+		case W25QXX_OP_ERASE_CHIP:		max_ms = t->t_ce_max_ms;		break;
+		case W25QXX_OP_WRITE:
+		default:						max_ms = (t->t_pp_max_us + 999) / 1000;	break;
+	}
+
+	return max_ms + W25QXX_TIMEOUT_MARGIN_MS;
+}
+
+
+/*
+	Wait for a program/erase issued right before: sleep through most of its learned
+	time without touching the bus, then poll SR1 with a doubling interval. The time
+	it took moves the estimate, so sleeps follow the actual part and temperature.
+*/
+static bool w25qxx_waitForOp(w25qxx_dev_t *dev, w25qxx_op_type_t type)
+{
+	uint32_t est = dev->busy_est_us[type];
+	uint32_t timeout = w25qxx_timeoutMs(dev, type);
+	uint32_t step = (est / 32) ? (est / 32) : 1;
+	uint32_t last = 0;
+	uint32_t slept;
+	uint32_t measured;
+	int32_t  start = dev->get_time();
+#ifdef W25QXX_STATS
+	uint32_t start_us = w25qxx_timeUs(dev);
+#endif
+
+	slept = w25qxx_sleepUs(dev, est - est / 8);
+
+	while (w25qxx_isBusy(dev)){
+		if ((uint32_t)(dev->get_time() - start) >= timeout){
+			W25QXX_STAT(dev->stats.timeouts++);
+			return false;
+		}
+
+		last = w25qxx_sleepUs(dev, step);
+		slept += last;
+		if (step < est / 16)
+			step *= 2;
+	}
+
+	W25QXX_STAT(w25qxx_statLatency(dev, w25qxx_opLatency(type), start_us));
+
+	// without a way to sleep there is nothing to learn from
+	if (slept == 0)
+		return true;
+
+	// done inside the last interval, or already before the first poll
+	measured = last ? (slept - last / 2) : (slept - slept / 8);
+	est = est - est / 8 + measured / 8;
+
+	if (est > (timeout - W25QXX_TIMEOUT_MARGIN_MS) * 1000)
+		est = (timeout - W25QXX_TIMEOUT_MARGIN_MS) * 1000;
+	dev->busy_est_us[type] = est ? est : 1;
+
+	return true;
+}
+
+
+/** 
+  * @brief  pick the cheapest erase that starts at addr and stays inside the range,
+  *         a larger block is used only if it is not slower than its smaller parts
+  * @param  *size: [out] bytes covered by the chosen erase
+  * @retval erase type
+  */
+static w25qxx_op_type_t w25qxx_planErase(w25qxx_dev_t *dev, uint32_t addr, uint32_t remain, uint32_t *size)
+{
+	const w25qxx_timing_t *t = &dev->timing;
+	uint32_t half_block = W25QXX_BLOCK_SIZE(dev) / 2;
+	uint32_t sectors_per_half = half_block / W25QXX_SECTOR_SIZE(dev);
+
+	bool has_32k = (dev->erase_sizes & W25QXX_ERASE_32K) != 0;
+
+	if ((dev->erase_sizes & W25QXX_ERASE_64K) && ((addr % W25QXX_BLOCK_SIZE(dev)) == 0) && (remain >= W25QXX_BLOCK_SIZE(dev)) &&
+		(!has_32k || (t->t_be64_ms <= 2 * t->t_be32_ms)) && (t->t_be64_ms <= 2 * sectors_per_half * t->t_se_ms)){
+		*size = W25QXX_BLOCK_SIZE(dev);
+		return W25QXX_OP_ERASE_BLOCK;
+	}
+
+	if (has_32k && ((addr % half_block) == 0) && (remain >= half_block) &&
+		(t->t_be32_ms <= sectors_per_half * t->t_se_ms)){
+		*size = half_block;
+		return W25QXX_OP_ERASE_BLOCK_32K;
+	}
+
+	*size = W25QXX_SECTOR_SIZE(dev);
+	return W25QXX_OP_ERASE_SECTOR;
+}
+
+
+/** 
+  * @brief  erase a sector aligned range with the fewest, fastest commands:
+  *         64KB for aligned middles, 32KB and 4KB for the edges, chip erase
+  *         when the range is the whole device
+  * @param  *dev: [in] device handle
+  * @param  addr: [in] start byte address, multiple of sector_size
+  * @param  len: [in] byte number, multiple of sector_size
+  * @retval status 1:passed  0:failed
+  */
+bool w25qxx_dev_erase(w25qxx_dev_t *dev, uint32_t addr, uint32_t len)
+{
+	uint32_t capacity = dev->capacity_kb * 1024;
+	uint32_t size;
+	w25qxx_op_type_t type;
+
+	if ((len == 0) || (addr % W25QXX_SECTOR_SIZE(dev)) || (len % W25QXX_SECTOR_SIZE(dev)) ||
+		(addr >= capacity) || (len > (capacity - addr)))
+		return false;
+
+	/*
+		The typical 64KB erase times of the datasheets add up to about tCE,
+		each of those erases costs a WREN, the command and its busy polling
+		on top, so one chip erase is the quicker way for the whole device.
+	*/
+	if ((addr == 0) && (len == capacity))
+		return w25qxx_dev_eraseChip(dev);
+
+	ERROR_CHECK(w25qxx_waitForWriteEnd(dev));
+
+	while (len){
+		type = w25qxx_planErase(dev, addr, len, &size);
+
+		ERROR_CHECK(w25qxx_issueErase(dev, type, addr));
+		ERROR_CHECK(w25qxx_waitForOp(dev, type));
+
+		addr += size;
+		len -= size;
+	}
+
+	return true;
+}
+
+
+
+
+/** 
+  * @brief  Page Program (02h/12h) or Quad Page Program (32h/34h), no busy handling
+  * @param  addr: [in] byte address, the chip wraps at the page end
+  * @param  *buff: [in] data
+  * @param  len: [in] byte number
+  * @retval status 1:passed  0:failed
+  */
+static bool w25qxx_programPage(w25qxx_dev_t *dev, uint32_t addr, const uint8_t *buff, uint32_t len)
+{
+	w25qxx_transfer_t xfer;
+	uint8_t cmd;
+
+	if (dev->quad_program)
+		cmd = w25qxx_use4ByteOpcodes(dev) ? CMD_Quad_Page_Program_4_Byte_Addr : CMD_Quad_Page_Program;
+	else
+		cmd = w25qxx_use4ByteOpcodes(dev) ? CMD_Page_Program_4_Byte_Addr : CMD_Page_Program;
+
+	w25qxx_buildHeader(dev, &xfer, cmd, addr, w25qxx_addrLen(dev), 0);
+
+	xfer.data_lines = dev->quad_program ? 4 : 1;
+	xfer.tx = buff;
+	xfer.len = len;
+
+	ERROR_CHECK(w25qxx_transfer(dev, &xfer));
+
+	w25qxx_notify(dev, addr, len, false);
+
+	return true;
+}
+
+
+
+/** 
+  * @brief  compare a flash range with a buffer, read back W25QXX_STREAM_CHUNK bytes at a time
+  * @param  *dev: [in] device handle
+  * @param  addr: [in] start byte address
+  * @param  *buff: [in] expected bytes
+  * @param  len: [in] byte number
+  * @retval status 1:equal  0:different or failed
+  */
+bool w25qxx_dev_verify(w25qxx_dev_t *dev, uint32_t addr, const uint8_t *buff, uint32_t len)
+{
+	uint8_t  back[W25QXX_STREAM_CHUNK];
+	uint32_t chunk;
+
+	while (len){
+		chunk = (len < sizeof(back)) ? len : sizeof(back);
+
+		ERROR_CHECK(w25qxx_dev_read(dev, addr, back, chunk));
+
+		if (memcmp(back, buff, chunk) != 0){
+			W25QXX_STAT(dev->stats.verify_errors++);
+			return false;
+		}
+
+		addr += chunk;
+		buff += chunk;
+		len -= chunk;
+	}
+
+	return true;
+}
+
+
+/* Read back a finished program in verify mode */
+static bool w25qxx_verifyWrite(w25qxx_dev_t *dev, uint32_t addr, const uint8_t *buff, uint32_t len)
+{
+	if (!dev->verify)
+		return true;
+
+	return w25qxx_dev_verify(dev, addr, buff, len);
+}
+
+
+
+/** 
+  * @brief write one Byte to w25qxxx flash
+  * @param  *dev: [in] device handle
+  * @param pBuffer: [in] input data
+  * @param WriteAddr_inBytes: [in] indicate address
+  * @retval status 0:passed  1:failed
+  */
+bool w25qxx_dev_writeByte(w25qxx_dev_t *dev, const uint8_t* buff, uint32_t WriteAddr_inBytes)
+{
+	ERROR_CHECK(w25qxx_waitForWriteEnd(dev));
+
+	w25qxx_enableWrite(dev);
+
+	ERROR_CHECK(w25qxx_programPage(dev, WriteAddr_inBytes, buff, SIZE_1_BYTE));
+
+	ERROR_CHECK(w25qxx_waitForOp(dev, W25QXX_OP_WRITE));
+
+	ERROR_CHECK(w25qxx_verifyWrite(dev, WriteAddr_inBytes, buff, SIZE_1_BYTE));
+
+	return true;
+}
+
+
+
+/** 
+  * @brief write Byte data to indicate page address
+  * @param  *dev: [in] device handle
+  * @param *pBuffer: [in] Byte data array
+  * @param Page_Address: [in] page address (0 - W25Qxxx_PageCount-1)
+  * @param OffsetInByte: [in] offset address
+  * @retval status 0:passed  1:failed
+  */
+bool w25qxx_dev_writePage(w25qxx_dev_t *dev, const uint8_t *buff, uint32_t page_addr, 
+						uint32_t OffsetInByte, uint32_t NumByteToWrite_up_to_PageSize)
+{
+	if (((NumByteToWrite_up_to_PageSize + OffsetInByte) > W25QXX_PAGE_SIZE(dev)) || (NumByteToWrite_up_to_PageSize == 0))
+		NumByteToWrite_up_to_PageSize = W25QXX_PAGE_SIZE(dev) - OffsetInByte;
+
+	if (dev->smart_scratch)
+		return w25qxx_dev_writeSmart(dev, page_addr * W25QXX_PAGE_SIZE(dev) + OffsetInByte, buff, NumByteToWrite_up_to_PageSize);
+
+	ERROR_CHECK(w25qxx_waitForWriteEnd(dev));
+
+	w25qxx_enableWrite(dev);
+
+	page_addr = (page_addr * W25QXX_PAGE_SIZE(dev)) + OffsetInByte;
+
+	ERROR_CHECK(w25qxx_programPage(dev, page_addr, buff, NumByteToWrite_up_to_PageSize));
+
+	ERROR_CHECK(w25qxx_waitForOp(dev, W25QXX_OP_WRITE));
+
+	ERROR_CHECK(w25qxx_verifyWrite(dev, page_addr, buff, NumByteToWrite_up_to_PageSize));
+
+	return true;
+}
+
+/** 
+  * @brief write Byte data to indicate sector address  4KB Max based on page Write
+  * @param  *dev: [in] device handle
+  * @param *pBuffer: [in] Byte data array
+  * @param Page_Address: [in] page address (0 - W25Qxxx_SectorCount-1)
+  * @param OffsetInByte: [in] offset byte number
+  * @param NumByteToWrite_up_to_SectorSize: [in] Byte data number
+  * @retval status 0:passed  1:failed
+  */
+bool w25qxx_dev_writeSector(w25qxx_dev_t *dev, const uint8_t *buff, uint32_t sector_addr, 
+						uint32_t OffsetInByte, uint32_t NumByteToWrite_up_to_SectorSize)
+{
+	uint32_t start_page;
+	int32_t  remain_bytes;
+	uint32_t local_offset;
+
+	if ((NumByteToWrite_up_to_SectorSize > W25QXX_SECTOR_SIZE(dev)) || 
+											(NumByteToWrite_up_to_SectorSize == 0))
+		NumByteToWrite_up_to_SectorSize = W25QXX_SECTOR_SIZE(dev);
+
+	if (OffsetInByte >= W25QXX_SECTOR_SIZE(dev)){
+		return false;
+	}
+
+	if ((OffsetInByte + NumByteToWrite_up_to_SectorSize) > W25QXX_SECTOR_SIZE(dev)){
+		remain_bytes = W25QXX_SECTOR_SIZE(dev) - OffsetInByte;
+	}else{
+		remain_bytes = NumByteToWrite_up_to_SectorSize;
+	}
+
+	if (dev->smart_scratch)
+		return w25qxx_dev_writeSmart(dev, sector_addr * W25QXX_SECTOR_SIZE(dev) + OffsetInByte, buff, remain_bytes);
+		
+
+	start_page = w25qxx_sectorToPage(dev, sector_addr) + (OffsetInByte / W25QXX_PAGE_SIZE(dev));
+	local_offset = OffsetInByte % W25QXX_PAGE_SIZE(dev);
+	
+	do{
+		uint8_t res = w25qxx_dev_writePage(dev, buff, start_page, local_offset, remain_bytes);
+		if (!res)
+			return false;
+		start_page++;
+		remain_bytes -= W25QXX_PAGE_SIZE(dev) - local_offset;
+		buff += W25QXX_PAGE_SIZE(dev) - local_offset;
+		local_offset = 0;
+	}while(remain_bytes > 0);
+
+	return true;
+}
+
+
+/* Program a range page by page */
+static bool w25qxx_programRange(w25qxx_dev_t *dev, uint32_t addr, const uint8_t *buff, uint32_t len)
+{
+	uint32_t chunk;
+
+	ERROR_CHECK(w25qxx_waitForWriteEnd(dev));
+
+	while (len){
+		chunk = W25QXX_PAGE_SIZE(dev) - (addr % W25QXX_PAGE_SIZE(dev));
+		if (chunk > len)
+			chunk = len;
+
+		w25qxx_enableWrite(dev);
+		ERROR_CHECK(w25qxx_programPage(dev, addr, buff, chunk));
+		ERROR_CHECK(w25qxx_waitForOp(dev, W25QXX_OP_WRITE));
+		ERROR_CHECK(w25qxx_verifyWrite(dev, addr, buff, chunk));
+
+		addr += chunk;
+		buff += chunk;
+		len -= chunk;
+	}
+
+	return true;
+}
+
+
+/* Merge the new bytes into the sector image, erase and program its non blank pages */
+static bool w25qxx_rewriteSector(w25qxx_dev_t *dev, uint32_t addr, const uint8_t *buff, uint32_t len)
+{
+	uint8_t *scratch = dev->smart_scratch;
+	uint32_t base = addr - (addr % W25QXX_SECTOR_SIZE(dev));
+	uint32_t offset = addr - base;
+	uint32_t tail = offset + len;
+
+	// the written span is already in scratch, fetch the rest of the sector
+	if (offset)
+		ERROR_CHECK(w25qxx_dev_read(dev, base, scratch, offset));
+	if (tail < W25QXX_SECTOR_SIZE(dev))
+		ERROR_CHECK(w25qxx_dev_read(dev, base + tail, scratch + tail, W25QXX_SECTOR_SIZE(dev) - tail));
+
+	memcpy(scratch + offset, buff, len);
+
+	ERROR_CHECK(w25qxx_dev_eraseSector(dev, base / W25QXX_SECTOR_SIZE(dev)));
+	dev->smart_stats.sectors_erased++;
+
+	for (uint32_t off = 0; off < W25QXX_SECTOR_SIZE(dev); off += W25QXX_PAGE_SIZE(dev)){
+		uint32_t i;
+
+		for (i = 0; (i < W25QXX_PAGE_SIZE(dev)) && (scratch[off + i] == 0xFF); ++i)
+			;
+		if (i == W25QXX_PAGE_SIZE(dev))
+			continue;
+
+		ERROR_CHECK(w25qxx_programRange(dev, base + off, scratch + off, W25QXX_PAGE_SIZE(dev)));
+		dev->smart_stats.pages_rewritten++;
+	}
+
+	return true;
+}
+
+
+/** 
+  * @brief  write by comparing with the flash contents first: unchanged pages are
+  *         skipped, pages needing only 1->0 transitions are programmed in place and
+  *         a sector is erased only when some page needs a 0->1 transition
+  * @param  *dev: [in] device handle, smart write scratch set
+  * @param  addr: [in] start byte address
+  * @param  *buff: [in] data
+  * @param  len: [in] byte number, clamped to the end of the chip
+  * @retval status 1:passed  0:failed
+  */
+bool w25qxx_dev_writeSmart(w25qxx_dev_t *dev, uint32_t addr, const uint8_t *buff, uint32_t len)
+{
+	uint32_t capacity = dev->capacity_kb * 1024;
+	uint8_t *scratch = dev->smart_scratch;
+	uint32_t offset;
+	uint32_t chunk;
+
+	if ((scratch == NULL) || (len == 0) || (addr >= capacity))
+		return false;
+
+	if (len > (capacity - addr))
+		len = capacity - addr;
+
+	while (len){
+		bool need_erase = false;
+
+		offset = addr % W25QXX_SECTOR_SIZE(dev);
+		chunk = W25QXX_SECTOR_SIZE(dev) - offset;
+		if (chunk > len)
+			chunk = len;
+
+		ERROR_CHECK(w25qxx_dev_read(dev, addr, scratch + offset, chunk));
+
+		for (uint32_t i = 0; i < chunk; ++i){
+			if ((scratch[offset + i] & buff[i]) != buff[i]){
+				need_erase = true;
+				break;
+			}
+		}
+
+		if (need_erase){
+			ERROR_CHECK(w25qxx_rewriteSector(dev, addr, buff, chunk));
+		}else{
+			for (uint32_t pos = offset; pos < offset + chunk; ){
+				uint32_t end = pos - (pos % W25QXX_PAGE_SIZE(dev)) + W25QXX_PAGE_SIZE(dev);
+				uint32_t first, last;
+
+				if (end > offset + chunk)
+					end = offset + chunk;
+
+				for (first = pos; (first < end) && (scratch[first] == buff[first - offset]); ++first)
+					;
+
+				if (first == end){
+					dev->smart_stats.pages_unchanged++;
+				}else{
+					// only the differing bytes are clocked out
+					for (last = end - 1; scratch[last] == buff[last - offset]; --last)
+						;
+					ERROR_CHECK(w25qxx_programRange(dev, addr - offset + first, buff + (first - offset), last - first + 1));
+					dev->smart_stats.pages_programmed++;
+				}
+
+				pos = end;
+			}
+		}
+
+		addr += chunk;
+		buff += chunk;
+		len -= chunk;
+	}
+
+	return true;
+}
+
+
+/** 
+  * @brief write Byte data to indicate block address  64KB Max base on page Write
+  * @param  *dev: [in] device handle
+  * @param *pBuffer: [in] Byte data array
+  * @param Block_Address: [in] page address (0 - W25Qxxx_BlockCount-1)
+  * @param OffsetInByte: [in] offset byte number
+  * @param NumByteToWrite_up_to_BlockSize: [in] Byte data number
+  * @retval status 0:passed  1:failed
+  */
+bool w25qxx_dev_writeBlock(w25qxx_dev_t *dev, const uint8_t *buff, uint32_t block_addr, 
+							uint32_t OffsetInByte, uint32_t NumByteToWrite_up_to_BlockSize)
+{
+	uint32_t start_page;
+	int32_t  bytes_to_write;
+	uint32_t local_offset;
+
+	if ((NumByteToWrite_up_to_BlockSize > W25QXX_BLOCK_SIZE(dev)) || 
+											(NumByteToWrite_up_to_BlockSize == 0))
+		NumByteToWrite_up_to_BlockSize = W25QXX_BLOCK_SIZE(dev);
+
+	if (OffsetInByte >= W25QXX_BLOCK_SIZE(dev)){
+		return false;
+	}
+
+	if ((OffsetInByte + NumByteToWrite_up_to_BlockSize) > W25QXX_BLOCK_SIZE(dev)){
+		bytes_to_write = W25QXX_BLOCK_SIZE(dev) - OffsetInByte;
+	}else{
+		bytes_to_write = NumByteToWrite_up_to_BlockSize;
+	}
+
+	if (dev->smart_scratch)
+		return w25qxx_dev_writeSmart(dev, block_addr * W25QXX_BLOCK_SIZE(dev) + OffsetInByte, buff, bytes_to_write);
+
+
+	start_page = w25qxx_blockToPage(dev, block_addr) + (OffsetInByte / W25QXX_PAGE_SIZE(dev));
+	local_offset = OffsetInByte % W25QXX_PAGE_SIZE(dev);
+
+	do{
+		uint8_t res = w25qxx_dev_writePage(dev, buff, start_page, local_offset, bytes_to_write);
+		if (!res)
+			return false;
+		start_page++;
+		bytes_to_write -= W25QXX_PAGE_SIZE(dev) - local_offset;
+		buff += W25QXX_PAGE_SIZE(dev) - local_offset;
+		local_offset = 0;
+	}while(bytes_to_write > 0);
+
+	return true;
+}
+
+
+/** 
+  * @brief  write any range, split at page boundaries only
+  * @param  *dev: [in] device handle
+  * @param  addr: [in] start byte address
+  * @param  *buff: [in] data
+  * @param  len: [in] byte number, clamped to the end of the chip
+  * @retval status 1:passed  0:failed
+  */
+bool w25qxx_dev_write(w25qxx_dev_t *dev, uint32_t addr, const uint8_t *buff, uint32_t len)
+{
+	uint32_t capacity = dev->capacity_kb * 1024;
+
+	if ((len == 0) || (addr >= capacity))
+		return false;
+
+	if (len > (capacity - addr))
+		len = capacity - addr;
+
+	if (dev->smart_scratch)
+		return w25qxx_dev_writeSmart(dev, addr, buff, len);
+
+	return w25qxx_programRange(dev, addr, buff, len);
+}
+
+
+/** 
+  * @brief  start a stream writer at addr
+  * @param  *dev: [in] device handle
+  * @param  *w: [out] writer
+  * @param  addr: [in] byte address of the first append
+  * @retval status 1:passed  0:failed
+  */
+bool w25qxx_dev_writerOpen(w25qxx_dev_t *dev, w25qxx_writer_t *w, uint32_t addr)
+{
+	if (addr >= dev->capacity_kb * 1024)
+		return false;
+
+	w->dev = dev;
+	w->addr = addr;
+	w->fill = 0;
+
+	return true;
+}
+
+
+/** 
+  * @brief  append to the stream, whole pages are programmed as soon as they are complete
+  * @param  *w: [in] writer
+  * @param  *buff: [in] data
+  * @param  len: [in] byte number, failing without writing when it passes the end of the chip
+  * @retval status 1:passed  0:failed
+  */
+bool w25qxx_dev_writerAppend(w25qxx_writer_t *w, const uint8_t *buff, uint32_t len)
+{
+	w25qxx_dev_t *dev = w->dev;
+	uint32_t pos = w->addr + w->fill;
+	uint32_t room;
+
+	if (len > (dev->capacity_kb * 1024 - pos))
+		return false;
+
+	while (len){
+		room = W25QXX_PAGE_SIZE(dev) - (pos % W25QXX_PAGE_SIZE(dev));
+
+		if ((w->fill == 0) && (len >= room)){
+			// nothing buffered: program the rest of the page and whole pages straight from buff
+			room += ((len - room) / W25QXX_PAGE_SIZE(dev)) * W25QXX_PAGE_SIZE(dev);
+			ERROR_CHECK(w25qxx_dev_write(dev, pos, buff, room));
+			w->addr += room;
+		}else{
+			if (room > len)
+				room = len;
+
+			memcpy(w->buf + w->fill, buff, room);
+			w->fill += room;
+
+			if (((w->addr + w->fill) % W25QXX_PAGE_SIZE(dev)) == 0){
+				ERROR_CHECK(w25qxx_dev_write(dev, w->addr, w->buf, w->fill));
+				w->addr += w->fill;
+				w->fill = 0;
+			}
+		}
+
+		pos += room;
+		buff += room;
+		len -= room;
+	}
+
+	return true;
+}
+
+
+/** 
+  * @brief  program the buffered partial page, the writer can be reopened at w->addr
+  * @param  *w: [in] writer
+  * @retval status 1:passed  0:failed
+  */
+bool w25qxx_dev_writerClose(w25qxx_writer_t *w)
+{
+	if (w->fill){
+		ERROR_CHECK(w25qxx_dev_write(w->dev, w->addr, w->buf, w->fill));
+		w->addr += w->fill;
+		w->fill = 0;
+	}
+
+	return true;
+}
+
+
+
+
+/** 
+  * @brief  build the read transaction for the selected read mode
+  *
+  *   mode          opcode     addr  dummy clocks      data
+  *   FAST          0Bh/0Ch    x1    8                 x1
+  *   DUAL_OUTPUT   3Bh/3Ch    x1    8                 x2
+  *   QUAD_OUTPUT   6Bh/6Ch    x1    8                 x4
+  *   QUAD_IO       EBh/ECh    x4    M7-0 + 4          x4
+  *
+  *   Opcodes and dummy bytes with 3 address bytes come from the capabilities
+  *   (SFDP or the W25Qxx defaults), the 4-byte address opcodes are fixed.
+  *   In continuous read mode the chip already holds the EBh/ECh opcode, the
+  *   header starts with the address and M7-0 = Ax keeps the mode.
+  */
+static w25qxx_transfer_t* w25qxx_buildRead(w25qxx_dev_t *dev, w25qxx_transfer_t *xfer, uint32_t addr, uint8_t *buff, uint32_t len)
+{
+	static const uint8_t cmd_4byte[4] = { CMD_Fast_Read_4_Byte_Addr, CMD_Fast_Read_Dual_Output_4_Byte_Addr,
+										  CMD_Fast_Read_Quad_Output_4_Byte_Addr, CMD_Fast_Read_Quad_IO_4_Byte_Addr };
+	static const uint8_t data_lines[4] = { 1, 2, 4, 4 };
+	bool continuous = (dev->read_mode == W25QXX_READ_QUAD_IO_CONTINUOUS);
+	uint8_t mode = continuous ? W25QXX_READ_QUAD_IO : dev->read_mode;
+
+	w25qxx_buildHeader(dev, xfer, w25qxx_use4ByteOpcodes(dev) ? cmd_4byte[mode] : dev->read_cmd[mode],
+						addr, w25qxx_addrLen(dev), dev->read_dummy[mode]);
+	xfer->data_lines = data_lines[mode];
+
+	if (mode == W25QXX_READ_QUAD_IO){
+		// M7-0 first, then the dummy clocks, all on four lines
+		xfer->header[w25qxx_addrLen(dev) + 1] = continuous ? W25QXX_CONTINUOUS_READ_MODE : CMD_DUMMY;
+		xfer->addr_lines = 4;
+
+		if (dev->continuous_read){
+			// drop the opcode, the chip is still in EBh/ECh
+			for (uint8_t i = 1; i < xfer->header_len; ++i)
+				xfer->header[i - 1] = xfer->header[i];
+			xfer->header_len--;
+			xfer->cmd_len = 0;
+		}
+	}
+
+	xfer->rx = buff;
+	xfer->len = len;
+
+	return xfer;
+}
+
+
+
+static void w25qxx_delayUs(w25qxx_dev_t *dev, uint32_t us)
+{
+	if (dev->delay_us)
+		dev->delay_us(us);
+	else
+		dev->delay(1);
+}
+
+
+/*
+	Make [addr, addr + len) readable while a non-blocking erase/program runs: suspend it if the
+	policy allows and the read stays outside the operation's range, else wait
+*/
+static bool w25qxx_suspendForRead(w25qxx_dev_t *dev, uint32_t addr, uint32_t len, bool *suspended)
+{
+	w25qxx_op_t *op = dev->pending;
+
+	*suspended = false;
+
+	if ((op == NULL) || !w25qxx_isBusy(dev))
+		return true;
+
+	// chip erase cannot be suspended, suspended target cells read back undefined
+	if ((op->type == W25QXX_OP_ERASE_CHIP) || (op->suspends >= dev->suspend_limit) ||
+		((addr < op->range_end) && ((addr + len) > op->range_start)))
+		return w25qxx_waitForWriteEnd(dev);
+
+	// tRS: the instruction must run a while between two suspends
+	if ((uint32_t)(dev->get_time() - dev->resume_time) < 2)
+		w25qxx_delayUs(dev, W25QXX_T_RS_US);
+
+	dev->suspend_time = dev->get_time();
+	ERROR_CHECK(w25qxx_command(dev, CMD_Erase_Program_Suspend, 0, 0, 0, NULL, NULL, 0));
+	w25qxx_delayUs(dev, W25QXX_T_SUS_US);
+	ERROR_CHECK(w25qxx_waitForWriteEnd(dev));
+
+	// SUS stays clear if the instruction finished before the suspend
+	if (w25qxx_dev_readRegX(dev, 2) & SR2_S15_SUS){
+		op->suspends++;
+		*suspended = true;
+	}
+
+	return true;
+}
+
+
+static bool w25qxx_resume(w25qxx_dev_t *dev)
+{
+	ERROR_CHECK(w25qxx_command(dev, CMD_Erase_Program_Resume, 0, 0, 0, NULL, NULL, 0));
+
+	dev->resume_time = dev->get_time();
+
+	// time spent suspended does not count against the operation timeout
+	dev->pending->start_time += dev->resume_time - dev->suspend_time;
+
+	return true;
+}
+
+
+/* One read command with the chip readable and the Quad I/O wrap length set, wrap is ignored by other read modes */
+static bool w25qxx_readBurst(w25qxx_dev_t *dev, uint32_t addr, uint8_t *buff, uint32_t len, uint8_t wrap)
+{
+	w25qxx_transfer_t xfer;
+	bool suspended;
+	bool res;
+#ifdef W25QXX_STATS
+	uint32_t start_us = w25qxx_timeUs(dev);
+#endif
+
+	// a wrapped burst reads the aligned window of wrap bytes around addr
+	if (wrap)
+		ERROR_CHECK(w25qxx_suspendForRead(dev, addr - (addr % wrap), wrap, &suspended));
+	else
+		ERROR_CHECK(w25qxx_suspendForRead(dev, addr, len, &suspended));
+
+	// 77h is accepted while an erase/program is suspended
+	res = (dev->read_mode < W25QXX_READ_QUAD_IO) || w25qxx_dev_setBurstWrap(dev, wrap);
+	if (res)
+		res = w25qxx_transfer(dev, w25qxx_buildRead(dev, &xfer, addr, buff, len));
+	if (res)
+		dev->continuous_read = (dev->read_mode == W25QXX_READ_QUAD_IO_CONTINUOUS);
+
+	if (suspended)
+		ERROR_CHECK(w25qxx_resume(dev));
+
+	if (res)
+		W25QXX_STAT(w25qxx_statLatency(dev, W25QXX_LAT_READ, start_us));
+
+	return res;
+}
+
+
+/** ############################################################################################
+  * @brief  linear read with a single Fast Read command, streams across page, sector
+  *         and block boundaries
+  * @param  *dev: [in] device handle
+  * @param  addr: [in] start address 0 ~ (W25Qxxx_CapacityInKiloByte*1024)-1
+  * @param  *buff: [out] receive bytes
+  * @param  len: [in] byte number, clamped to the end of the chip
+  * @retval status 1:passed  0:failed
+  */
+bool w25qxx_dev_read(w25qxx_dev_t *dev, uint32_t addr, uint8_t *buff, uint32_t len)
+{
+	uint32_t capacity = dev->capacity_kb * 1024;
+
+	if ((len == 0) || (addr >= capacity))
+		return false;
+
+	if (len > (capacity - addr))
+		len = capacity - addr;
+
+	return w25qxx_readBurst(dev, addr, buff, len, 0);
+}
+
+
+
+/** 
+  * @brief  fill a cache line critical word first: one Quad I/O read with Set Burst with
+  *         Wrap when a Quad I/O read mode is selected, otherwise two linear reads
+  * @param  *dev: [in] device handle
+  * @param  addr: [in] first byte returned, the line is the len byte aligned block holding it
+  * @param  *buff: [out] len bytes, addr first and wrapping at the line end
+  * @param  len: [in] line length 8, 16, 32 or 64
+  * @retval status 1:passed  0:failed
+  */
+bool w25qxx_dev_readWrap(w25qxx_dev_t *dev, uint32_t addr, uint8_t *buff, uint8_t len)
+{
+	uint32_t head;
+
+	if (((len != 8) && (len != 16) && (len != 32) && (len != 64)) || (addr >= dev->capacity_kb * 1024))
+		return false;
+
+	if (dev->read_mode >= W25QXX_READ_QUAD_IO)
+		return w25qxx_readBurst(dev, addr, buff, len, len);
+
+	head = len - (addr & (len - 1));
+	ERROR_CHECK(w25qxx_dev_read(dev, addr, buff, head));
+	if (head == len)
+		return true;
+
+	return w25qxx_dev_read(dev, addr & ~(uint32_t)(len - 1), buff + head, len - head);
+}
+
+
+
+/** 
+  * @brief  read one Byte data from indicate address
+  * @param  *dev: [in] device handle
+  * @param  *pBuffer: [out] receive read byte data
+  * @param  Bytes_Address: [in] address 0 ~ (W25Qxxx_CapacityInKiloByte-1)*1024
+  * @retval status 0:passed  1:failed
+  */
+bool w25qxx_dev_readByte(w25qxx_dev_t *dev, uint8_t *buff, uint32_t bytes_addr)
+{
+	if (bytes_addr >= (dev->capacity_kb * 1024))
+		return false;
+
+	// same readiness handling as every other read: suspend or wait only for a pending operation
+	return w25qxx_readBurst(dev, bytes_addr, buff, SIZE_1_BYTE, 0);
+}
+
+
+
+/** 
+  * @brief read a page from indicate page-address
+  * @param  *dev: [in] device handle
+  * @param *pBuffer: [out] receive bytes
+  * @param Page_Address: [in] page address (0 - W25Qxxx_PageCount-1)
   * @param OffsetInByte: [in] offset byte number   [0 --- offset ------ 255]
   * @param NumByteToRead_up_to_PageSize: [in] read byte number  max 256Bytes
   * @retval status 0:passed   1:failed
   */
-bool w25qxx_readPage(uint8_t *buff, uint32_t page_addr, 
+bool w25qxx_dev_readPage(w25qxx_dev_t *dev, uint8_t *buff, uint32_t page_addr, 
 						uint32_t OffsetInByte, uint32_t NumByteToRead_up_to_PageSize)
 {
-	if ((NumByteToRead_up_to_PageSize > w25qxx.page_size) || (NumByteToRead_up_to_PageSize == 0))
-		NumByteToRead_up_to_PageSize = w25qxx.page_size;
-	
-	if ((OffsetInByte + NumByteToRead_up_to_PageSize) > w25qxx.page_size)
-		NumByteToRead_up_to_PageSize = w25qxx.page_size - OffsetInByte;
-
-	page_addr = page_addr * w25qxx.page_size + OffsetInByte;
-
-	w25qxx.interface_enable(true);
+	if ((NumByteToRead_up_to_PageSize > W25QXX_PAGE_SIZE(dev)) || (NumByteToRead_up_to_PageSize == 0))
+		NumByteToRead_up_to_PageSize = W25QXX_PAGE_SIZE(dev);
 
-	if (w25qxx.type >= W25Q256){
-		w25qxx.interface_write_byte(CMD_Fast_Read_4_Byte_Addr);
-		w25qxx.interface_write_byte((page_addr & 0xFF000000) >> 24);
-	}else{
-		w25qxx.interface_write_byte(CMD_Fast_Read);
+	if (OffsetInByte >= W25QXX_PAGE_SIZE(dev)){
+		return false;
 	}
 
-	w25qxx.interface_write_byte((page_addr & 0xFF0000) >> 16);
-	w25qxx.interface_write_byte((page_addr & 0xFF00) >> 8);
-	w25qxx.interface_write_byte(page_addr & 0xFF);
-	w25qxx.interface_write_byte(CMD_DUMMY);
-	//HAL_SPI_Receive(&hspi_flash, pBuffer, NumByteToRead_up_to_PageSize, SPI_FLASH_TIMEOUT);
-
-	w25qxx.interface_read(buff, NumByteToRead_up_to_PageSize);
-
-	w25qxx.interface_enable(false);
+	if ((OffsetInByte + NumByteToRead_up_to_PageSize) > W25QXX_PAGE_SIZE(dev))
+		NumByteToRead_up_to_PageSize = W25QXX_PAGE_SIZE(dev) - OffsetInByte;
 
-	return true;
+	return w25qxx_dev_read(dev, page_addr * W25QXX_PAGE_SIZE(dev) + OffsetInByte, buff, NumByteToRead_up_to_PageSize);
 }
 
 
 
 /** ############################################################################################
   * @brief read a sector from indicate sector-address
+  * @param  *dev: [in] device handle
   * @param *pBuffer: [out] receive bytes
   * @param Sector_Address: [in] sector address (0 - W25Qxxx_SectorCount-1)
   * @param OffsetInByte: [in] offset byte number
   * @param NumByteToRead_up_to_SectorSize: [in] read byte number  max 4096Bytes
   * @retval status 0:passed   1:failed
   */
-bool w25qxx_readSector(uint8_t *buff, uint32_t sector_addr, uint32_t OffsetInByte, uint32_t NumByteToRead_up_to_SectorSize)
+bool w25qxx_dev_readSector(w25qxx_dev_t *dev, uint8_t *buff, uint32_t sector_addr, uint32_t OffsetInByte, uint32_t NumByteToRead_up_to_SectorSize)
 {
-	uint32_t start_page;
-	int32_t  remain_bytes;
-	uint32_t local_offset;
+	uint32_t remain_bytes;
 
-	if ((NumByteToRead_up_to_SectorSize > w25qxx.sector_size) || 
+	if ((NumByteToRead_up_to_SectorSize > W25QXX_SECTOR_SIZE(dev)) || 
 											(NumByteToRead_up_to_SectorSize == 0))
-		NumByteToRead_up_to_SectorSize = w25qxx.sector_size;
+		NumByteToRead_up_to_SectorSize = W25QXX_SECTOR_SIZE(dev);
 	
-	if (OffsetInByte >= w25qxx.sector_size){
+	if (OffsetInByte >= W25QXX_SECTOR_SIZE(dev)){
 		return false;
 	}
 
-	if ((OffsetInByte + NumByteToRead_up_to_SectorSize) > w25qxx.sector_size){
-		remain_bytes = w25qxx.sector_size - OffsetInByte;
+	if ((OffsetInByte + NumByteToRead_up_to_SectorSize) > W25QXX_SECTOR_SIZE(dev)){
+		remain_bytes = W25QXX_SECTOR_SIZE(dev) - OffsetInByte;
 	}else{
 		remain_bytes = NumByteToRead_up_to_SectorSize;
 	}
-		
-	start_page = w25qxx_sectorToPage(sector_addr) + (OffsetInByte / w25qxx.page_size);
-	local_offset = OffsetInByte % w25qxx.page_size;
-	
-	do{
-		w25qxx_readPage(buff, start_page, local_offset, remain_bytes);
-		start_page++;
-		remain_bytes -= w25qxx.page_size - local_offset;
-		buff += w25qxx.page_size - local_offset;
-		local_offset = 0;
-	}while(remain_bytes > 0);
 
-	return true;
+	return w25qxx_dev_read(dev, sector_addr * W25QXX_SECTOR_SIZE(dev) + OffsetInByte, buff, remain_bytes);
 }
 
 
 /** 
   * @brief read a block bytes data from block-address
+  * @param  *dev: [in] device handle
   * @param *pBuffer: [out] receive bytes
   * @param Block_Address: [in] sector address (0 - W25Qxxx_BLockCount-1)
   * @param OffsetInByte: [in] offset byte number
   * @param NumByteToRead_up_to_BlockSize: [in] read byte number  max 64KiBytes
   * @retval status 0:passed   1:failed
   */
-bool w25qxx_readBlock(uint8_t *buff, uint32_t block_addr, uint32_t OffsetInByte, uint32_t NumByteToRead_up_to_BlockSize)
+bool w25qxx_dev_readBlock(w25qxx_dev_t *dev, uint8_t *buff, uint32_t block_addr, uint32_t OffsetInByte, uint32_t NumByteToRead_up_to_BlockSize)
 {
-	uint32_t start_page;
-	int32_t remain_bytes;
-	uint32_t local_offset;
+	uint32_t remain_bytes;
 
-	if ((NumByteToRead_up_to_BlockSize > w25qxx.block_size) || 
+	if ((NumByteToRead_up_to_BlockSize > W25QXX_BLOCK_SIZE(dev)) || 
 											(NumByteToRead_up_to_BlockSize == 0))
-		NumByteToRead_up_to_BlockSize = w25qxx.block_size;
+		NumByteToRead_up_to_BlockSize = W25QXX_BLOCK_SIZE(dev);
 
-	if (OffsetInByte >= w25qxx.block_size){
+	if (OffsetInByte >= W25QXX_BLOCK_SIZE(dev)){
 		return false;
 	}
 
-	if ((OffsetInByte + NumByteToRead_up_to_BlockSize) > w25qxx.block_size)
-		remain_bytes = w25qxx.block_size - OffsetInByte;
+	if ((OffsetInByte + NumByteToRead_up_to_BlockSize) > W25QXX_BLOCK_SIZE(dev))
+		remain_bytes = W25QXX_BLOCK_SIZE(dev) - OffsetInByte;
 	else
 		remain_bytes = NumByteToRead_up_to_BlockSize;
-	start_page = w25qxx_blockToPage(block_addr) + (OffsetInByte / w25qxx.page_size);
-	local_offset = OffsetInByte % w25qxx.page_size;
-	do
-	{
-		w25qxx_readPage(buff, start_page, local_offset, remain_bytes);
-		start_page++;
-		remain_bytes -= w25qxx.page_size - local_offset;
-		buff += w25qxx.page_size - local_offset;
-		local_offset = 0;
-	} while (remain_bytes > 0);
+
+	return w25qxx_dev_read(dev, block_addr * W25QXX_BLOCK_SIZE(dev) + OffsetInByte, buff, remain_bytes);
+}
+
+
+
+
+/** ############################################################################################
+  *  Non-blocking erase/program
+  *
+  *  A start function issues the instruction as soon as the chip is idle and
+  *  returns, w25qxx_opPoll() advances the state machine with one SR1 read per
+  *  call. It can be driven from the main loop, a timer or a bus completion
+  *  callback. Multi-page writes issue the next page program from the poll that
+  *  sees the previous one finish. One operation runs per device, a start while
+  *  another one is still busy fails.
+  */
+
+enum{
+	W25QXX_OP_STATE_ISSUE = 0,	// waiting for the chip to become idle
+	W25QXX_OP_STATE_WAIT,		// instruction running, waiting for BUSY to clear
+};
+
+
+static w25qxx_op_status_t w25qxx_opFinish(w25qxx_op_t *op, w25qxx_op_status_t status)
+{
+	op->status = status;
+
+	if (op->dev->pending == op)
+		op->dev->pending = NULL;
+
+	if (op->callback)
+		op->callback(op);
+
+	return status;
+}
+
+
+static bool w25qxx_opIssue(w25qxx_op_t *op)
+{
+	w25qxx_dev_t *dev = op->dev;
+	uint32_t chunk;
+
+	op->start_time = dev->get_time();
+	op->state = W25QXX_OP_STATE_WAIT;
+	W25QXX_STAT(op->issue_us = w25qxx_timeUs(dev));
+
+	if (op->type != W25QXX_OP_WRITE)
+		return w25qxx_issueErase(dev, op->type, op->addr);
+
+	chunk = W25QXX_PAGE_SIZE(dev) - (op->addr % W25QXX_PAGE_SIZE(dev));
+	if (chunk > op->remain)
+		chunk = op->remain;
+
+	w25qxx_enableWrite(dev);
+	ERROR_CHECK(w25qxx_programPage(dev, op->addr, op->buff, chunk));
+
+	op->addr += chunk;
+	op->buff += chunk;
+	op->remain -= chunk;
+
+	return true;
+}
+
+
+static bool w25qxx_opStart(w25qxx_dev_t *dev, w25qxx_op_t *op, w25qxx_op_type_t type, uint32_t addr,
+							const uint8_t *buff, uint32_t len, w25qxx_op_callback_t callback)
+{
+	// one operation at a time: finish and the read suspend logic follow dev->pending only
+	if ((dev->pending != NULL) && (dev->pending->status == W25QXX_OP_BUSY))
+		return false;
+
+	op->dev = dev;
+	op->type = type;
+	op->addr = addr;
+	op->buff = buff;
+	op->remain = len;
+	op->range_start = addr;
+	op->callback = callback;
+
+	switch (type){
+		case W25QXX_OP_ERASE_SECTOR:
+			op->range_end = addr + W25QXX_SECTOR_SIZE(dev);
+			break;
+		case W25QXX_OP_ERASE_BLOCK:
+			op->range_end = addr + W25QXX_BLOCK_SIZE(dev);
+			break;
+		case W25QXX_OP_ERASE_BLOCK_32K:
+			op->range_end = addr + W25QXX_BLOCK_SIZE(dev) / 2;
+			break;
+		case W25QXX_OP_ERASE_CHIP:
+			op->range_end = dev->capacity_kb * 1024;
+			break;
+		default:
+			op->range_end = addr + len;
+			break;
+	}
+	op->state = W25QXX_OP_STATE_ISSUE;
+	op->status = W25QXX_OP_BUSY;
+	op->start_time = dev->get_time();
+	op->suspends = 0;
+	dev->pending = op;
+
+	if (w25qxx_isBusy(dev))
+		return true;
+
+	if (!w25qxx_opIssue(op)){
+		op->status = W25QXX_OP_ERROR;
+		dev->pending = NULL;
+		return false;
+	}
+
+	return true;
+}
+
+
+/** 
+  * @brief  advance an operation, never blocks
+  * @param  *op: [in/out] operation started with one of the w25qxx_xxxStart functions
+  * @retval W25QXX_OP_BUSY while running, W25QXX_OP_DONE / W25QXX_OP_ERROR once finished
+  */
+w25qxx_op_status_t w25qxx_opPoll(w25qxx_op_t *op)
+{
+	w25qxx_dev_t *dev = op->dev;
+
+	uint32_t elapsed;
+
+	if (op->status != W25QXX_OP_BUSY)
+		return op->status;
+
+	elapsed = (uint32_t)(dev->get_time() - op->start_time);
+
+	// leave the bus alone during most of the expected time of a long instruction
+	if ((op->state == W25QXX_OP_STATE_WAIT) &&
+		(elapsed < (dev->busy_est_us[op->type] - dev->busy_est_us[op->type] / 4) / 1000))
+		return W25QXX_OP_BUSY;
+
+	if (w25qxx_isBusy(dev)){
+		if (elapsed >= ((op->state == W25QXX_OP_STATE_WAIT) ? w25qxx_timeoutMs(dev, op->type) : SPI_FLASH_TIMEOUT)){
+			W25QXX_STAT(dev->stats.timeouts++);
+			return w25qxx_opFinish(op, W25QXX_OP_ERROR);
+		}
+		return W25QXX_OP_BUSY;
+	}
+
+	if (op->state == W25QXX_OP_STATE_WAIT)
+		W25QXX_STAT(w25qxx_statLatency(dev, w25qxx_opLatency(op->type), op->issue_us));
+
+	if ((op->state == W25QXX_OP_STATE_WAIT) && (op->remain == 0))
+		return w25qxx_opFinish(op, W25QXX_OP_DONE);
+
+	// chip idle: first instruction of a deferred start or next page of a write
+	if (!w25qxx_opIssue(op))
+		return w25qxx_opFinish(op, W25QXX_OP_ERROR);
+
+	return W25QXX_OP_BUSY;
+}
+
+
+/** 
+  * @brief  start a 4KB sector erase
+  * @param  *dev: [in] device handle
+  * @param  *op: [out] operation state, must stay valid until finished
+  * @param  sector_addr: [in] 0 ~ W25Qxxx_SectorCount-1
+  * @param  callback: [in] called once on completion, may be NULL
+  * @retval status 1:started  0:failed
+  */
+bool w25qxx_dev_eraseSectorStart(w25qxx_dev_t *dev, w25qxx_op_t *op, uint32_t sector_addr, w25qxx_op_callback_t callback)
+{
+	return w25qxx_opStart(dev, op, W25QXX_OP_ERASE_SECTOR, sector_addr * W25QXX_SECTOR_SIZE(dev), NULL, 0, callback);
+}
+
+
+/** 
+  * @brief  start a 64KB block erase
+  * @param  *dev: [in] device handle
+  * @param  block_addr: [in] 0 ~ W25Qxxx_BlockCount-1
+  */
+bool w25qxx_dev_eraseBlockStart(w25qxx_dev_t *dev, w25qxx_op_t *op, uint32_t block_addr, w25qxx_op_callback_t callback)
+{
+	if (!(dev->erase_sizes & W25QXX_ERASE_64K))
+		return false;
+
+	return w25qxx_opStart(dev, op, W25QXX_OP_ERASE_BLOCK, block_addr * W25QXX_BLOCK_SIZE(dev), NULL, 0, callback);
+}
+
+
+/** 
+  * @brief  start a chip erase
+  * @param  *dev: [in] device handle
+  */
+bool w25qxx_dev_eraseChipStart(w25qxx_dev_t *dev, w25qxx_op_t *op, w25qxx_op_callback_t callback)
+{
+	return w25qxx_opStart(dev, op, W25QXX_OP_ERASE_CHIP, 0, NULL, 0, callback);
+}
+
+
+/** 
+  * @brief  start a page write, same clamping as w25qxx_writePage
+  * @param  *dev: [in] device handle
+  * @param  *buff: [in] data, must stay valid until finished
+  */
+bool w25qxx_dev_writePageStart(w25qxx_dev_t *dev, w25qxx_op_t *op, const uint8_t *buff, uint32_t page_addr,
+							uint32_t OffsetInByte, uint32_t NumByteToWrite_up_to_PageSize,
+							w25qxx_op_callback_t callback)
+{
+	if (OffsetInByte >= W25QXX_PAGE_SIZE(dev))
+		return false;
+
+	if (((NumByteToWrite_up_to_PageSize + OffsetInByte) > W25QXX_PAGE_SIZE(dev)) || (NumByteToWrite_up_to_PageSize == 0))
+		NumByteToWrite_up_to_PageSize = W25QXX_PAGE_SIZE(dev) - OffsetInByte;
+
+	return w25qxx_opStart(dev, op, W25QXX_OP_WRITE, page_addr * W25QXX_PAGE_SIZE(dev) + OffsetInByte,
+							buff, NumByteToWrite_up_to_PageSize, callback);
+}
+
+
+/** 
+  * @brief  start a write of any length, split into page programs chained by w25qxx_opPoll
+  * @param  *dev: [in] device handle
+  * @param  addr: [in] start byte address
+  * @param  *buff: [in] data, must stay valid until finished
+  * @param  len: [in] byte number, clamped to the end of the chip
+  */
+bool w25qxx_dev_writeStart(w25qxx_dev_t *dev, w25qxx_op_t *op, uint32_t addr, const uint8_t *buff, uint32_t len,
+						w25qxx_op_callback_t callback)
+{
+	uint32_t capacity = dev->capacity_kb * 1024;
+
+	if ((len == 0) || (addr >= capacity))
+		return false;
+
+	if (len > (capacity - addr))
+		len = capacity - addr;
+
+	return w25qxx_opStart(dev, op, W25QXX_OP_WRITE, addr, buff, len, callback);
+}
+
+
+
+
+/* W25Qxx values of type, kept when the part has no usable SFDP table */
+static void w25qxx_defaultCaps(w25qxx_dev_t *dev, w25qxx_t type)
+{
+	static const uint8_t read_cmd[4] = { CMD_Fast_Read, CMD_Fast_Read_Dual_Output,
+										 CMD_Fast_Read_Quad_Output, CMD_Fast_Read_Quad_IO };
+	static const uint8_t read_dummy[4] = { 1, 1, 1, 3 };
+
+	dev->sfdp = false;
+	dev->addr_mode = (type >= W25Q256) ? W25QXX_ADDR_4BYTE_OPCODES : W25QXX_ADDR_3BYTE;
+	dev->erase_sizes = W25QXX_ERASE_4K | W25QXX_ERASE_32K | W25QXX_ERASE_64K;
+	dev->read_modes = (1 << (W25QXX_READ_QUAD_IO_CONTINUOUS + 1)) - 1;
+	memcpy(dev->read_cmd, read_cmd, sizeof(read_cmd));
+	memcpy(dev->read_dummy, read_dummy, sizeof(read_dummy));
+	dev->timing = *w25qxx_getTiming(type);
+	dev->page_size = 256;
+}
+
+
+#ifndef W25QXX_FIXED_TYPE
+/* W25Qxx part of a capacity, 0 for sizes outside W25Q10 ~ W25Q512 */
+static w25qxx_t w25qxx_typeFromCapacity(uint32_t capacity_kb)
+{
+	for (uint8_t i = 0; i <= (W25Q512 - W25Q10); ++i){
+		if ((128u << i) == capacity_kb)
+			return (w25qxx_t)(W25Q10 + i);
+	}
+
+	return (w25qxx_t)0;
+}
+
+
+/*
+	Fast read field of the BFPT: dummy clocks 4:0, mode clocks 7:5, opcode 15:8.
+	Mode and dummy clocks go out on addr_lines and have to fill whole bytes.
+*/
+static bool w25qxx_sfdpReadCmd(uint16_t field, uint8_t addr_lines, uint8_t *cmd, uint8_t *dummy)
+{
+	uint32_t bits = ((field & 0x1F) + ((field >> 5) & 0x07)) * addr_lines;
+
+	if ((bits == 0) || (bits % 8) || ((bits / 8) > (W25QXX_HEADER_MAX - 5)))
+		return false;
+
+	*cmd = field >> 8;
+	*dummy = bits / 8;
 
 	return true;
 }
 
 
+/* Typical time field of the BFPT: count bits, then unit_bits selecting an entry of units */
+static uint32_t w25qxx_sfdpTime(uint32_t field, uint8_t count_bits, uint8_t unit_bits, const uint32_t *units)
+{
+	return ((field & ((1u << count_bits) - 1)) + 1) * units[(field >> count_bits) & ((1u << unit_bits) - 1)];
+}
+
+
+/** 
+  * @brief  read the SFDP header and the Basic Flash Parameter Table (JESD216) and take
+  *         capacity, page size, erase sizes, fast reads, timing and 4-byte addressing
+  *         from it. Erase types are used when they match 20h/52h/D8h.
+  * @retval 1: table applied  0: no usable table, nothing changed
+  */
+static bool w25qxx_readSfdp(w25qxx_dev_t *dev)
+{
+	static const uint8_t erase_cmd[3] = { CMD_Erase_Sector, CMD_Erase_Block_32K, CMD_Erase_Block_64K };
+	static const uint32_t erase_units_ms[4] = { 1, 16, 128, 1000 };
+	static const uint32_t pp_units_us[2] = { 8, 64 };
+	static const uint32_t ce_units_ms[4] = { 16, 256, 4000, 64000 };
+	uint8_t  hdr[16];
+	uint8_t  raw[W25QXX_SFDP_BFPT_MAX * 4];
+	uint32_t dw[W25QXX_SFDP_BFPT_MAX];
+	uint32_t erase_ms[3] = { 0 };
+	uint32_t count;
+	uint64_t bytes;
+	uint8_t  erase_sizes = 0;
+	uint8_t  read_modes = 1 << W25QXX_READ_FAST;
+	uint8_t  read_cmd[4] = { CMD_Fast_Read, 0, 0, 0 };
+	uint8_t  read_dummy[4] = { 1, 0, 0, 0 };
+	uint8_t  addr_mode = W25QXX_ADDR_3BYTE;
+	uint16_t page_size = 256;
+	w25qxx_timing_t timing = dev->timing;
+
+	// header: signature, minor, major, NPH, then the first parameter header
+	// {ID LSB, minor, major, length in dwords, 3 byte pointer, ID MSB}, JESD216 puts the BFPT first
+	ERROR_CHECK(w25qxx_command(dev, CMD_Read_SFDP, 0, 3, 1, NULL, hdr, sizeof(hdr)));
+
+	if ((((uint32_t)hdr[3] << 24) | ((uint32_t)hdr[2] << 16) | (hdr[1] << 8) | hdr[0]) != W25QXX_SFDP_SIGNATURE)
+		return false;
+	if ((hdr[5] != 1) || (hdr[10] != 1) || (((hdr[15] << 8) | hdr[8]) != W25QXX_SFDP_BFPT_ID) || (hdr[11] < 9))
+		return false;
+
+	count = (hdr[11] > W25QXX_SFDP_BFPT_MAX) ? W25QXX_SFDP_BFPT_MAX : hdr[11];
+
+	ERROR_CHECK(w25qxx_command(dev, CMD_Read_SFDP, ((uint32_t)hdr[14] << 16) | (hdr[13] << 8) | hdr[12],
+								3, 1, NULL, raw, count * 4));
+
+	memset(dw, 0, sizeof(dw));
+	for (uint32_t i = 0; i < count; ++i)
+		dw[i] = ((uint32_t)raw[i * 4 + 3] << 24) | ((uint32_t)raw[i * 4 + 2] << 16) | (raw[i * 4 + 1] << 8) | raw[i * 4];
+
+	// 2nd dword: density in bits, 2^N above 2Gbit
+	if (dw[1] & 0x80000000){
+		if ((dw[1] & 0x7FFFFFFF) > 34)
+			return false;
+		bytes = (1ull << (dw[1] & 0x7FFFFFFF)) / 8;
+	}else{
+		bytes = ((uint64_t)dw[1] + 1) / 8;
+	}
+
+	if ((bytes < 0x10000) || (bytes % 0x10000) || (bytes > 0x80000000ull))
+		return false;
+
+	// 8th/9th dword: erase types {size 2^N, opcode}
+	for (uint8_t i = 0; i < 4; ++i){
+		uint16_t type = dw[7 + i / 2] >> ((i % 2) * 16);
+		uint8_t  n = ((type & 0xFF) == 12) ? 0 : ((type & 0xFF) == 15) ? 1 : ((type & 0xFF) == 16) ? 2 : 3;
+
+		if ((n < 3) && ((type >> 8) == erase_cmd[n])){
+			erase_sizes |= 1 << n;
+			// 10th dword: typical time of erase type i
+			if (count >= 11)
+				erase_ms[n] = w25qxx_sfdpTime(dw[9] >> (4 + 7 * i), 5, 2, erase_units_ms);
+		}
+	}
+
+	// 4KB erase from the 1st dword of JESD216 tables without erase types
+	if ((dw[0] & 0x03) == 0x01)
+		erase_sizes |= W25QXX_ERASE_4K;
+
+	if (!(erase_sizes & W25QXX_ERASE_4K))
+		return false;
+
+	// 1st dword: supported fast reads, their opcodes and clocks in the 3rd and 4th
+	if ((dw[0] & (1 << 16)) && w25qxx_sfdpReadCmd(dw[3] & 0xFFFF, 1, &read_cmd[W25QXX_READ_DUAL_OUTPUT],
+													&read_dummy[W25QXX_READ_DUAL_OUTPUT]))
+		read_modes |= 1 << W25QXX_READ_DUAL_OUTPUT;
+
+	if ((dw[0] & (1 << 22)) && w25qxx_sfdpReadCmd(dw[2] >> 16, 1, &read_cmd[W25QXX_READ_QUAD_OUTPUT],
+													&read_dummy[W25QXX_READ_QUAD_OUTPUT]))
+		read_modes |= 1 << W25QXX_READ_QUAD_OUTPUT;
+
+	if ((dw[0] & (1 << 21)) && w25qxx_sfdpReadCmd(dw[2] & 0xFFFF, 4, &read_cmd[W25QXX_READ_QUAD_IO],
+													&read_dummy[W25QXX_READ_QUAD_IO])){
+		read_modes |= 1 << W25QXX_READ_QUAD_IO;
+		// continuous mode needs M7-0 right after the address
+		if (((dw[2] >> 5) & 0x07) == 2)
+			read_modes |= 1 << W25QXX_READ_QUAD_IO_CONTINUOUS;
+	}
+
+	// 10th/11th dword (JESD216A): program/erase times, max = 2 * (multiplier + 1) * typical
+	if (count >= 11){
+		uint32_t erase_mul = 2 * ((dw[9] & 0x0F) + 1);
+		uint32_t mul = 2 * ((dw[10] & 0x0F) + 1);
+
+		page_size = 1 << ((dw[10] >> 4) & 0x0F);
+		if ((page_size == 0) || (page_size > 256))
+			page_size = 256;
+
+		// bits 23:14 are the first/additional byte program times, the page time unit is one bit
+		timing.t_pp_us = w25qxx_sfdpTime(dw[10] >> 8, 5, 1, pp_units_us);
+		timing.t_pp_max_us = timing.t_pp_us * mul;
+		timing.t_ce_ms = w25qxx_sfdpTime(dw[10] >> 24, 5, 2, ce_units_ms);
+		timing.t_ce_max_ms = timing.t_ce_ms * mul;
+
+		if (erase_ms[0]){
+			timing.t_se_ms = erase_ms[0];
+			timing.t_se_max_ms = erase_ms[0] * erase_mul;
+		}
+		if (erase_ms[1]){
+			timing.t_be32_ms = erase_ms[1];
+			timing.t_be32_max_ms = erase_ms[1] * erase_mul;
+		}
+		if (erase_ms[2]){
+			timing.t_be64_ms = erase_ms[2];
+			timing.t_be64_max_ms = erase_ms[2] * erase_mul;
+		}
+	}
+
+	// 16th dword (JESD216B): how to reach above 16MB, dedicated opcodes preferred to B7h
+	if (bytes > 0x1000000){
+		if (dw[15] & (1 << 29))
+			addr_mode = W25QXX_ADDR_4BYTE_OPCODES;
+		else if (dw[15] & ((1 << 24) | (1 << 25)))
+			addr_mode = W25QXX_ADDR_4BYTE_MODE;
+		else
+			return false;
+
+		if (addr_mode == W25QXX_ADDR_4BYTE_MODE){
+			if (!(dw[15] & (1 << 24)))
+				w25qxx_enableWrite(dev);
+			ERROR_CHECK(w25qxx_command(dev, CMD_Enter_4_Byte_Mode, 0, 0, 0, NULL, NULL, 0));
+		}
+	}
+
+	dev->sfdp = true;
+	dev->capacity_kb = bytes / 1024;
+	dev->page_size = page_size;
+	dev->addr_mode = addr_mode;
+	dev->erase_sizes = erase_sizes;
+	dev->read_modes = read_modes;
+	memcpy(dev->read_cmd, read_cmd, sizeof(read_cmd));
+	memcpy(dev->read_dummy, read_dummy, sizeof(read_dummy));
+	dev->timing = timing;
+
+	return true;
+}
+#endif
 
 
-static bool w25qxx_initCheck(void)
+static bool w25qxx_initCheck(w25qxx_dev_t *dev)
 {
 	uint32_t jedec_id;
-	uint8_t  device_id;
+	uint16_t man_device_id;
 
 	w25qxx_t type;
 
-	while (w25qxx.get_time() < 20)
-		w25qxx.delay(1);
+	while (dev->get_time() < 20)
+		dev->delay(1);
 
 	
-	w25qxx.interface_enable(false);
+	dev->interface_enable(false);
+
+	dev->delay(20);
 
-	w25qxx.delay(20);
+	w25qxx_powerUp(dev);
 
-	w25qxx_powerUp();
-	device_id = w25qxx_getManDeviceID();
-	jedec_id = w25qxx_getJedecID();
+#ifndef W25QXX_FIXED_TYPE
+	// a previous init may have left the part in 4-byte address mode
+	if (dev->addr_mode == W25QXX_ADDR_4BYTE_MODE)
+		w25qxx_command(dev, CMD_Exit_4_Byte_Mode, 0, 0, 0, NULL, NULL, 0);
+	dev->addr_mode = W25QXX_ADDR_3BYTE;
+#endif
+
+	man_device_id = w25qxx_getManDeviceID(dev);
+	jedec_id = w25qxx_getJedecID(dev);
 
 	switch (jedec_id & 0x000000FF)
 	{
 		case 0x20: // 	W25Q512
 			type = W25Q512;
-			w25qxx.block_count = 1024;
 			break;
 		case 0x19: // 	W25Q256
 			type = W25Q256;
-			w25qxx.block_count = 512;
 			break;
 		case 0x18: // 	W25Q128
 			type = W25Q128;
-			w25qxx.block_count = 256;
 			break;
 		case 0x17: //	W25Q64
 			type = W25Q64;
-			w25qxx.block_count = 128;
 			break;
 		case 0x16: //	W25Q32
 			type = W25Q32;
-			w25qxx.block_count = 64;
 			break;
 		case 0x15: //	W25Q16
 			type = W25Q16;
-			w25qxx.block_count = 32;
 			break;
 		case 0x14: //	W25Q80
 			type = W25Q80;
-			w25qxx.block_count = 16;
 			break;
 		case 0x13: //	W25Q40
 			type = W25Q40;
-			w25qxx.block_count = 8;
 			break;
 		case 0x12: //	W25Q20
 			type = W25Q20;
-			w25qxx.block_count = 4;
 			break;
 		case 0x11: //	W25Q10
 			type = W25Q10;
-			w25qxx.block_count = 2;
 			break;
-		default:
+		default:   //	not a W25Qxx capacity code, only usable with SFDP
+			type = (w25qxx_t)0;
+			break;
+	}
+
+#ifdef W25QXX_FIXED_TYPE
+	// geometry is known at build time, only the part is checked
+	if ((type != W25QXX_FIXED_TYPE) || (dev->device_id != (man_device_id & 0xFF)))
+		return false;
+
+	w25qxx_defaultCaps(dev, type);
+	dev->capacity_kb = W25QXX_FIXED_CAPACITY_KB;
+#else
+	w25qxx_defaultCaps(dev, type);
+
+	if (w25qxx_readSfdp(dev)){
+		type = w25qxx_typeFromCapacity(dev->capacity_kb);
+	}else{
+		if (!type || (dev->device_id != (man_device_id & 0xFF)))
 			return false;
+
+		dev->capacity_kb = 128u << (type - W25Q10);
 	}
+#endif
 
-	if((w25qxx.type != type) || (w25qxx.device_id != device_id)){
+	// type 0: take whatever is found
+	if (dev->type && (dev->type != type)){
 		return false;
 	}
 
+	dev->type = type;
+	dev->man_device_id = man_device_id;
+	dev->jedec_id = jedec_id;
 
-	w25qxx_getUniqID();
 
-	uint8_t regVal = w25qxx_readRegX(1);
+	w25qxx_getUniqID(dev);
+
+	uint8_t regVal = w25qxx_dev_readRegX(dev, 1);
 
 	if ((regVal&SR1_S0_BUSY) == SR1_S0_BUSY)
 		return false;
@@ -753,27 +2298,45 @@ static bool w25qxx_initCheck(void)
 }
 
 
-bool w25qxx_init(void)
+bool w25qxx_dev_init(w25qxx_dev_t *dev)
 {
-	w25qxx.device_id = CMD_Device_ID;
-	w25qxx.jedec_id = CMD_JEDEC_ID;
-	w25qxx.man_device_id = CMD_Manufacture_ID;
+	static const w25qxx_read_mode_t fastest[] = { W25QXX_READ_QUAD_IO, W25QXX_READ_QUAD_OUTPUT, W25QXX_READ_DUAL_OUTPUT };
+
+	w25qxx_dev_resetStats(dev);
 
-	w25qxx.page_size = 256;			// 256  Byte
-	w25qxx.sector_size = 0x1000;	// 4096 Byte
-	w25qxx.sector_count = w25qxx.block_count*16;
-	w25qxx.page_count = (w25qxx.sector_count * w25qxx.sector_size) / w25qxx.page_size;
-	w25qxx.block_size = w25qxx.sector_size * 16;
-	w25qxx.capacity_kb = (w25qxx.sector_count * w25qxx.sector_size) / 1024;
+	dev->device_id = CMD_Device_ID;
+	dev->jedec_id = CMD_JEDEC_ID;
+	dev->man_device_id = CMD_Manufacture_ID;
 
-	if(!w25qxx_initCheck()){
+	dev->read_mode = W25QXX_READ_FAST;
+	dev->quad_program = false;
+	dev->continuous_read = false;
+	dev->burst_wrap = W25QXX_WRAP_UNKNOWN;
+	dev->pending = NULL;
+
+	// capacity, page size and capabilities come from SFDP or the JEDEC ID
+	if(!w25qxx_initCheck(dev)){
 		return false;
 	}
 
-}
-
+	dev->sector_size = 0x1000;	// 4096 Byte
+	dev->block_size = dev->sector_size * 16;
+	dev->block_count = (dev->capacity_kb * 1024) / W25QXX_BLOCK_SIZE(dev);
+	dev->sector_count = dev->block_count*16;
+	dev->page_count = (dev->sector_count * W25QXX_SECTOR_SIZE(dev)) / W25QXX_PAGE_SIZE(dev);
+
+	for (uint8_t i = 0; i < W25QXX_OP_TYPE_COUNT; ++i)
+		dev->busy_est_us[i] = w25qxx_typicalUs(dev, (w25qxx_op_type_t)i);
+
+	// fastest read the part and the wiring allow, continuous mode stays opt-in
+	if (dev->interface_transfer && (dev->bus_lines >= 2)){
+		for (uint8_t i = 0; i < sizeof(fastest) / sizeof(fastest[0]); ++i){
+			if ((fastest[i] != W25QXX_READ_DUAL_OUTPUT) && (dev->bus_lines < 4))
+				continue;
+			if (w25qxx_dev_setReadMode(dev, fastest[i]))
+				break;
+		}
+	}
 
-w25q32_init_t* w25qxx_getStruct(void)
-{
-	return &w25qxx;
+	return true;
 }
@@ -0,0 +1,345 @@
+#include <stdint.h>
+#include <string.h>
+#include "w25qxx_array.h"
+
+
+static void w25qxx_array_memberPoll(w25qxx_array_t *arr, uint8_t m)
+{
+	w25qxx_op_status_t status;
+
+	if (!arr->busy[m])
+		return;
+
+	status = w25qxx_opPoll(&arr->op[m]);
+	if (status == W25QXX_OP_BUSY)
+		return;
+
+	arr->busy[m] = false;
+	if (status == W25QXX_OP_ERROR)
+		arr->error = true;
+}
+
+
+/* Start the next member of a staggered mirror erase once the previous one finished */
+static void w25qxx_array_mirrorErase(w25qxx_array_t *arr)
+{
+	w25qxx_dev_t *dev;
+	uint8_t m;
+	bool ok;
+
+	if (arr->erase_len == 0)
+		return;
+
+	if (arr->erase_next > 0 && arr->busy[arr->erase_next - 1])
+		return;
+
+	if (arr->erase_next >= arr->member_count){
+		arr->erase_len = 0;
+		return;
+	}
+
+	m = arr->erase_next++;
+	dev = arr->member[m];
+
+	if (arr->erase_type == W25QXX_OP_ERASE_BLOCK)
+		ok = w25qxx_dev_eraseBlockStart(dev, &arr->op[m], arr->erase_addr / dev->block_size, NULL);
+	else
+		ok = w25qxx_dev_eraseSectorStart(dev, &arr->op[m], arr->erase_addr / dev->sector_size, NULL);
+
+	if (ok)
+		arr->busy[m] = true;
+	else
+		arr->error = true;
+}
+
+
+/**
+  * @brief  advance all outstanding member operations, never blocks
+  * @param  *arr: [in] array
+  * @retval 1: array idle  0: operations in flight
+  */
+bool w25qxx_array_poll(w25qxx_array_t *arr)
+{
+	bool idle = true;
+
+	for (uint8_t m = 0; m < arr->member_count; ++m)
+		w25qxx_array_memberPoll(arr, m);
+
+	w25qxx_array_mirrorErase(arr);
+
+	for (uint8_t m = 0; m < arr->member_count; ++m)
+		idle &= !arr->busy[m];
+
+	return idle && (arr->erase_len == 0);
+}
+
+
+/**
+  * @brief  wait for all outstanding operations
+  * @retval status 1:passed  0:a member operation failed
+  */
+bool w25qxx_array_sync(w25qxx_array_t *arr)
+{
+	bool ok;
+
+	while (!w25qxx_array_poll(arr))
+		;
+
+	ok = !arr->error;
+	arr->error = false;
+
+	return ok;
+}
+
+
+/* Wait for one member, the others keep advancing meanwhile */
+static void w25qxx_array_memberWait(w25qxx_array_t *arr, uint8_t m)
+{
+	while (arr->busy[m])
+		w25qxx_array_poll(arr);
+}
+
+
+/**
+  * @brief  combine initialized devices into one logical volume
+  * @param  *arr: [out] array
+  * @param  mode: [in] W25QXX_ARRAY_STRIPED or W25QXX_ARRAY_MIRRORED
+  * @param  **members: [in] devices after w25qxx_dev_init, same page and sector size
+  * @param  member_count: [in] 1 ~ W25QXX_ARRAY_MAX_MEMBERS
+  * @retval status 1:passed  0:failed
+  */
+bool w25qxx_array_init(w25qxx_array_t *arr, w25qxx_array_mode_t mode,
+						w25qxx_dev_t **members, uint8_t member_count)
+{
+	uint32_t sector_count;
+	uint32_t n;
+
+	if ((member_count == 0) || (member_count > W25QXX_ARRAY_MAX_MEMBERS))
+		return false;
+
+	memset(arr, 0, sizeof(*arr));
+	arr->mode = mode;
+	arr->member_count = member_count;
+
+	sector_count = members[0]->sector_count;
+	for (uint8_t m = 0; m < member_count; ++m){
+		if ((members[m]->page_size != members[0]->page_size) ||
+			(members[m]->sector_size != members[0]->sector_size) ||
+			(members[m]->block_size != members[0]->block_size))
+			return false;
+
+		if (members[m]->sector_count < sector_count)
+			sector_count = members[m]->sector_count;
+
+		arr->member[m] = members[m];
+	}
+
+	// the smallest member limits the volume
+	n = (mode == W25QXX_ARRAY_STRIPED) ? member_count : 1;
+
+	arr->page_size = members[0]->page_size;
+	arr->sector_size = members[0]->sector_size * n;
+	arr->sector_count = sector_count;
+	arr->block_size = members[0]->block_size * n;
+	arr->block_count = (sector_count * members[0]->sector_size) / members[0]->block_size;
+	arr->page_count = (arr->sector_count * arr->sector_size) / arr->page_size;
+	arr->capacity_kb = (arr->sector_count * arr->sector_size) / 1024;
+
+	return true;
+}
+
+
+/* Logical address to member and member address, striped mode */
+static uint8_t w25qxx_array_map(w25qxx_array_t *arr, uint32_t addr, uint32_t *member_addr)
+{
+	uint32_t page = addr / arr->page_size;
+
+	*member_addr = (page / arr->member_count) * arr->page_size + (addr % arr->page_size);
+
+	return page % arr->member_count;
+}
+
+
+/* Idle mirror, round robin; waits only when every member is busy */
+static uint8_t w25qxx_array_pickMirror(w25qxx_array_t *arr)
+{
+	for (;;){
+		w25qxx_array_poll(arr);
+
+		for (uint8_t i = 0; i < arr->member_count; ++i){
+			uint8_t m = (arr->read_next + i) % arr->member_count;
+			if (!arr->busy[m]){
+				arr->read_next = (m + 1) % arr->member_count;
+				return m;
+			}
+		}
+	}
+}
+
+
+/**
+  * @brief  read the logical volume
+  * @param  addr: [in] logical byte address
+  * @param  *buff: [out] receive bytes
+  * @param  len: [in] byte number, clamped to the end of the volume
+  * @retval status 1:passed  0:failed
+  */
+bool w25qxx_array_read(w25qxx_array_t *arr, uint32_t addr, uint8_t *buff, uint32_t len)
+{
+	uint32_t capacity = arr->capacity_kb * 1024;
+	uint32_t member_addr;
+	uint32_t chunk;
+	uint8_t  m;
+
+	if ((len == 0) || (addr >= capacity))
+		return false;
+
+	if (len > (capacity - addr))
+		len = capacity - addr;
+
+	if (arr->mode == W25QXX_ARRAY_MIRRORED){
+		m = w25qxx_array_pickMirror(arr);
+		if (!w25qxx_dev_read(arr->member[m], addr, buff, len))
+			return false;
+
+		// the range of a staggered erase is already erased from the caller's view
+		if (arr->erase_len && (addr < arr->erase_addr + arr->erase_len) && (arr->erase_addr < addr + len)){
+			uint32_t from = (addr > arr->erase_addr) ? addr : arr->erase_addr;
+			uint32_t to = ((addr + len) < (arr->erase_addr + arr->erase_len)) ? (addr + len) : (arr->erase_addr + arr->erase_len);
+			memset(buff + (from - addr), 0xFF, to - from);
+		}
+		return true;
+	}
+
+	while (len){
+		m = w25qxx_array_map(arr, addr, &member_addr);
+		chunk = arr->page_size - (addr % arr->page_size);
+		if (chunk > len)
+			chunk = len;
+
+		w25qxx_array_memberWait(arr, m);
+		if (!w25qxx_dev_read(arr->member[m], member_addr, buff, chunk))
+			return false;
+
+		addr += chunk;
+		buff += chunk;
+		len -= chunk;
+	}
+
+	return true;
+}
+
+
+/**
+  * @brief  program erased space, page programs on different members overlap
+  * @param  addr: [in] logical byte address
+  * @param  *buff: [in] data
+  * @param  len: [in] byte number, clamped to the end of the volume
+  * @retval status 1:passed  0:failed
+  */
+bool w25qxx_array_write(w25qxx_array_t *arr, uint32_t addr, const uint8_t *buff, uint32_t len)
+{
+	uint32_t capacity = arr->capacity_kb * 1024;
+	uint32_t member_addr;
+	uint32_t chunk;
+	uint8_t  m;
+
+	if ((len == 0) || (addr >= capacity))
+		return false;
+
+	if (len > (capacity - addr))
+		len = capacity - addr;
+
+	// programs must not race a staggered erase
+	if (arr->mode == W25QXX_ARRAY_MIRRORED && !w25qxx_array_sync(arr))
+		return false;
+
+	while (len){
+		chunk = arr->page_size - (addr % arr->page_size);
+		if (chunk > len)
+			chunk = len;
+
+		if (arr->mode == W25QXX_ARRAY_MIRRORED){
+			for (m = 0; m < arr->member_count; ++m){
+				w25qxx_array_memberWait(arr, m);
+				if (!w25qxx_dev_writeStart(arr->member[m], &arr->op[m], addr, buff, chunk, NULL))
+					return false;
+				arr->busy[m] = true;
+			}
+		}else{
+			m = w25qxx_array_map(arr, addr, &member_addr);
+			w25qxx_array_memberWait(arr, m);
+			if (!w25qxx_dev_writeStart(arr->member[m], &arr->op[m], member_addr, buff, chunk, NULL))
+				return false;
+			arr->busy[m] = true;
+		}
+
+		addr += chunk;
+		buff += chunk;
+		len -= chunk;
+	}
+
+	return w25qxx_array_sync(arr);
+}
+
+
+static bool w25qxx_array_eraseStart(w25qxx_array_t *arr, w25qxx_op_type_t type, uint32_t index)
+{
+	uint32_t unit = (type == W25QXX_OP_ERASE_BLOCK) ? arr->block_size : arr->sector_size;
+	bool ok;
+
+	if ((index + 1) * (uint64_t)unit > arr->capacity_kb * 1024ull)
+		return false;
+
+	if (arr->mode == W25QXX_ARRAY_MIRRORED){
+		// one staggered erase at a time, so a mirror is always readable
+		if (!w25qxx_array_sync(arr))
+			return false;
+
+		arr->erase_type = type;
+		arr->erase_addr = index * unit;
+		arr->erase_len = unit;
+		arr->erase_next = 0;
+		w25qxx_array_poll(arr);
+
+		return !arr->error;
+	}
+
+	// same sector/block on every member, erase times overlap
+	for (uint8_t m = 0; m < arr->member_count; ++m){
+		w25qxx_array_memberWait(arr, m);
+
+		if (type == W25QXX_OP_ERASE_BLOCK)
+			ok = w25qxx_dev_eraseBlockStart(arr->member[m], &arr->op[m], index, NULL);
+		else
+			ok = w25qxx_dev_eraseSectorStart(arr->member[m], &arr->op[m], index, NULL);
+
+		if (!ok)
+			return false;
+		arr->busy[m] = true;
+	}
+
+	return true;
+}
+
+
+/**
+  * @brief  start erasing a logical sector (member_count * 4KB when striped)
+  * @param  sector_addr: [in] 0 ~ sector_count-1
+  * @retval status 1:started  0:failed
+  */
+bool w25qxx_array_eraseSector(w25qxx_array_t *arr, uint32_t sector_addr)
+{
+	return w25qxx_array_eraseStart(arr, W25QXX_OP_ERASE_SECTOR, sector_addr);
+}
+
+
+/**
+  * @brief  start erasing a logical block (member_count * 64KB when striped)
+  * @param  block_addr: [in] 0 ~ block_count-1
+  * @retval status 1:started  0:failed
+  */
+bool w25qxx_array_eraseBlock(w25qxx_array_t *arr, uint32_t block_addr)
+{
+	return w25qxx_array_eraseStart(arr, W25QXX_OP_ERASE_BLOCK, block_addr);
+}
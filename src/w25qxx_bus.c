@@ -0,0 +1,461 @@
+#include <stdint.h>
+#include <string.h>
+#include "w25qxx_bus.h"
+
+enum{
+	BUS_IDLE = 0,       // nothing queued
+	BUS_WORKED,         // ran a read, a page or an erase start
+	BUS_WAITING,        // only a busy erase is outstanding
+};
+
+
+#ifdef W25QXX_BUS_PTHREAD
+static void w25qxx_bus_pthreadLock(void *ctx)
+{
+	pthread_mutex_lock(&((w25qxx_bus_t *)ctx)->mutex);
+}
+
+
+static void w25qxx_bus_pthreadUnlock(void *ctx)
+{
+	pthread_mutex_unlock(&((w25qxx_bus_t *)ctx)->mutex);
+}
+
+
+static void w25qxx_bus_pthreadWait(void *ctx)
+{
+	w25qxx_bus_t *bus = (w25qxx_bus_t *)ctx;
+
+	pthread_cond_wait(&bus->cond, &bus->mutex);
+}
+
+
+static void w25qxx_bus_pthreadSignal(void *ctx)
+{
+	pthread_cond_broadcast(&((w25qxx_bus_t *)ctx)->cond);
+}
+#endif
+
+
+/**
+  * @brief  set up shared access to an initialized device
+  * @param  *bus: [out] bus
+  * @param  *dev: [in] device after w25qxx_dev_init, only used through the bus from now on
+  * @param  *sync: [in] lock/condition hooks, NULL: pthreads
+  * @retval status 1:passed  0:failed
+  */
+bool w25qxx_bus_init(w25qxx_bus_t *bus, w25qxx_dev_t *dev, const w25qxx_bus_sync_t *sync)
+{
+	memset(bus, 0, sizeof(*bus));
+	bus->dev = dev;
+
+	if (sync){
+		bus->sync = *sync;
+		return (sync->lock != NULL) && (sync->unlock != NULL) && (sync->wait != NULL) && (sync->signal != NULL);
+	}
+
+#ifdef W25QXX_BUS_PTHREAD
+	if (pthread_mutex_init(&bus->mutex, NULL) != 0)
+		return false;
+	if (pthread_cond_init(&bus->cond, NULL) != 0){
+		pthread_mutex_destroy(&bus->mutex);
+		return false;
+	}
+
+	bus->sync.lock = w25qxx_bus_pthreadLock;
+	bus->sync.unlock = w25qxx_bus_pthreadUnlock;
+	bus->sync.wait = w25qxx_bus_pthreadWait;
+	bus->sync.signal = w25qxx_bus_pthreadSignal;
+	bus->sync.ctx = bus;
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+
+void w25qxx_bus_deinit(w25qxx_bus_t *bus)
+{
+#ifdef W25QXX_BUS_PTHREAD
+	if (bus->sync.ctx == bus){
+		pthread_cond_destroy(&bus->cond);
+		pthread_mutex_destroy(&bus->mutex);
+	}
+#else
+	(void)bus;
+#endif
+}
+
+
+static void w25qxx_bus_lock(w25qxx_bus_t *bus)
+{
+	bus->sync.lock(bus->sync.ctx);
+}
+
+
+static void w25qxx_bus_unlock(w25qxx_bus_t *bus)
+{
+	bus->sync.unlock(bus->sync.ctx);
+}
+
+
+static void w25qxx_bus_push(w25qxx_bus_req_t **head, w25qxx_bus_req_t *req)
+{
+	req->next = NULL;
+	while (*head)
+		head = &(*head)->next;
+	*head = req;
+}
+
+
+static w25qxx_bus_req_t* w25qxx_bus_pop(w25qxx_bus_req_t **head)
+{
+	w25qxx_bus_req_t *req = *head;
+
+	if (req)
+		*head = req->next;
+
+	return req;
+}
+
+
+/* Write/erase w was submitted before read and touches its bytes */
+static bool w25qxx_bus_blocks(const w25qxx_bus_req_t *w, const w25qxx_bus_req_t *read)
+{
+	return (w != NULL) && ((int32_t)(w->seq - read->seq) < 0) &&
+			(read->addr < (w->addr + w->len)) && (w->addr < (read->addr + read->len));
+}
+
+
+/*
+	First queued read not overlapping a write/erase submitted before it, taken
+	out of the FIFO. Called locked.
+*/
+static w25qxx_bus_req_t* w25qxx_bus_popRead(w25qxx_bus_t *bus)
+{
+	w25qxx_bus_req_t **head = &bus->reads;
+	w25qxx_bus_req_t *req, *w;
+
+	for (; *head; head = &(*head)->next){
+		req = *head;
+
+		if (w25qxx_bus_blocks(bus->active, req))
+			continue;
+
+		for (w = bus->writes; w && !w25qxx_bus_blocks(w, req); w = w->next)
+			;
+		if (w)
+			continue;
+
+		*head = req->next;
+		bus->read_count--;
+		return req;
+	}
+
+	return NULL;
+}
+
+
+/* Anything left to run, called locked */
+static bool w25qxx_bus_pending(w25qxx_bus_t *bus)
+{
+	return (bus->reads != NULL) || (bus->writes != NULL) || (bus->active != NULL);
+}
+
+
+/*
+	The callback runs first: once status leaves BUSY the owner may free or
+	reuse req (w25qxx_bus_sync keeps it on the stack), nothing touches it after
+*/
+static void w25qxx_bus_finish(w25qxx_bus_t *bus, w25qxx_bus_req_t *req, bool ok)
+{
+	if (req->callback)
+		req->callback(req);
+
+	w25qxx_bus_lock(bus);
+	if (bus->active == req)
+		bus->active = NULL;
+	req->status = ok ? W25QXX_OP_DONE : W25QXX_OP_ERROR;
+	bus->sync.signal(bus->sync.ctx);
+	w25qxx_bus_unlock(bus);
+}
+
+
+/* Next page of a write, false on failure */
+static bool w25qxx_bus_writeStep(w25qxx_bus_t *bus, w25qxx_bus_req_t *req)
+{
+	w25qxx_dev_t *dev = bus->dev;
+	uint32_t addr = req->addr + req->done;
+	uint32_t chunk = dev->page_size - (addr % dev->page_size);
+
+	if (chunk > (req->len - req->done))
+		chunk = req->len - req->done;
+
+	if (!w25qxx_dev_writePage(dev, req->tx + req->done, addr / dev->page_size, addr % dev->page_size, chunk))
+		return false;
+
+	req->done += chunk;
+
+	return true;
+}
+
+
+/* Start the next 64KB/4KB erase of the range or advance the running one */
+static w25qxx_op_status_t w25qxx_bus_eraseStep(w25qxx_bus_t *bus, w25qxx_bus_req_t *req)
+{
+	w25qxx_dev_t *dev = bus->dev;
+	uint32_t addr = req->addr + req->done;
+	w25qxx_op_status_t status;
+	bool res;
+
+	if (!bus->op_running){
+		if ((dev->erase_sizes & W25QXX_ERASE_64K) && ((addr % dev->block_size) == 0) &&
+			((req->len - req->done) >= dev->block_size)){
+			bus->op_size = dev->block_size;
+			res = w25qxx_dev_eraseBlockStart(dev, &bus->op, addr / dev->block_size, NULL);
+		}else{
+			bus->op_size = dev->sector_size;
+			res = w25qxx_dev_eraseSectorStart(dev, &bus->op, addr / dev->sector_size, NULL);
+		}
+
+		if (!res)
+			return W25QXX_OP_ERROR;
+
+		bus->op_running = true;
+	}
+
+	status = w25qxx_opPoll(&bus->op);
+	if (status != W25QXX_OP_BUSY)
+		bus->op_running = false;
+	if (status == W25QXX_OP_DONE)
+		req->done += bus->op_size;
+
+	return status;
+}
+
+
+/*
+	One executor step, called by the owner without the lock: a queued read
+	free to go, else one page or erase of the active write/erase.
+*/
+static uint8_t w25qxx_bus_step(w25qxx_bus_t *bus)
+{
+	w25qxx_bus_req_t *req;
+	w25qxx_op_status_t status;
+	bool res;
+
+	w25qxx_bus_lock(bus);
+	req = w25qxx_bus_popRead(bus);
+	if ((req == NULL) && (bus->active == NULL)){
+		bus->active = w25qxx_bus_pop(&bus->writes);
+		if (bus->active)
+			bus->write_count--;
+	}
+	if (req || bus->active)
+		bus->sync.signal(bus->sync.ctx);	// room in the queue
+	w25qxx_bus_unlock(bus);
+
+	if (req){
+		res = w25qxx_dev_read(bus->dev, req->addr, req->rx, req->len);
+		if (res)
+			req->done = req->len;
+		w25qxx_bus_finish(bus, req, res);
+		return BUS_WORKED;
+	}
+
+	req = bus->active;
+	if (req == NULL)
+		return BUS_IDLE;
+
+	if (req->kind == W25QXX_BUS_WRITE){
+		if (!w25qxx_bus_writeStep(bus, req))
+			w25qxx_bus_finish(bus, req, false);
+		else if (req->done == req->len)
+			w25qxx_bus_finish(bus, req, true);
+
+		return BUS_WORKED;
+	}
+
+	status = w25qxx_bus_eraseStep(bus, req);
+	if (status == W25QXX_OP_BUSY)
+		return BUS_WAITING;
+
+	if ((status == W25QXX_OP_ERROR) || (req->done == req->len))
+		w25qxx_bus_finish(bus, req, status == W25QXX_OP_DONE);
+
+	return BUS_WORKED;
+}
+
+
+/*
+	Called locked: run one step if nobody else does, otherwise sleep until
+	something changes. block: also sleep when there is nothing to do.
+*/
+static void w25qxx_bus_help(w25qxx_bus_t *bus, bool block)
+{
+	uint8_t res;
+
+	if (bus->owned || !w25qxx_bus_pending(bus)){
+		if (block || bus->owned)
+			bus->sync.wait(bus->sync.ctx);
+		return;
+	}
+
+	bus->owned = true;
+	w25qxx_bus_unlock(bus);
+
+	res = w25qxx_bus_step(bus);
+
+	// a busy erase and nothing else: give the chip time without holding the bus
+	if (res == BUS_WAITING)
+		bus->dev->delay(1);
+
+	w25qxx_bus_lock(bus);
+	bus->owned = false;
+	bus->sync.signal(bus->sync.ctx);
+}
+
+
+/**
+  * @brief  queue a request, req must stay valid until it completed
+  * @param  *req: [in] kind, addr, rx/tx, len, callback filled in
+  * @retval status 1:queued  0:invalid request
+  */
+bool w25qxx_bus_submit(w25qxx_bus_t *bus, w25qxx_bus_req_t *req)
+{
+	w25qxx_dev_t *dev = bus->dev;
+	uint32_t capacity = dev->capacity_kb * 1024;
+
+	if ((req->len == 0) || (req->addr >= capacity) || (req->len > (capacity - req->addr)))
+		return false;
+
+	if ((req->kind == W25QXX_BUS_ERASE) && ((req->addr % dev->sector_size) || (req->len % dev->sector_size)))
+		return false;
+
+	if (((req->kind == W25QXX_BUS_READ) && (req->rx == NULL)) || ((req->kind == W25QXX_BUS_WRITE) && (req->tx == NULL)))
+		return false;
+
+	req->status = W25QXX_OP_BUSY;
+	req->done = 0;
+
+	w25qxx_bus_lock(bus);
+
+	if (req->kind == W25QXX_BUS_READ){
+		while (bus->read_count >= W25QXX_BUS_QUEUE_LEN)
+			w25qxx_bus_help(bus, true);
+		req->seq = bus->seq++;
+		w25qxx_bus_push(&bus->reads, req);
+		bus->read_count++;
+	}else{
+		while (bus->write_count >= W25QXX_BUS_QUEUE_LEN)
+			w25qxx_bus_help(bus, true);
+		req->seq = bus->seq++;
+		w25qxx_bus_push(&bus->writes, req);
+		bus->write_count++;
+	}
+
+	bus->sync.signal(bus->sync.ctx);
+	w25qxx_bus_unlock(bus);
+
+	return true;
+}
+
+
+/**
+  * @brief  block until req completed
+  * @retval status 1:done  0:failed
+  */
+bool w25qxx_bus_wait(w25qxx_bus_t *bus, w25qxx_bus_req_t *req)
+{
+	w25qxx_op_status_t status;
+
+	w25qxx_bus_lock(bus);
+	while (req->status == W25QXX_OP_BUSY)
+		w25qxx_bus_help(bus, true);
+	status = req->status;
+	w25qxx_bus_unlock(bus);
+
+	return status == W25QXX_OP_DONE;
+}
+
+
+w25qxx_op_status_t w25qxx_bus_poll(w25qxx_bus_t *bus, w25qxx_bus_req_t *req)
+{
+	w25qxx_op_status_t status;
+
+	w25qxx_bus_lock(bus);
+	status = req->status;
+	w25qxx_bus_unlock(bus);
+
+	return status;
+}
+
+
+bool w25qxx_bus_process(w25qxx_bus_t *bus)
+{
+	bool pending;
+
+	w25qxx_bus_lock(bus);
+	if (!bus->owned)
+		w25qxx_bus_help(bus, false);
+	pending = w25qxx_bus_pending(bus);
+	w25qxx_bus_unlock(bus);
+
+	return pending;
+}
+
+
+void w25qxx_bus_run(w25qxx_bus_t *bus)
+{
+	w25qxx_bus_lock(bus);
+	while (!bus->stop)
+		w25qxx_bus_help(bus, true);
+	w25qxx_bus_unlock(bus);
+}
+
+
+void w25qxx_bus_stop(w25qxx_bus_t *bus)
+{
+	w25qxx_bus_lock(bus);
+	bus->stop = true;
+	bus->sync.signal(bus->sync.ctx);
+	w25qxx_bus_unlock(bus);
+}
+
+
+static bool w25qxx_bus_sync(w25qxx_bus_t *bus, w25qxx_bus_kind_t kind, uint32_t addr, uint8_t *rx,
+							const uint8_t *tx, uint32_t len)
+{
+	w25qxx_bus_req_t req;
+
+	memset(&req, 0, sizeof(req));
+	req.kind = kind;
+	req.addr = addr;
+	req.rx = rx;
+	req.tx = tx;
+	req.len = len;
+
+	if (!w25qxx_bus_submit(bus, &req))
+		return false;
+
+	return w25qxx_bus_wait(bus, &req);
+}
+
+
+bool w25qxx_bus_read(w25qxx_bus_t *bus, uint32_t addr, uint8_t *buff, uint32_t len)
+{
+	return w25qxx_bus_sync(bus, W25QXX_BUS_READ, addr, buff, NULL, len);
+}
+
+
+bool w25qxx_bus_write(w25qxx_bus_t *bus, uint32_t addr, const uint8_t *buff, uint32_t len)
+{
+	return w25qxx_bus_sync(bus, W25QXX_BUS_WRITE, addr, NULL, buff, len);
+}
+
+
+bool w25qxx_bus_erase(w25qxx_bus_t *bus, uint32_t addr, uint32_t len)
+{
+	return w25qxx_bus_sync(bus, W25QXX_BUS_ERASE, addr, NULL, NULL, len);
+}
@@ -0,0 +1,240 @@
+#include <stdint.h>
+#include "w25qxx.h"
+
+/*
+	Compatibility shim: the original single chip API on a default instance.
+*/
+
+w25q32_init_t w25qxx;
+
+
+bool w25qxx_read(uint32_t addr, uint8_t *buff, uint32_t len)
+{
+	return w25qxx_dev_read(&w25qxx, addr, buff, len);
+}
+
+
+bool w25qxx_readByte(uint8_t *buff, uint32_t bytes_addr)
+{
+	return w25qxx_dev_readByte(&w25qxx, buff, bytes_addr);
+}
+
+
+bool w25qxx_readWrap(uint32_t addr, uint8_t *buff, uint8_t len)
+{
+	return w25qxx_dev_readWrap(&w25qxx, addr, buff, len);
+}
+
+
+bool w25qxx_readPage(uint8_t *buff, uint32_t page_addr, 
+						uint32_t OffsetInByte, uint32_t NumByteToRead_up_to_PageSize)
+{
+	return w25qxx_dev_readPage(&w25qxx, buff, page_addr, OffsetInByte, NumByteToRead_up_to_PageSize);
+}
+
+
+bool w25qxx_readSector(uint8_t *buff, uint32_t sector_addr, 
+						uint32_t OffsetInByte, uint32_t NumByteToRead_up_to_SectorSize)
+{
+	return w25qxx_dev_readSector(&w25qxx, buff, sector_addr, OffsetInByte, NumByteToRead_up_to_SectorSize);
+}
+
+
+bool w25qxx_readBlock(uint8_t *buff, uint32_t block_addr, 
+						uint32_t OffsetInByte, uint32_t NumByteToRead_up_to_BlockSize)
+{
+	return w25qxx_dev_readBlock(&w25qxx, buff, block_addr, OffsetInByte, NumByteToRead_up_to_BlockSize);
+}
+
+
+bool w25qxx_writeByte(const uint8_t* buff, uint32_t WriteAddr_inBytes)
+{
+	return w25qxx_dev_writeByte(&w25qxx, buff, WriteAddr_inBytes);
+}
+
+
+bool w25qxx_writePage(const uint8_t *buff, uint32_t page_addr, 
+						uint32_t OffsetInByte, uint32_t NumByteToWrite_up_to_PageSize)
+{
+	return w25qxx_dev_writePage(&w25qxx, buff, page_addr, OffsetInByte, NumByteToWrite_up_to_PageSize);
+}
+
+
+bool w25qxx_writeSector(const uint8_t *buff, uint32_t sector_addr, 
+						uint32_t OffsetInByte, uint32_t NumByteToWrite_up_to_SectorSize)
+{
+	return w25qxx_dev_writeSector(&w25qxx, buff, sector_addr, OffsetInByte, NumByteToWrite_up_to_SectorSize);
+}
+
+
+bool w25qxx_writeBlock(const uint8_t *buff, uint32_t block_addr, 
+							uint32_t OffsetInByte, uint32_t NumByteToWrite_up_to_BlockSize)
+{
+	return w25qxx_dev_writeBlock(&w25qxx, buff, block_addr, OffsetInByte, NumByteToWrite_up_to_BlockSize);
+}
+
+
+bool w25qxx_writeSmart(uint32_t addr, const uint8_t *buff, uint32_t len)
+{
+	return w25qxx_dev_writeSmart(&w25qxx, addr, buff, len);
+}
+
+
+bool w25qxx_write(uint32_t addr, const uint8_t *buff, uint32_t len)
+{
+	return w25qxx_dev_write(&w25qxx, addr, buff, len);
+}
+
+
+bool w25qxx_writerOpen(w25qxx_writer_t *w, uint32_t addr)
+{
+	return w25qxx_dev_writerOpen(&w25qxx, w, addr);
+}
+
+
+bool w25qxx_eraseBlock(uint32_t block_addr)
+{
+	return w25qxx_dev_eraseBlock(&w25qxx, block_addr);
+}
+
+
+bool w25q32_eraseSector(uint32_t sector_addr)
+{
+	return w25qxx_dev_eraseSector(&w25qxx, sector_addr);
+}
+
+
+bool w25qxx_eraseBlock32K(uint32_t block32_addr)
+{
+	return w25qxx_dev_eraseBlock32K(&w25qxx, block32_addr);
+}
+
+
+bool w25qxx_erase(uint32_t addr, uint32_t len)
+{
+	return w25qxx_dev_erase(&w25qxx, addr, len);
+}
+
+
+int8_t w25q32_eraseChip(void)
+{
+	return w25qxx_dev_eraseChip(&w25qxx);
+}
+
+
+bool w25qxx_eraseSectorStart(w25qxx_op_t *op, uint32_t sector_addr, w25qxx_op_callback_t callback)
+{
+	return w25qxx_dev_eraseSectorStart(&w25qxx, op, sector_addr, callback);
+}
+
+
+bool w25qxx_eraseBlockStart(w25qxx_op_t *op, uint32_t block_addr, w25qxx_op_callback_t callback)
+{
+	return w25qxx_dev_eraseBlockStart(&w25qxx, op, block_addr, callback);
+}
+
+
+bool w25qxx_eraseChipStart(w25qxx_op_t *op, w25qxx_op_callback_t callback)
+{
+	return w25qxx_dev_eraseChipStart(&w25qxx, op, callback);
+}
+
+
+bool w25qxx_writePageStart(w25qxx_op_t *op, const uint8_t *buff, uint32_t page_addr,
+							uint32_t OffsetInByte, uint32_t NumByteToWrite_up_to_PageSize,
+							w25qxx_op_callback_t callback)
+{
+	return w25qxx_dev_writePageStart(&w25qxx, op, buff, page_addr, OffsetInByte,
+										NumByteToWrite_up_to_PageSize, callback);
+}
+
+
+bool w25qxx_writeStart(w25qxx_op_t *op, uint32_t addr, const uint8_t *buff, uint32_t len,
+						w25qxx_op_callback_t callback)
+{
+	return w25qxx_dev_writeStart(&w25qxx, op, addr, buff, len, callback);
+}
+
+
+bool w25qxx_init(void)
+{
+	return w25qxx_dev_init(&w25qxx);
+}
+
+
+uint8_t w25qxx_readRegX(uint8_t reg_x)
+{
+	return w25qxx_dev_readRegX(&w25qxx, reg_x);
+}
+
+
+bool w25qxx_setQuadEnable(bool en)
+{
+	return w25qxx_dev_setQuadEnable(&w25qxx, en);
+}
+
+
+bool w25qxx_setReadMode(w25qxx_read_mode_t mode)
+{
+	return w25qxx_dev_setReadMode(&w25qxx, mode);
+}
+
+
+bool w25qxx_setQuadProgram(bool en)
+{
+	return w25qxx_dev_setQuadProgram(&w25qxx, en);
+}
+
+
+bool w25qxx_setBurstWrap(uint8_t len)
+{
+	return w25qxx_dev_setBurstWrap(&w25qxx, len);
+}
+
+
+void w25qxx_setSmartWrite(uint8_t *scratch)
+{
+	w25qxx_dev_setSmartWrite(&w25qxx, scratch);
+}
+
+
+void w25qxx_setSuspendLimit(uint8_t limit)
+{
+	w25qxx_dev_setSuspendLimit(&w25qxx, limit);
+}
+
+
+void w25qxx_setVerify(bool en)
+{
+	w25qxx_dev_setVerify(&w25qxx, en);
+}
+
+
+bool w25qxx_verify(uint32_t addr, const uint8_t *buff, uint32_t len)
+{
+	return w25qxx_dev_verify(&w25qxx, addr, buff, len);
+}
+
+
+bool w25qxx_crc32(uint32_t addr, uint32_t len, uint32_t *crc)
+{
+	return w25qxx_dev_crc32(&w25qxx, addr, len, crc);
+}
+
+
+w25q32_init_t* w25qxx_getStruct(void)
+{
+	return &w25qxx;
+}
+
+
+bool w25qxx_getStats(w25qxx_stats_t *snapshot)
+{
+	return w25qxx_dev_getStats(&w25qxx, snapshot);
+}
+
+
+void w25qxx_resetStats(void)
+{
+	w25qxx_dev_resetStats(&w25qxx);
+}
@@ -0,0 +1,328 @@
+#include <stdint.h>
+#include <string.h>
+#include "w25qxx_emap.h"
+
+
+static w25qxx_emap_state_t w25qxx_emap_get(w25qxx_emap_t *m, uint32_t sector)
+{
+	return (w25qxx_emap_state_t)((m->map[sector / 4] >> ((sector % 4) * 2)) & 0x03);
+}
+
+
+static void w25qxx_emap_set(w25qxx_emap_t *m, uint32_t sector, w25qxx_emap_state_t state)
+{
+	w25qxx_emap_state_t old = w25qxx_emap_get(m, sector);
+
+	if (old == state)
+		return;
+
+	if (old == W25QXX_EMAP_FREE)
+		m->free_count--;
+	if (state == W25QXX_EMAP_FREE)
+		m->free_count++;
+
+	m->map[sector / 4] &= ~(0x03 << ((sector % 4) * 2));
+	m->map[sector / 4] |= state << ((sector % 4) * 2);
+	m->changed = true;
+}
+
+
+/* Listener: erased sectors become ERASED, programmed ones DIRTY */
+static void w25qxx_emap_changed(w25qxx_notify_t *n, uint32_t addr, uint32_t len, bool erase)
+{
+	w25qxx_emap_t *m = (w25qxx_emap_t *)n->user;
+	uint32_t first = addr / m->dev->sector_size;
+	uint32_t last = (addr + len - 1) / m->dev->sector_size;
+
+	if (len == 0)
+		return;
+
+	for (uint32_t s = first; (s <= last) && (s < m->dev->sector_count); ++s)
+		w25qxx_emap_set(m, s, erase ? W25QXX_EMAP_ERASED : W25QXX_EMAP_DIRTY);
+}
+
+
+/* Read a sector until its first programmed byte */
+static bool w25qxx_emap_isBlank(w25qxx_emap_t *m, uint32_t sector, bool *blank)
+{
+	w25qxx_dev_t *dev = m->dev;
+	uint8_t buff[W25QXX_STREAM_CHUNK];
+	uint32_t addr = sector * dev->sector_size;
+	uint32_t len = dev->sector_size;
+	uint32_t chunk;
+
+	*blank = false;
+
+	while (len){
+		chunk = (len < sizeof(buff)) ? len : sizeof(buff);
+
+		if (!w25qxx_dev_read(dev, addr, buff, chunk))
+			return false;
+
+		for (uint32_t i = 0; i < chunk; ++i){
+			if (buff[i] != 0xFF)
+				return true;
+		}
+
+		addr += chunk;
+		len -= chunk;
+	}
+
+	*blank = true;
+
+	return true;
+}
+
+
+/**
+  * @brief  attach an erase map to an initialized device
+  * @param  *m: [out] map
+  * @param  *dev: [in] device after w25qxx_dev_init
+  * @param  *map: [in] W25QXX_EMAP_BYTES(sector_count) bytes, must outlive the map
+  * @param  *saved: [in] copy from w25qxx_emap_save, NULL: blank scan
+  * @retval status 1:passed  0:failed
+  */
+bool w25qxx_emap_mount(w25qxx_emap_t *m, w25qxx_dev_t *dev, uint8_t *map, const uint8_t *saved)
+{
+	bool blank;
+
+	if (map == NULL)
+		return false;
+
+	memset(m, 0, sizeof(*m));
+	m->dev = dev;
+	m->map = map;
+
+	if (saved){
+		memcpy(map, saved, W25QXX_EMAP_BYTES(dev->sector_count));
+		for (uint32_t s = 0; s < dev->sector_count; ++s){
+			// 3 is no state, the copy is corrupt
+			if (w25qxx_emap_get(m, s) > W25QXX_EMAP_FREE)
+				return false;
+			if (w25qxx_emap_get(m, s) == W25QXX_EMAP_FREE)
+				m->free_count++;
+		}
+	}else{
+		memset(map, 0, W25QXX_EMAP_BYTES(dev->sector_count));
+		for (uint32_t s = 0; s < dev->sector_count; ++s){
+			if (!w25qxx_emap_isBlank(m, s, &blank))
+				return false;
+			if (blank)
+				w25qxx_emap_set(m, s, W25QXX_EMAP_ERASED);
+		}
+	}
+
+	m->changed = (saved == NULL);
+
+	m->notify.changed = w25qxx_emap_changed;
+	m->notify.user = m;
+	w25qxx_dev_addNotify(dev, &m->notify);
+
+	return true;
+}
+
+
+/*
+	The erase notification marked the sectors of the background erase erased
+	at issue time, a failed erase leaves them in an unknown state
+*/
+static w25qxx_op_status_t w25qxx_emap_failed(w25qxx_emap_t *m)
+{
+	for (uint32_t s = m->op_sector; s < (m->op_sector + m->op_sectors); ++s)
+		w25qxx_emap_set(m, s, W25QXX_EMAP_DIRTY);
+	m->erase_errors++;
+
+	return W25QXX_OP_ERROR;
+}
+
+
+/* Advance the background erase */
+static w25qxx_op_status_t w25qxx_emap_poll(w25qxx_emap_t *m)
+{
+	w25qxx_op_status_t status;
+
+	if (!m->op_running)
+		return W25QXX_OP_DONE;
+
+	status = w25qxx_opPoll(&m->op);
+	if (status == W25QXX_OP_BUSY)
+		return status;
+
+	m->op_running = false;
+	if (status == W25QXX_OP_ERROR)
+		return w25qxx_emap_failed(m);
+
+	return status;
+}
+
+
+/* Wait for the background erase */
+static bool w25qxx_emap_finish(w25qxx_emap_t *m)
+{
+	w25qxx_op_status_t status;
+
+	while ((status = w25qxx_emap_poll(m)) == W25QXX_OP_BUSY)
+		m->dev->delay(1);
+
+	return status == W25QXX_OP_DONE;
+}
+
+
+bool w25qxx_emap_unmount(w25qxx_emap_t *m)
+{
+	bool res = w25qxx_emap_finish(m);
+
+	w25qxx_dev_removeNotify(m->dev, &m->notify);
+
+	return res;
+}
+
+
+void w25qxx_emap_save(w25qxx_emap_t *m, uint8_t *saved)
+{
+	memcpy(saved, m->map, W25QXX_EMAP_BYTES(m->dev->sector_count));
+	m->changed = false;
+}
+
+
+w25qxx_emap_state_t w25qxx_emap_state(w25qxx_emap_t *m, uint32_t sector)
+{
+	if (sector >= m->dev->sector_count)
+		return W25QXX_EMAP_DIRTY;
+
+	return w25qxx_emap_get(m, sector);
+}
+
+
+/**
+  * @brief  drop the contents of the sectors fully inside a range
+  * @param  addr: [in] byte address
+  * @param  len: [in] byte number
+  * @retval status 1:passed  0:failed
+  */
+bool w25qxx_emap_discard(w25qxx_emap_t *m, uint32_t addr, uint32_t len)
+{
+	w25qxx_dev_t *dev = m->dev;
+	uint32_t capacity = dev->capacity_kb * 1024;
+	uint32_t first, end;
+
+	if ((len == 0) || (addr >= capacity) || (len > (capacity - addr)))
+		return false;
+
+	// partly covered sectors keep data outside the range
+	first = (addr + dev->sector_size - 1) / dev->sector_size;
+	end = (addr + len) / dev->sector_size;
+
+	for (uint32_t s = first; s < end; ++s){
+		if (w25qxx_emap_get(m, s) != W25QXX_EMAP_ERASED)
+			w25qxx_emap_set(m, s, W25QXX_EMAP_FREE);
+	}
+
+	return true;
+}
+
+
+/**
+  * @brief  background erase step, call when the application is idle
+  * @retval W25QXX_OP_BUSY: free sectors left or an erase running  W25QXX_OP_DONE: nothing to do
+  *         W25QXX_OP_ERROR: an erase failed, its sectors are dirty again
+  */
+w25qxx_op_status_t w25qxx_emap_idle(w25qxx_emap_t *m)
+{
+	w25qxx_dev_t *dev = m->dev;
+	uint32_t per_block = dev->block_size / dev->sector_size;
+	uint32_t s = m->cursor;
+	w25qxx_op_status_t status;
+	uint32_t i;
+	bool res;
+
+	status = w25qxx_emap_poll(m);
+	if (status != W25QXX_OP_DONE)
+		return status;
+
+	// the chip is busy with another non-blocking operation
+	if ((m->free_count == 0) || (dev->pending != NULL))
+		return (m->free_count != 0) ? W25QXX_OP_BUSY : W25QXX_OP_DONE;
+
+	for (i = 0; i < dev->sector_count; ++i, s = (s + 1) % dev->sector_count){
+		if (w25qxx_emap_get(m, s) == W25QXX_EMAP_FREE)
+			break;
+	}
+
+	if ((dev->erase_sizes & W25QXX_ERASE_64K) && ((s % per_block) == 0)){
+		for (i = 1; (i < per_block) && (w25qxx_emap_get(m, s + i) == W25QXX_EMAP_FREE); ++i)
+			;
+	}else{
+		i = 1;
+	}
+
+	if (i == per_block)
+		res = w25qxx_dev_eraseBlockStart(dev, &m->op, s / per_block, NULL);
+	else
+		res = w25qxx_dev_eraseSectorStart(dev, &m->op, s, NULL);
+
+	m->op_sector = s;
+	m->op_sectors = (i == per_block) ? per_block : 1;
+	m->cursor = (s + m->op_sectors) % dev->sector_count;
+
+	if (!res)
+		return w25qxx_emap_failed(m);
+
+	// the erase notification already marked the sectors erased
+	m->op_running = true;
+	m->pre_erased += m->op_sectors;
+
+	return W25QXX_OP_BUSY;
+}
+
+
+/**
+  * @brief  erase the sectors of a range that are not erased yet, sectors marked
+  *         erased are read until their first programmed byte before being skipped
+  * @param  addr: [in] sector aligned byte address
+  * @param  len: [in] sector aligned byte number
+  * @retval status 1:passed  0:failed
+  */
+bool w25qxx_emap_prepare(w25qxx_emap_t *m, uint32_t addr, uint32_t len)
+{
+	w25qxx_dev_t *dev = m->dev;
+	uint32_t capacity = dev->capacity_kb * 1024;
+	uint32_t first = addr / dev->sector_size;
+	uint32_t end = (addr + len) / dev->sector_size;
+	uint32_t run = 0;
+	bool blank;
+
+	if ((len == 0) || (addr % dev->sector_size) || (len % dev->sector_size) ||
+		(addr >= capacity) || (len > (capacity - addr)))
+		return false;
+
+	if (!w25qxx_emap_finish(m))
+		return false;
+
+	// runs of sectors needing an erase go to w25qxx_dev_erase, which picks the largest units
+	for (uint32_t s = first; s <= end; ++s){
+		if ((s < end) && (w25qxx_emap_get(m, s) == W25QXX_EMAP_ERASED)){
+			// a stale saved copy may call a programmed sector erased, the check stops at its first programmed byte
+			if (!w25qxx_emap_isBlank(m, s, &blank))
+				return false;
+			if (!blank){
+				w25qxx_emap_set(m, s, W25QXX_EMAP_DIRTY);
+				m->stale_erased++;
+			}
+		}
+
+		if ((s < end) && (w25qxx_emap_get(m, s) != W25QXX_EMAP_ERASED)){
+			run++;
+			continue;
+		}
+
+		if (s < end)
+			m->erases_skipped++;
+
+		if (run && !w25qxx_dev_erase(dev, (s - run) * dev->sector_size, run * dev->sector_size))
+			return false;
+		run = 0;
+	}
+
+	return true;
+}
@@ -0,0 +1,809 @@
+#include <stdint.h>
+#include <string.h>
+#include "w25qxx_ftl.h"
+
+#define FTL_MAGIC               0x314C5446      // "FTL1"
+#define FTL_CKPT_MAGIC          0x314B4346      // "FCK1"
+#define FTL_PAGES               (W25QXX_FTL_DATA_PAGES + 1)
+#define FTL_HDR_SIZE            16
+#define FTL_ENTRY_SIZE          8
+
+#define FTL_HOT                 0
+#define FTL_COLD                1
+
+#define FTL_FLAG_HEAD           0x01
+#define FTL_FLAG_RESERVED       0x02
+#define FTL_FLAG_PINNED         0x04            // opened after the last checkpoint, kept until the next one
+
+/* Page 0 of every data sector */
+typedef struct
+{
+    uint32_t magic;
+    uint32_t erase_count;
+    uint32_t open_wseq;
+    uint32_t next;
+    struct{
+        uint32_t lpn;
+        uint32_t wseq;
+    }entry[W25QXX_FTL_DATA_PAGES];
+
+}ftl_hdr_t;
+
+/* Page 0 of a checkpoint slot, map and erase counts follow from page 1 */
+typedef struct
+{
+    uint32_t magic;
+    uint32_t seq;
+    uint32_t wseq;
+    uint32_t data_sectors;
+    uint32_t page_count;
+    uint32_t head_sector[2];
+    uint32_t head_next[2];
+    uint32_t sum;
+
+}ftl_ckpt_t;
+
+
+static uint32_t w25qxx_ftl_sum(uint32_t sum, const uint8_t *data, uint32_t len)
+{
+	// FNV-1a
+	while (len--){
+		sum ^= *data++;
+		sum *= 16777619u;
+	}
+
+	return sum;
+}
+
+
+static bool w25qxx_ftl_readAt(w25qxx_ftl_t *ftl, uint32_t s, uint32_t offset, void *buff, uint32_t len)
+{
+	return w25qxx_dev_readSector(ftl->dev, buff, ftl->first_sector + s, offset, len);
+}
+
+
+static bool w25qxx_ftl_writeAt(w25qxx_ftl_t *ftl, uint32_t s, uint32_t offset, const void *buff, uint32_t len)
+{
+	return w25qxx_dev_writeSector(ftl->dev, buff, ftl->first_sector + s, offset, len);
+}
+
+
+/* Stream bytes into consecutive sectors of a checkpoint slot */
+static bool w25qxx_ftl_put(w25qxx_ftl_t *ftl, uint32_t *pos, const uint8_t *data, uint32_t len)
+{
+	uint32_t ss = ftl->dev->sector_size;
+	uint32_t chunk;
+
+	while (len){
+		chunk = ss - (*pos % ss);
+		if (chunk > len)
+			chunk = len;
+
+		if (!w25qxx_ftl_writeAt(ftl, *pos / ss, *pos % ss, data, chunk))
+			return false;
+
+		*pos += chunk;
+		data += chunk;
+		len -= chunk;
+	}
+
+	return true;
+}
+
+
+/* Sectors without current pages, pinned ones become reusable after the next checkpoint */
+static uint32_t w25qxx_ftl_freeCount(w25qxx_ftl_t *ftl, uint32_t *pinned)
+{
+	uint32_t count = 0;
+
+	*pinned = 0;
+	for (uint32_t s = 0; s < ftl->data_sectors; ++s){
+		if (ftl->sector[s].valid != 0)
+			continue;
+		if (ftl->sector[s].flags == 0)
+			count++;
+		else if (ftl->sector[s].flags == FTL_FLAG_PINNED)
+			(*pinned)++;
+	}
+
+	return count;
+}
+
+
+/*
+    Free sector for a head, reserved on return. The hot head takes the least worn
+    one, the cold head the most worn one, as data moved by the collector rarely
+    changes again.
+*/
+static uint32_t w25qxx_ftl_allocate(w25qxx_ftl_t *ftl, uint8_t h)
+{
+	uint32_t best = W25QXX_FTL_NONE;
+
+	for (uint32_t s = 0; s < ftl->data_sectors; ++s){
+		uint32_t ec = ftl->sector[s].erase_count;
+
+		if ((ftl->sector[s].valid != 0) || (ftl->sector[s].flags != 0))
+			continue;
+		if ((best == W25QXX_FTL_NONE) ||
+			((h == FTL_HOT) && (ec < ftl->sector[best].erase_count)) ||
+			((h == FTL_COLD) && (ec > ftl->sector[best].erase_count)))
+			best = s;
+	}
+
+	if (best != W25QXX_FTL_NONE)
+		ftl->sector[best].flags = FTL_FLAG_RESERVED;
+
+	return best;
+}
+
+
+/* Erase the reserved successor of a head and make it the open sector */
+static bool w25qxx_ftl_open(w25qxx_ftl_t *ftl, uint8_t h)
+{
+	w25qxx_ftl_head_t *head = &ftl->head[h];
+	w25qxx_ftl_sector_t *sec;
+	ftl_hdr_t hdr;
+	uint32_t s = head->next;
+
+	if (s == W25QXX_FTL_NONE)
+		s = w25qxx_ftl_allocate(ftl, h);
+	if (s == W25QXX_FTL_NONE)
+		return false;
+
+	// the chain from the last checkpoint must survive until the next one
+	sec = &ftl->sector[s];
+	sec->flags = FTL_FLAG_HEAD | FTL_FLAG_PINNED;
+	head->next = w25qxx_ftl_allocate(ftl, h);
+
+	if (!w25qxx_dev_eraseSector(ftl->dev, ftl->first_sector + s))
+		return false;
+
+	sec->erase_count++;
+	sec->min_wseq = 0;
+	sec->max_wseq = 0;
+	ftl->stats.erases++;
+	ftl->opens++;
+
+	hdr.magic = FTL_MAGIC;
+	hdr.erase_count = sec->erase_count;
+	hdr.open_wseq = ++ftl->wseq;
+	hdr.next = head->next;
+	if (!w25qxx_ftl_writeAt(ftl, s, 0, &hdr, FTL_HDR_SIZE))
+		return false;
+
+	if (head->sector != W25QXX_FTL_NONE)
+		ftl->sector[head->sector].flags &= ~FTL_FLAG_HEAD;
+
+	head->sector = s;
+	head->page = 1;
+
+	return true;
+}
+
+
+/* Point a logical page at a new copy */
+static void w25qxx_ftl_remap(w25qxx_ftl_t *ftl, uint32_t lpn, uint32_t ppn)
+{
+	uint32_t old = ftl->map[lpn];
+
+	if (old != W25QXX_FTL_NONE)
+		ftl->sector[old / FTL_PAGES].valid--;
+
+	ftl->map[lpn] = ppn;
+	ftl->sector[ppn / FTL_PAGES].valid++;
+}
+
+
+/* Append one page to a head: data first, the summary entry commits it */
+static bool w25qxx_ftl_program(w25qxx_ftl_t *ftl, uint8_t h, uint32_t lpn, const uint8_t *data)
+{
+	w25qxx_ftl_head_t *head = &ftl->head[h];
+	uint32_t entry[2];
+	uint32_t s, p;
+
+	if ((head->sector == W25QXX_FTL_NONE) || (head->page > W25QXX_FTL_DATA_PAGES)){
+		if (!w25qxx_ftl_open(ftl, h))
+			return false;
+	}
+
+	s = head->sector;
+	p = head->page++;
+
+	if (!w25qxx_ftl_writeAt(ftl, s, p * ftl->dev->page_size, data, ftl->dev->page_size))
+		return false;
+
+	entry[0] = lpn;
+	entry[1] = ++ftl->wseq;
+	if (!w25qxx_ftl_writeAt(ftl, s, FTL_HDR_SIZE + (p - 1) * FTL_ENTRY_SIZE, entry, FTL_ENTRY_SIZE))
+		return false;
+
+	if (ftl->sector[s].min_wseq == 0)
+		ftl->sector[s].min_wseq = entry[1];
+	ftl->sector[s].max_wseq = entry[1];
+
+	w25qxx_ftl_remap(ftl, lpn, s * FTL_PAGES + p);
+
+	return true;
+}
+
+
+/* Move the current pages of a closed sector to the cold head, the sector becomes free */
+static bool w25qxx_ftl_relocate(w25qxx_ftl_t *ftl, uint32_t victim)
+{
+	ftl_hdr_t hdr;
+
+	if (!w25qxx_ftl_readAt(ftl, victim, 0, &hdr, sizeof(hdr)))
+		return false;
+
+	for (uint32_t p = 1; (p <= W25QXX_FTL_DATA_PAGES) && ftl->sector[victim].valid; ++p){
+		uint32_t lpn = hdr.entry[p - 1].lpn;
+
+		if ((lpn >= ftl->page_count) || (ftl->map[lpn] != victim * FTL_PAGES + p))
+			continue;
+
+		if (!w25qxx_ftl_readAt(ftl, victim, p * ftl->dev->page_size, ftl->page_buf, ftl->dev->page_size))
+			return false;
+		if (!w25qxx_ftl_program(ftl, FTL_COLD, lpn, ftl->page_buf))
+			return false;
+
+		ftl->stats.gc_pages++;
+	}
+
+	return true;
+}
+
+
+/* Greedy victim: closed sector with the fewest current pages */
+static bool w25qxx_ftl_collect(w25qxx_ftl_t *ftl)
+{
+	uint32_t victim = W25QXX_FTL_NONE;
+
+	for (uint32_t s = 0; s < ftl->data_sectors; ++s){
+		w25qxx_ftl_sector_t *sec = &ftl->sector[s];
+
+		if ((sec->flags & (FTL_FLAG_HEAD | FTL_FLAG_RESERVED)) || (sec->valid == 0) || (sec->valid >= W25QXX_FTL_DATA_PAGES))
+			continue;
+		if ((victim == W25QXX_FTL_NONE) || (sec->valid < ftl->sector[victim].valid))
+			victim = s;
+	}
+
+	if (victim == W25QXX_FTL_NONE)
+		return false;
+
+	return w25qxx_ftl_relocate(ftl, victim);
+}
+
+
+/* Static wear leveling: free the least worn sector if it holds data that never changes */
+static bool w25qxx_ftl_wearLevel(w25qxx_ftl_t *ftl, bool *moved)
+{
+	uint32_t min_s = W25QXX_FTL_NONE;
+	uint32_t max_ec = 0;
+	uint32_t pinned;
+
+	*moved = false;
+
+	// moving a full sector needs room on the cold head
+	if (w25qxx_ftl_freeCount(ftl, &pinned) < W25QXX_FTL_GC_LOW)
+		return true;
+
+	for (uint32_t s = 0; s < ftl->data_sectors; ++s){
+		w25qxx_ftl_sector_t *sec = &ftl->sector[s];
+
+		if (sec->erase_count > max_ec)
+			max_ec = sec->erase_count;
+		if (!(sec->flags & (FTL_FLAG_HEAD | FTL_FLAG_RESERVED)) && (sec->valid != 0) &&
+			((min_s == W25QXX_FTL_NONE) || (sec->erase_count < ftl->sector[min_s].erase_count)))
+			min_s = s;
+	}
+
+	if ((min_s == W25QXX_FTL_NONE) || ((max_ec - ftl->sector[min_s].erase_count) <= W25QXX_FTL_WEAR_DELTA))
+		return true;
+
+	*moved = true;
+	ftl->stats.wear_moves++;
+
+	return w25qxx_ftl_relocate(ftl, min_s);
+}
+
+
+static void w25qxx_ftl_geometry(w25qxx_ftl_t *ftl, uint32_t sector_count)
+{
+	uint32_t ss = ftl->dev->sector_size;
+	uint32_t ckpt_bytes = ftl->dev->page_size + W25QXX_FTL_MAP_ENTRIES(sector_count) * 4 + sector_count * 4;
+	uint32_t reserve;
+
+	ftl->ckpt_sectors = (ckpt_bytes + ss - 1) / ss;
+	ftl->data_sectors = sector_count - 2 * ftl->ckpt_sectors;
+
+	// over provisioning keeps garbage collection cheap
+	reserve = W25QXX_FTL_GC_LOW + 5 + ftl->data_sectors / 16;
+	if (ftl->data_sectors <= reserve){
+		ftl->data_sectors = 0;
+		return;
+	}
+
+	ftl->sector_count = ((ftl->data_sectors - reserve) * W25QXX_FTL_DATA_PAGES) / FTL_PAGES;
+	ftl->page_count = ftl->sector_count * FTL_PAGES;
+	ftl->capacity_kb = (ftl->page_count * ftl->dev->page_size) / 1024;
+}
+
+
+/* Mount time: keep the newer of two copies of a logical page */
+static bool w25qxx_ftl_apply(w25qxx_ftl_t *ftl, uint32_t lpn, uint32_t ppn, uint32_t wseq)
+{
+	uint32_t old = ftl->map[lpn];
+	w25qxx_ftl_sector_t *old_sec;
+	uint32_t old_wseq;
+
+	if (old != W25QXX_FTL_NONE){
+		old_sec = &ftl->sector[old / FTL_PAGES];
+
+		if ((old / FTL_PAGES) == (ppn / FTL_PAGES)){
+			if (old > ppn)
+				return true;
+		}else if (old_sec->min_wseq > wseq){
+			return true;
+		}else if (old_sec->max_wseq >= wseq){
+			// write ranges of both heads overlap, ask the flash
+			if (!w25qxx_ftl_readAt(ftl, old / FTL_PAGES, FTL_HDR_SIZE + ((old % FTL_PAGES) - 1) * FTL_ENTRY_SIZE + 4,
+									&old_wseq, sizeof(old_wseq)))
+				return false;
+			if (old_wseq > wseq)
+				return true;
+		}
+	}
+
+	w25qxx_ftl_remap(ftl, lpn, ppn);
+
+	return true;
+}
+
+
+/* Apply the entries of one sector newer than after_wseq, returns the first unused data page */
+static bool w25qxx_ftl_replay(w25qxx_ftl_t *ftl, uint32_t s, const ftl_hdr_t *hdr, uint32_t after_wseq, uint32_t *fill)
+{
+	w25qxx_ftl_sector_t *sec = &ftl->sector[s];
+
+	sec->erase_count = hdr->erase_count;
+	sec->min_wseq = 0;
+	sec->max_wseq = 0;
+	if (hdr->open_wseq > ftl->wseq)
+		ftl->wseq = hdr->open_wseq;
+
+	*fill = 1;
+	for (uint32_t p = 1; p <= W25QXX_FTL_DATA_PAGES; ++p){
+		uint32_t lpn = hdr->entry[p - 1].lpn;
+		uint32_t wseq = hdr->entry[p - 1].wseq;
+
+		if ((lpn == W25QXX_FTL_NONE) && (wseq == W25QXX_FTL_NONE))
+			continue;
+		*fill = p + 1;
+
+		if ((lpn >= ftl->page_count) || (wseq == W25QXX_FTL_NONE))
+			continue;
+
+		if (sec->min_wseq == 0)
+			sec->min_wseq = wseq;
+		sec->max_wseq = wseq;
+		if (wseq > ftl->wseq)
+			ftl->wseq = wseq;
+	}
+
+	for (uint32_t p = 1; p <= W25QXX_FTL_DATA_PAGES; ++p){
+		uint32_t lpn = hdr->entry[p - 1].lpn;
+		uint32_t wseq = hdr->entry[p - 1].wseq;
+
+		if ((lpn >= ftl->page_count) || (wseq == W25QXX_FTL_NONE) || (wseq <= after_wseq))
+			continue;
+		if (!w25qxx_ftl_apply(ftl, lpn, s * FTL_PAGES + p, wseq))
+			return false;
+	}
+
+	return true;
+}
+
+
+/* Rebuild the map from every sector header */
+static bool w25qxx_ftl_scan(w25qxx_ftl_t *ftl)
+{
+	ftl_hdr_t hdr;
+	uint32_t fill;
+
+	for (uint32_t s = 0; s < ftl->data_sectors; ++s){
+		if (!w25qxx_ftl_readAt(ftl, s, 0, &hdr, sizeof(hdr)))
+			return false;
+		if (hdr.magic != FTL_MAGIC)
+			continue;
+		if (!w25qxx_ftl_replay(ftl, s, &hdr, 0, &fill))
+			return false;
+	}
+
+	for (uint8_t h = 0; h < 2; ++h){
+		ftl->head[h].sector = W25QXX_FTL_NONE;
+		ftl->head[h].next = w25qxx_ftl_allocate(ftl, h);
+	}
+
+	// anchor the heads, later mounts replay from here
+	return w25qxx_ftl_sync(ftl);
+}
+
+
+/* Continue a head after the checkpoint: follow its chain of sectors opened later */
+static bool w25qxx_ftl_replayHead(w25qxx_ftl_t *ftl, uint8_t h, uint32_t ckpt_sector, uint32_t ckpt_next, uint32_t ckpt_wseq)
+{
+	w25qxx_ftl_head_t *head = &ftl->head[h];
+	uint32_t cur = (ckpt_sector != W25QXX_FTL_NONE) ? ckpt_sector : ckpt_next;
+	uint32_t last_open = 0;
+	ftl_hdr_t hdr;
+	uint32_t fill;
+
+	head->sector = ckpt_sector;
+	head->page = W25QXX_FTL_DATA_PAGES + 1;
+	head->next = ckpt_next;
+
+	while ((cur != W25QXX_FTL_NONE) && (cur < ftl->data_sectors)){
+		if (!w25qxx_ftl_readAt(ftl, cur, 0, &hdr, sizeof(hdr)))
+			return false;
+
+		if (hdr.magic != FTL_MAGIC)
+			break;
+		if ((cur != ckpt_sector) && ((hdr.open_wseq <= ckpt_wseq) || (hdr.open_wseq <= last_open)))
+			break;
+
+		if (!w25qxx_ftl_replay(ftl, cur, &hdr, ckpt_wseq, &fill))
+			return false;
+
+		// still needed by a mount from the same checkpoint
+		ftl->sector[cur].flags |= FTL_FLAG_PINNED;
+
+		last_open = hdr.open_wseq;
+		head->sector = cur;
+		head->page = fill;
+		head->next = hdr.next;
+		cur = hdr.next;
+	}
+
+	// a page torn before its entry was written cannot be programmed again
+	while ((head->sector != W25QXX_FTL_NONE) && (head->page <= W25QXX_FTL_DATA_PAGES)){
+		uint32_t i;
+
+		if (!w25qxx_ftl_readAt(ftl, head->sector, head->page * ftl->dev->page_size, ftl->page_buf, ftl->dev->page_size))
+			return false;
+		for (i = 0; (i < ftl->dev->page_size) && (ftl->page_buf[i] == 0xFF); ++i)
+			;
+		if (i == ftl->dev->page_size)
+			break;
+		head->page++;
+	}
+
+	return true;
+}
+
+
+/* Load the newest checkpoint that verifies, then replay the heads */
+static bool w25qxx_ftl_loadCheckpoint(w25qxx_ftl_t *ftl, bool *loaded)
+{
+	uint32_t ss = ftl->dev->sector_size;
+	ftl_ckpt_t ckpt[2];
+	uint8_t order[2] = {0, 1};
+
+	*loaded = false;
+
+	for (uint8_t slot = 0; slot < 2; ++slot){
+		if (!w25qxx_ftl_readAt(ftl, ftl->data_sectors + slot * ftl->ckpt_sectors, 0, &ckpt[slot], sizeof(ckpt[slot])))
+			return false;
+		if ((ckpt[slot].magic == FTL_CKPT_MAGIC) && (ckpt[slot].seq > ftl->ckpt_seq) && (ckpt[slot].seq != W25QXX_FTL_NONE))
+			ftl->ckpt_seq = ckpt[slot].seq;
+	}
+
+	if ((ckpt[1].magic == FTL_CKPT_MAGIC) && ((ckpt[0].magic != FTL_CKPT_MAGIC) || (ckpt[1].seq > ckpt[0].seq))){
+		order[0] = 1;
+		order[1] = 0;
+	}
+
+	for (uint8_t i = 0; i < 2; ++i){
+		uint8_t slot = order[i];
+		ftl_ckpt_t *c = &ckpt[slot];
+		uint32_t base = (ftl->first_sector + ftl->data_sectors + slot * ftl->ckpt_sectors) * ss;
+		uint32_t sum = 2166136261u;
+
+		if ((c->magic != FTL_CKPT_MAGIC) || (c->data_sectors != ftl->data_sectors) || (c->page_count != ftl->page_count))
+			continue;
+
+		if (!w25qxx_dev_read(ftl->dev, base + ftl->dev->page_size, (uint8_t *)ftl->map, ftl->page_count * 4))
+			return false;
+		sum = w25qxx_ftl_sum(sum, (uint8_t *)ftl->map, ftl->page_count * 4);
+
+		for (uint32_t s = 0; s < ftl->data_sectors; s += 64){
+			uint32_t n = ((ftl->data_sectors - s) < 64) ? (ftl->data_sectors - s) : 64;
+			uint32_t ec[64];
+
+			if (!w25qxx_dev_read(ftl->dev, base + ftl->dev->page_size + ftl->page_count * 4 + s * 4, (uint8_t *)ec, n * 4))
+				return false;
+			sum = w25qxx_ftl_sum(sum, (uint8_t *)ec, n * 4);
+
+			for (uint32_t k = 0; k < n; ++k)
+				ftl->sector[s + k].erase_count = ec[k];
+		}
+
+		if (sum != c->sum)
+			continue;
+
+		for (uint32_t s = 0; s < ftl->data_sectors; ++s){
+			ftl->sector[s].valid = 0;
+			ftl->sector[s].flags = 0;
+			ftl->sector[s].min_wseq = 0;
+			ftl->sector[s].max_wseq = 0;
+		}
+		for (uint32_t lpn = 0; lpn < ftl->page_count; ++lpn){
+			if (ftl->map[lpn] != W25QXX_FTL_NONE)
+				ftl->sector[ftl->map[lpn] / FTL_PAGES].valid++;
+		}
+
+		ftl->wseq = c->wseq;
+		ftl->ckpt_slot = slot;
+
+		for (uint8_t h = 0; h < 2; ++h){
+			if (!w25qxx_ftl_replayHead(ftl, h, c->head_sector[h], c->head_next[h], c->wseq))
+				return false;
+		}
+
+		for (uint8_t h = 0; h < 2; ++h){
+			if (ftl->head[h].sector != W25QXX_FTL_NONE)
+				ftl->sector[ftl->head[h].sector].flags |= FTL_FLAG_HEAD;
+			if (ftl->head[h].next != W25QXX_FTL_NONE)
+				ftl->sector[ftl->head[h].next].flags = FTL_FLAG_RESERVED;
+		}
+
+		*loaded = true;
+		return true;
+	}
+
+	return true;
+}
+
+
+/**
+  * @brief  mount a region, from the newest checkpoint when possible
+  * @param  *ftl: [out] translation layer
+  * @param  *dev: [in] device after w25qxx_dev_init, 256 byte pages and 4KB sectors
+  * @param  first_sector: [in] first physical sector of the region
+  * @param  sector_count: [in] sectors in the region
+  * @param  *map: [in] W25QXX_FTL_MAP_ENTRIES(sector_count) entries
+  * @param  *sectors: [in] sector_count entries
+  * @retval status 1:passed  0:failed
+  */
+bool w25qxx_ftl_mount(w25qxx_ftl_t *ftl, w25qxx_dev_t *dev, uint32_t first_sector, uint32_t sector_count,
+						uint32_t *map, w25qxx_ftl_sector_t *sectors)
+{
+	bool loaded;
+
+	if ((dev->page_size != sizeof(ftl->page_buf)) || (dev->sector_size != FTL_PAGES * dev->page_size) ||
+		(first_sector >= dev->sector_count) || (sector_count > (dev->sector_count - first_sector)))
+		return false;
+
+	memset(ftl, 0, sizeof(*ftl));
+	ftl->dev = dev;
+	ftl->first_sector = first_sector;
+	ftl->map = map;
+	ftl->sector = sectors;
+
+	w25qxx_ftl_geometry(ftl, sector_count);
+	if (ftl->data_sectors == 0)
+		return false;
+
+	memset(map, 0xFF, ftl->page_count * sizeof(*map));
+	memset(sectors, 0, ftl->data_sectors * sizeof(*sectors));
+
+	if (!w25qxx_ftl_loadCheckpoint(ftl, &loaded))
+		return false;
+
+	if (loaded)
+		return true;
+
+	memset(map, 0xFF, ftl->page_count * sizeof(*map));
+	memset(sectors, 0, ftl->data_sectors * sizeof(*sectors));
+	ftl->wseq = 0;
+
+	return w25qxx_ftl_scan(ftl);
+}
+
+
+/**
+  * @brief  erase the region and mount it empty
+  * @retval status 1:passed  0:failed
+  */
+bool w25qxx_ftl_format(w25qxx_ftl_t *ftl, w25qxx_dev_t *dev, uint32_t first_sector, uint32_t sector_count,
+						uint32_t *map, w25qxx_ftl_sector_t *sectors)
+{
+	if ((first_sector >= dev->sector_count) || (sector_count > (dev->sector_count - first_sector)))
+		return false;
+
+	if (!w25qxx_dev_erase(dev, first_sector * dev->sector_size, sector_count * dev->sector_size))
+		return false;
+
+	return w25qxx_ftl_mount(ftl, dev, first_sector, sector_count, map, sectors);
+}
+
+
+/**
+  * @brief  write the map and erase counts to the older checkpoint slot
+  * @retval status 1:passed  0:failed
+  */
+bool w25qxx_ftl_sync(w25qxx_ftl_t *ftl)
+{
+	uint32_t ss = ftl->dev->sector_size;
+	uint8_t slot = ftl->ckpt_slot ^ 1;
+	uint32_t base = ftl->data_sectors + slot * ftl->ckpt_sectors;
+	uint32_t pos = base * ss + ftl->dev->page_size;
+	ftl_ckpt_t c;
+
+	if (!w25qxx_dev_erase(ftl->dev, (ftl->first_sector + base) * ss, ftl->ckpt_sectors * ss))
+		return false;
+
+	c.sum = w25qxx_ftl_sum(2166136261u, (uint8_t *)ftl->map, ftl->page_count * 4);
+	if (!w25qxx_ftl_put(ftl, &pos, (uint8_t *)ftl->map, ftl->page_count * 4))
+		return false;
+
+	for (uint32_t s = 0; s < ftl->data_sectors; s += 64){
+		uint32_t n = ((ftl->data_sectors - s) < 64) ? (ftl->data_sectors - s) : 64;
+		uint32_t ec[64];
+
+		for (uint32_t k = 0; k < n; ++k)
+			ec[k] = ftl->sector[s + k].erase_count;
+
+		c.sum = w25qxx_ftl_sum(c.sum, (uint8_t *)ec, n * 4);
+		if (!w25qxx_ftl_put(ftl, &pos, (uint8_t *)ec, n * 4))
+			return false;
+	}
+
+	// the header goes last, a torn checkpoint never verifies
+	c.magic = FTL_CKPT_MAGIC;
+	c.seq = ++ftl->ckpt_seq;
+	c.wseq = ftl->wseq;
+	c.data_sectors = ftl->data_sectors;
+	c.page_count = ftl->page_count;
+	for (uint8_t h = 0; h < 2; ++h){
+		c.head_sector[h] = ftl->head[h].sector;
+		c.head_next[h] = ftl->head[h].next;
+	}
+
+	if (!w25qxx_ftl_writeAt(ftl, base, 0, &c, sizeof(c)))
+		return false;
+
+	ftl->ckpt_slot = slot;
+
+	// the heads are where the next mount starts replaying
+	for (uint32_t s = 0; s < ftl->data_sectors; ++s)
+		ftl->sector[s].flags &= ~FTL_FLAG_PINNED;
+	for (uint8_t h = 0; h < 2; ++h){
+		if (ftl->head[h].sector != W25QXX_FTL_NONE)
+			ftl->sector[ftl->head[h].sector].flags |= FTL_FLAG_PINNED;
+	}
+
+	return true;
+}
+
+
+/**
+  * @brief  read the logical space
+  * @param  addr: [in] logical byte address
+  * @param  *buff: [out] receive bytes
+  * @param  len: [in] byte number, clamped to the end of the logical space
+  * @retval status 1:passed  0:failed
+  */
+bool w25qxx_ftl_read(w25qxx_ftl_t *ftl, uint32_t addr, uint8_t *buff, uint32_t len)
+{
+	uint32_t ps = ftl->dev->page_size;
+	uint32_t capacity = ftl->page_count * ps;
+	uint32_t chunk, ppn;
+
+	if ((len == 0) || (addr >= capacity))
+		return false;
+
+	if (len > (capacity - addr))
+		len = capacity - addr;
+
+	while (len){
+		chunk = ps - (addr % ps);
+		if (chunk > len)
+			chunk = len;
+
+		ppn = ftl->map[addr / ps];
+		if (ppn == W25QXX_FTL_NONE){
+			memset(buff, 0xFF, chunk);
+		}else if (!w25qxx_ftl_readAt(ftl, ppn / FTL_PAGES, (ppn % FTL_PAGES) * ps + (addr % ps), buff, chunk)){
+			return false;
+		}
+
+		addr += chunk;
+		buff += chunk;
+		len -= chunk;
+	}
+
+	return true;
+}
+
+
+/**
+  * @brief  write the logical space, every touched page is appended to the hot head
+  * @param  addr: [in] logical byte address
+  * @param  *buff: [in] data
+  * @param  len: [in] byte number, clamped to the end of the logical space
+  * @retval status 1:passed  0:failed
+  */
+bool w25qxx_ftl_write(w25qxx_ftl_t *ftl, uint32_t addr, const uint8_t *buff, uint32_t len)
+{
+	uint32_t ps = ftl->dev->page_size;
+	uint32_t capacity = ftl->page_count * ps;
+	uint32_t chunk, pinned;
+	bool moved;
+
+	if ((len == 0) || (addr >= capacity))
+		return false;
+
+	if (len > (capacity - addr))
+		len = capacity - addr;
+
+	while (len){
+		const uint8_t *src = buff;
+
+		chunk = ps - (addr % ps);
+		if (chunk > len)
+			chunk = len;
+
+		// foreground collection only when the free pool runs dry
+		while (w25qxx_ftl_freeCount(ftl, &pinned) < W25QXX_FTL_GC_LOW){
+			if (pinned ? !w25qxx_ftl_sync(ftl) : !w25qxx_ftl_collect(ftl))
+				return false;
+		}
+
+		if (chunk != ps){
+			if (!w25qxx_ftl_read(ftl, addr - (addr % ps), ftl->page_buf, ps))
+				return false;
+			memcpy(ftl->page_buf + (addr % ps), buff, chunk);
+			src = ftl->page_buf;
+		}
+
+		if (!w25qxx_ftl_program(ftl, FTL_HOT, addr / ps, src))
+			return false;
+		ftl->stats.host_pages++;
+
+		if (ftl->opens >= W25QXX_FTL_WEAR_INTERVAL){
+			ftl->opens = 0;
+			if (!w25qxx_ftl_wearLevel(ftl, &moved))
+				return false;
+		}
+
+		addr += chunk;
+		buff += chunk;
+		len -= chunk;
+	}
+
+	return true;
+}
+
+
+/**
+  * @brief  background work: reclaim a sector while the free pool is below a
+  *         quarter of the spare sectors, or move cold data off a young sector
+  * @retval 1: work done  0: nothing to do or failed
+  */
+bool w25qxx_ftl_idle(w25qxx_ftl_t *ftl)
+{
+	uint32_t spare = ftl->data_sectors - (ftl->page_count / W25QXX_FTL_DATA_PAGES);
+	uint32_t pinned;
+	bool moved = false;
+
+	if (w25qxx_ftl_freeCount(ftl, &pinned) < W25QXX_FTL_GC_LOW + spare / 4)
+		return w25qxx_ftl_collect(ftl);
+
+	if (ftl->opens >= W25QXX_FTL_WEAR_INTERVAL){
+		ftl->opens = 0;
+		if (!w25qxx_ftl_wearLevel(ftl, &moved))
+			return false;
+	}
+
+	return moved;
+}
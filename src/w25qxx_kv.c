@@ -0,0 +1,580 @@
+#include <stdint.h>
+#include <string.h>
+#include "w25qxx_kv.h"
+
+#define KV_MAGIC                0x3156564B      // "KVV1"
+#define KV_SEG_HEADER           8
+
+#define KV_TYPE_SET             0x01
+#define KV_TYPE_DELETE          0x00
+
+#define KV_EMPTY                0xFFFFFFFF
+#define KV_DELETED              0xFFFFFFFE
+
+enum{
+	KV_SEG_FREE = 0,        // no header, contents unknown
+	KV_SEG_ERASED,          // no header, blank
+	KV_SEG_USED,
+};
+
+typedef struct
+{
+    uint8_t  key_len;       // 0xFF: rest of the page is unused
+    uint8_t  type;
+    uint16_t val_len;
+    uint32_t crc;           // header bytes 0-3, key and value
+
+}kv_record_t;
+
+
+static uint32_t w25qxx_kv_hash(const char *key, uint8_t len)
+{
+	// FNV-1a
+	uint32_t hash = 2166136261u;
+
+	while (len--){
+		hash ^= (uint8_t)*key++;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+
+static uint32_t w25qxx_kv_segAddr(w25qxx_kv_t *kv, uint8_t seg)
+{
+	return (kv->first_sector + seg) * kv->dev->sector_size;
+}
+
+
+/* Record in buf is intact */
+static bool w25qxx_kv_check(const uint8_t *rec, uint32_t room)
+{
+	kv_record_t hdr;
+	uint32_t size;
+
+	memcpy(&hdr, rec, sizeof(hdr));
+	size = W25QXX_KV_RECORD_HEADER + hdr.key_len + hdr.val_len;
+
+	if ((hdr.key_len == 0) || (hdr.key_len > W25QXX_KV_KEY_MAX) || (size > room) ||
+		((hdr.type != KV_TYPE_SET) && (hdr.type != KV_TYPE_DELETE)))
+		return false;
+
+	return w25qxx_crc32Update(w25qxx_crc32Update(0, rec, 4), rec + W25QXX_KV_RECORD_HEADER, hdr.key_len + hdr.val_len) == hdr.crc;
+}
+
+
+/*
+    Slot of a key, or where it would go. On a hit the record is left in kv->buf,
+    so a lookup costs the one read that also confirms the key. A failed read
+    proves nothing about the key and is reported as an error, not a miss.
+*/
+static w25qxx_kv_status_t w25qxx_kv_find(w25qxx_kv_t *kv, const char *key, uint8_t key_len, uint32_t hash, uint32_t *slot)
+{
+	uint32_t mask = kv->index_size - 1;
+	uint32_t free_slot = KV_EMPTY;
+
+	for (uint32_t n = 0, i = hash & mask; n < kv->index_size; ++n, i = (i + 1) & mask){
+		w25qxx_kv_entry_t *e = &kv->index[i];
+
+		if (e->addr == KV_EMPTY){
+			*slot = (free_slot != KV_EMPTY) ? free_slot : i;
+			return W25QXX_KV_NOT_FOUND;
+		}
+
+		if (e->addr == KV_DELETED){
+			if (free_slot == KV_EMPTY)
+				free_slot = i;
+			continue;
+		}
+
+		if ((e->hash != hash) || (e->len < W25QXX_KV_RECORD_HEADER + key_len))
+			continue;
+
+		if (!w25qxx_dev_read(kv->dev, e->addr, kv->buf, e->len))
+			return W25QXX_KV_ERROR;
+		if ((kv->buf[0] == key_len) && (memcmp(kv->buf + W25QXX_KV_RECORD_HEADER, key, key_len) == 0)){
+			*slot = i;
+			return W25QXX_KV_OK;
+		}
+	}
+
+	*slot = free_slot;
+	return W25QXX_KV_NOT_FOUND;
+}
+
+
+static bool w25qxx_kv_indexSet(w25qxx_kv_t *kv, const char *key, uint8_t key_len, uint32_t addr, uint16_t len)
+{
+	uint32_t hash = w25qxx_kv_hash(key, key_len);
+	w25qxx_kv_status_t status;
+	uint32_t slot;
+
+	status = w25qxx_kv_find(kv, key, key_len, hash, &slot);
+	if (status == W25QXX_KV_ERROR)
+		return false;
+
+	if (status == W25QXX_KV_NOT_FOUND){
+		if (slot == KV_EMPTY)
+			return false;
+		if (kv->index[slot].addr == KV_EMPTY){
+			// keep one empty slot so probing always terminates
+			if (kv->used + 1 >= kv->index_size)
+				return false;
+			kv->used++;
+		}
+		kv->count++;
+	}
+
+	kv->index[slot].hash = hash;
+	kv->index[slot].addr = addr;
+	kv->index[slot].len = len;
+
+	return true;
+}
+
+
+static bool w25qxx_kv_indexDelete(w25qxx_kv_t *kv, const char *key, uint8_t key_len)
+{
+	uint32_t slot;
+
+	switch (w25qxx_kv_find(kv, key, key_len, w25qxx_kv_hash(key, key_len), &slot)){
+		case W25QXX_KV_OK:
+			kv->index[slot].addr = KV_DELETED;
+			kv->count--;
+			return true;
+		case W25QXX_KV_NOT_FOUND:
+			return true;
+		default:
+			return false;
+	}
+}
+
+
+/* Apply one record found in a segment to the index */
+static bool w25qxx_kv_replay(w25qxx_kv_t *kv, uint32_t addr, const uint8_t *rec)
+{
+	kv_record_t hdr;
+	char key[W25QXX_KV_KEY_MAX];
+
+	memcpy(&hdr, rec, sizeof(hdr));
+	memcpy(key, rec + W25QXX_KV_RECORD_HEADER, hdr.key_len);
+
+	if (hdr.type == KV_TYPE_DELETE)
+		return w25qxx_kv_indexDelete(kv, key, hdr.key_len);
+
+	return w25qxx_kv_indexSet(kv, key, hdr.key_len, addr, W25QXX_KV_RECORD_HEADER + hdr.key_len + hdr.val_len);
+}
+
+
+/*
+    Walk the records of a segment page by page, calling replay for each one when
+    replay is set. Returns the append position: after the last record, or the next
+    page if a torn record was found.
+*/
+static bool w25qxx_kv_scan(w25qxx_kv_t *kv, uint8_t seg, bool replay, uint32_t *end)
+{
+	uint32_t ps = kv->dev->page_size;
+	uint32_t base = w25qxx_kv_segAddr(kv, seg);
+	uint8_t  page[256];
+
+	*end = base + KV_SEG_HEADER;
+
+	for (uint32_t off = 0; off < kv->dev->sector_size; off += ps){
+		uint32_t pos = (off == 0) ? KV_SEG_HEADER : 0;
+
+		if (!w25qxx_dev_read(kv->dev, base + off, page, ps))
+			return false;
+
+		while ((pos + W25QXX_KV_RECORD_HEADER) <= ps){
+			uint32_t size;
+
+			if (page[pos] == 0xFF)
+				break;
+
+			if (!w25qxx_kv_check(page + pos, ps - pos)){
+				// torn append, the rest of this page is not used again
+				*end = base + off + ps;
+				break;
+			}
+
+			size = W25QXX_KV_RECORD_HEADER + page[pos] + (page[pos + 2] | (page[pos + 3] << 8));
+
+			// keep the bytes in kv->buf, replay may overwrite page through find()
+			memcpy(kv->buf, page + pos, size);
+			if (replay && !w25qxx_kv_replay(kv, base + off + pos, kv->buf))
+				return false;
+
+			pos += size;
+			*end = base + off + pos;
+		}
+	}
+
+	return true;
+}
+
+
+static bool w25qxx_kv_openSegment(w25qxx_kv_t *kv, uint8_t seg)
+{
+	uint32_t hdr[2];
+
+	if (kv->seg_state[seg] != KV_SEG_ERASED){
+		if (!w25qxx_dev_eraseSector(kv->dev, kv->first_sector + seg))
+			return false;
+	}
+
+	hdr[0] = KV_MAGIC;
+	hdr[1] = ++kv->seq;
+	if (!w25qxx_dev_writePage(kv->dev, (uint8_t *)hdr, w25qxx_kv_segAddr(kv, seg) / kv->dev->page_size, 0, sizeof(hdr)))
+		return false;
+
+	kv->seg_state[seg] = KV_SEG_USED;
+	kv->seg_seq[seg] = kv->seq;
+	kv->active = seg;
+	kv->write_addr = w25qxx_kv_segAddr(kv, seg) + KV_SEG_HEADER;
+
+	return true;
+}
+
+
+/* Next page aligned position a record of size bytes fits at, KV_EMPTY if the active segment is full */
+static uint32_t w25qxx_kv_place(w25qxx_kv_t *kv, uint32_t size)
+{
+	uint32_t ps = kv->dev->page_size;
+	uint32_t addr = kv->write_addr;
+	uint32_t seg_end;
+
+	if (kv->active == W25QXX_KV_NO_SEGMENT)
+		return KV_EMPTY;
+
+	seg_end = w25qxx_kv_segAddr(kv, kv->active) + kv->dev->sector_size;
+
+	if ((addr % ps) + size > ps)
+		addr += ps - (addr % ps);
+
+	return ((addr + size) <= seg_end) ? addr : KV_EMPTY;
+}
+
+
+static bool w25qxx_kv_program(w25qxx_kv_t *kv, uint32_t addr, const uint8_t *rec, uint32_t size)
+{
+	uint32_t ps = kv->dev->page_size;
+
+	if (!w25qxx_dev_writePage(kv->dev, rec, addr / ps, addr % ps, size))
+		return false;
+
+	kv->write_addr = addr + size;
+
+	return true;
+}
+
+
+/* Copy the live records of the oldest segment into the spare and erase it */
+static bool w25qxx_kv_compact(w25qxx_kv_t *kv, uint8_t spare)
+{
+	uint8_t victim = W25QXX_KV_NO_SEGMENT;
+	uint32_t base;
+	uint8_t rec[256];
+
+	for (uint8_t s = 0; s < kv->segment_count; ++s){
+		if ((kv->seg_state[s] == KV_SEG_USED) &&
+			((victim == W25QXX_KV_NO_SEGMENT) || (kv->seg_seq[s] < kv->seg_seq[victim])))
+			victim = s;
+	}
+
+	if (victim == W25QXX_KV_NO_SEGMENT)
+		return false;
+
+	if (!w25qxx_kv_openSegment(kv, spare))
+		return false;
+
+	base = w25qxx_kv_segAddr(kv, victim);
+	for (uint32_t i = 0; i < kv->index_size; ++i){
+		w25qxx_kv_entry_t *e = &kv->index[i];
+		uint32_t addr;
+
+		if ((e->addr >= KV_DELETED) || (e->addr < base) || (e->addr >= base + kv->dev->sector_size))
+			continue;
+
+		// only current records are indexed, tombstones of the oldest segment have nothing left to hide
+		if (!w25qxx_dev_read(kv->dev, e->addr, rec, e->len))
+			return false;
+
+		addr = w25qxx_kv_place(kv, e->len);
+		if ((addr == KV_EMPTY) || !w25qxx_kv_program(kv, addr, rec, e->len))
+			return false;
+
+		e->addr = addr;
+	}
+
+	if (!w25qxx_dev_eraseSector(kv->dev, kv->first_sector + victim))
+		return false;
+
+	kv->seg_state[victim] = KV_SEG_ERASED;
+	kv->compactions++;
+
+	return true;
+}
+
+
+/* Make room for a record, moving to a new segment or compacting */
+static uint32_t w25qxx_kv_reserve(w25qxx_kv_t *kv, uint32_t size)
+{
+	uint32_t addr = w25qxx_kv_place(kv, size);
+	uint8_t free_count = 0;
+	uint8_t next = W25QXX_KV_NO_SEGMENT;
+
+	if (addr != KV_EMPTY)
+		return addr;
+
+	// free segments in ring order after the active one
+	for (uint8_t i = 1; i <= kv->segment_count; ++i){
+		uint8_t s = (kv->active == W25QXX_KV_NO_SEGMENT) ? (i - 1) : ((kv->active + i) % kv->segment_count);
+
+		if (kv->seg_state[s] == KV_SEG_USED)
+			continue;
+		if (next == W25QXX_KV_NO_SEGMENT)
+			next = s;
+		free_count++;
+	}
+
+	if (next == W25QXX_KV_NO_SEGMENT)
+		return KV_EMPTY;
+
+	if (free_count > 1){
+		if (!w25qxx_kv_openSegment(kv, next))
+			return KV_EMPTY;
+	}else if (!w25qxx_kv_compact(kv, next)){
+		return KV_EMPTY;
+	}
+
+	return w25qxx_kv_place(kv, size);
+}
+
+
+/**
+  * @brief  mount a region and rebuild the index
+  * @param  *kv: [out] store
+  * @param  *dev: [in] device after w25qxx_dev_init
+  * @param  first_sector: [in] first sector of the region
+  * @param  sector_count: [in] 2 ~ W25QXX_KV_MAX_SEGMENTS
+  * @param  *index: [in] index_size entries
+  * @param  index_size: [in] power of two
+  * @retval status 1:passed  0:failed
+  */
+bool w25qxx_kv_mount(w25qxx_kv_t *kv, w25qxx_dev_t *dev, uint32_t first_sector, uint8_t sector_count,
+						w25qxx_kv_entry_t *index, uint32_t index_size)
+{
+	uint8_t order[W25QXX_KV_MAX_SEGMENTS];
+	uint8_t used = 0;
+	uint32_t hdr[2];
+	uint32_t end = 0;
+
+	if ((sector_count < 2) || (sector_count > W25QXX_KV_MAX_SEGMENTS) || (dev->page_size > sizeof(kv->buf)) ||
+		(first_sector >= dev->sector_count) || (sector_count > (dev->sector_count - first_sector)) ||
+		(index_size < 2) || (index_size & (index_size - 1)))
+		return false;
+
+	memset(kv, 0, sizeof(*kv));
+	kv->dev = dev;
+	kv->first_sector = first_sector;
+	kv->segment_count = sector_count;
+	kv->index = index;
+	kv->index_size = index_size;
+	kv->active = W25QXX_KV_NO_SEGMENT;
+
+	for (uint32_t i = 0; i < index_size; ++i)
+		index[i].addr = KV_EMPTY;
+
+	for (uint8_t s = 0; s < sector_count; ++s){
+		if (!w25qxx_dev_read(dev, w25qxx_kv_segAddr(kv, s), (uint8_t *)hdr, sizeof(hdr)))
+			return false;
+
+		if (hdr[0] != KV_MAGIC){
+			kv->seg_state[s] = KV_SEG_FREE;
+			continue;
+		}
+
+		kv->seg_state[s] = KV_SEG_USED;
+		kv->seg_seq[s] = hdr[1];
+		if (hdr[1] > kv->seq)
+			kv->seq = hdr[1];
+
+		// insertion sort by sequence
+		uint8_t i = used++;
+		while ((i > 0) && (kv->seg_seq[order[i - 1]] > hdr[1])){
+			order[i] = order[i - 1];
+			i--;
+		}
+		order[i] = s;
+	}
+
+	for (uint8_t i = 0; i < used; ++i){
+		if (!w25qxx_kv_scan(kv, order[i], true, &end))
+			return false;
+	}
+
+	if (used){
+		kv->active = order[used - 1];
+		kv->write_addr = end;
+	}
+
+	return true;
+}
+
+
+/**
+  * @brief  erase the region and mount it empty
+  * @retval status 1:passed  0:failed
+  */
+bool w25qxx_kv_format(w25qxx_kv_t *kv, w25qxx_dev_t *dev, uint32_t first_sector, uint8_t sector_count,
+						w25qxx_kv_entry_t *index, uint32_t index_size)
+{
+	if ((first_sector >= dev->sector_count) || (sector_count > (dev->sector_count - first_sector)))
+		return false;
+
+	if (!w25qxx_dev_erase(dev, first_sector * dev->sector_size, sector_count * dev->sector_size))
+		return false;
+
+	if (!w25qxx_kv_mount(kv, dev, first_sector, sector_count, index, index_size))
+		return false;
+
+	for (uint8_t s = 0; s < sector_count; ++s)
+		kv->seg_state[s] = KV_SEG_ERASED;
+
+	return true;
+}
+
+
+/* Build and append a record, one page program */
+static bool w25qxx_kv_append(w25qxx_kv_t *kv, uint8_t type, const char *key, uint8_t key_len,
+								const void *value, uint16_t len, uint32_t *addr)
+{
+	uint32_t size = W25QXX_KV_RECORD_HEADER + key_len + len;
+	kv_record_t hdr;
+
+	if ((key_len == 0) || (key_len > W25QXX_KV_KEY_MAX) || (size > kv->dev->page_size))
+		return false;
+
+	hdr.key_len = key_len;
+	hdr.type = type;
+	hdr.val_len = len;
+	memcpy(kv->buf, &hdr, 4);
+	memcpy(kv->buf + W25QXX_KV_RECORD_HEADER, key, key_len);
+	memcpy(kv->buf + W25QXX_KV_RECORD_HEADER + key_len, value, len);
+	hdr.crc = w25qxx_crc32Update(w25qxx_crc32Update(0, kv->buf, 4), kv->buf + W25QXX_KV_RECORD_HEADER, key_len + len);
+	memcpy(kv->buf, &hdr, sizeof(hdr));
+
+	// compaction reads records through its own buffer, kv->buf survives
+	*addr = w25qxx_kv_reserve(kv, size);
+	if (*addr == KV_EMPTY)
+		return false;
+
+	return w25qxx_kv_program(kv, *addr, kv->buf, size);
+}
+
+
+/**
+  * @brief  store a value, one page program
+  * @param  *key: [in] zero terminated, 1 ~ W25QXX_KV_KEY_MAX chars
+  * @param  *value: [in] value bytes
+  * @param  len: [in] value length
+  * @retval status 1:passed  0:failed (too large, store or index full, chip access)
+  */
+bool w25qxx_kv_set(w25qxx_kv_t *kv, const char *key, const void *value, uint16_t len)
+{
+	size_t key_len = strlen(key);
+	uint32_t hash = w25qxx_kv_hash(key, (uint8_t)key_len);
+	w25qxx_kv_status_t status;
+	uint32_t slot;
+	uint32_t addr;
+	bool found;
+
+	if ((key_len == 0) || (key_len > W25QXX_KV_KEY_MAX))
+		return false;
+
+	// an unreadable index entry may be this key, a new slot would duplicate it
+	status = w25qxx_kv_find(kv, key, (uint8_t)key_len, hash, &slot);
+	if (status == W25QXX_KV_ERROR)
+		return false;
+
+	// check the index has room before anything reaches the chip
+	found = (status == W25QXX_KV_OK);
+	if (!found && ((slot == KV_EMPTY) || ((kv->index[slot].addr == KV_EMPTY) && (kv->used + 1 >= kv->index_size))))
+		return false;
+
+	if (!w25qxx_kv_append(kv, KV_TYPE_SET, key, (uint8_t)key_len, value, len, &addr))
+		return false;
+
+	// compaction moves records but never index slots
+	if (!found){
+		if (kv->index[slot].addr == KV_EMPTY)
+			kv->used++;
+		kv->count++;
+	}
+	kv->index[slot].hash = hash;
+	kv->index[slot].addr = addr;
+	kv->index[slot].len = W25QXX_KV_RECORD_HEADER + key_len + len;
+
+	return true;
+}
+
+
+/**
+  * @brief  look a key up, one read
+  * @param  *value: [out] value bytes
+  * @param  *len: [in] size of value  [out] length of the stored value
+  * @retval W25QXX_KV_OK, W25QXX_KV_NOT_FOUND, W25QXX_KV_ERROR: invalid key, read failed or corrupt record
+  */
+w25qxx_kv_status_t w25qxx_kv_get(w25qxx_kv_t *kv, const char *key, void *value, uint16_t *len)
+{
+	size_t key_len = strlen(key);
+	w25qxx_kv_status_t status;
+	uint32_t slot;
+	kv_record_t hdr;
+
+	if ((key_len == 0) || (key_len > W25QXX_KV_KEY_MAX))
+		return W25QXX_KV_ERROR;
+
+	status = w25qxx_kv_find(kv, key, (uint8_t)key_len, w25qxx_kv_hash(key, (uint8_t)key_len), &slot);
+	if (status != W25QXX_KV_OK)
+		return status;
+
+	memcpy(&hdr, kv->buf, sizeof(hdr));
+	if (!w25qxx_kv_check(kv->buf, kv->index[slot].len))
+		return W25QXX_KV_ERROR;
+
+	memcpy(value, kv->buf + W25QXX_KV_RECORD_HEADER + key_len, (hdr.val_len < *len) ? hdr.val_len : *len);
+	*len = hdr.val_len;
+
+	return W25QXX_KV_OK;
+}
+
+
+/**
+  * @brief  remove a key by appending a tombstone
+  * @retval W25QXX_KV_OK: removed, W25QXX_KV_NOT_FOUND, W25QXX_KV_ERROR: invalid key or chip access failed
+  */
+w25qxx_kv_status_t w25qxx_kv_delete(w25qxx_kv_t *kv, const char *key)
+{
+	size_t key_len = strlen(key);
+	w25qxx_kv_status_t status;
+	uint32_t slot;
+	uint32_t addr;
+
+	if ((key_len == 0) || (key_len > W25QXX_KV_KEY_MAX))
+		return W25QXX_KV_ERROR;
+
+	status = w25qxx_kv_find(kv, key, (uint8_t)key_len, w25qxx_kv_hash(key, (uint8_t)key_len), &slot);
+	if (status != W25QXX_KV_OK)
+		return status;
+
+	if (!w25qxx_kv_append(kv, KV_TYPE_DELETE, key, (uint8_t)key_len, NULL, 0, &addr))
+		return W25QXX_KV_ERROR;
+
+	// compaction moves records but never index slots
+	kv->index[slot].addr = KV_DELETED;
+	kv->count--;
+
+	return W25QXX_KV_OK;
+}
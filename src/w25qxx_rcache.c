@@ -0,0 +1,212 @@
+#include <stdint.h>
+#include <string.h>
+#include "w25qxx_rcache.h"
+
+
+/* Listener: drop the lines of the pages in [addr, addr + len) */
+static void w25qxx_rcache_changed(w25qxx_notify_t *n, uint32_t addr, uint32_t len, bool erase)
+{
+	w25qxx_rcache_t *rc = (w25qxx_rcache_t *)n->user;
+	uint32_t first = addr / rc->dev->page_size;
+	uint32_t last = (addr + len - 1) / rc->dev->page_size;
+
+	(void)erase;
+
+	if (len == 0)
+		return;
+
+	for (uint8_t i = 0; i < rc->set_count * rc->ways; ++i){
+		if ((rc->line[i].page != W25QXX_RCACHE_EMPTY) && (rc->line[i].page >= first) && (rc->line[i].page <= last))
+			rc->line[i].page = W25QXX_RCACHE_EMPTY;
+	}
+}
+
+
+/**
+  * @brief  set up a cache over an initialized device and attach it
+  * @param  *rc: [out] cache
+  * @param  *dev: [in] device after w25qxx_dev_init
+  * @param  *pool: [in] set_count * ways * page_size bytes of line storage
+  * @param  set_count: [in] power of two
+  * @param  ways: [in] lines per set
+  * @param  ahead: [in] read-ahead limit in pages, 0 ~ W25QXX_RCACHE_MAX_AHEAD
+  * @retval status 1:passed  0:failed
+  */
+bool w25qxx_rcache_init(w25qxx_rcache_t *rc, w25qxx_dev_t *dev, uint8_t *pool, uint8_t set_count,
+							uint8_t ways, uint8_t ahead)
+{
+	uint32_t lines = (uint32_t)set_count * ways;
+
+	if ((pool == NULL) || (set_count == 0) || (set_count & (set_count - 1)) || (ways == 0) ||
+		(lines > W25QXX_RCACHE_MAX_LINES) || (ahead > W25QXX_RCACHE_MAX_AHEAD))
+		return false;
+
+	memset(rc, 0, sizeof(*rc));
+	rc->dev = dev;
+	rc->set_count = set_count;
+	rc->ways = ways;
+	rc->next_page = W25QXX_RCACHE_EMPTY;
+
+	// a window larger than the cache would evict the page it was fetched for
+	rc->ahead_max = (ahead < lines) ? ahead : (uint8_t)(lines - 1);
+
+	for (uint32_t i = 0; i < lines; ++i){
+		rc->line[i].page = W25QXX_RCACHE_EMPTY;
+		rc->line[i].data = pool + i * dev->page_size;
+	}
+
+	rc->notify.changed = w25qxx_rcache_changed;
+	rc->notify.user = rc;
+	w25qxx_dev_addNotify(dev, &rc->notify);
+
+	return true;
+}
+
+
+void w25qxx_rcache_deinit(w25qxx_rcache_t *rc)
+{
+	w25qxx_dev_removeNotify(rc->dev, &rc->notify);
+}
+
+
+static w25qxx_rcache_line_t* w25qxx_rcache_find(w25qxx_rcache_t *rc, uint32_t page)
+{
+	w25qxx_rcache_line_t *set = &rc->line[(page & (rc->set_count - 1)) * rc->ways];
+
+	for (uint8_t w = 0; w < rc->ways; ++w){
+		if (set[w].page == page)
+			return &set[w];
+	}
+
+	return NULL;
+}
+
+
+/* Way of the page's set to fill: an empty one or the least recently used */
+static w25qxx_rcache_line_t* w25qxx_rcache_victim(w25qxx_rcache_t *rc, uint32_t page)
+{
+	w25qxx_rcache_line_t *set = &rc->line[(page & (rc->set_count - 1)) * rc->ways];
+	w25qxx_rcache_line_t *line = &set[0];
+
+	for (uint8_t w = 1; w < rc->ways; ++w){
+		if (line->page == W25QXX_RCACHE_EMPTY)
+			break;
+		if ((set[w].page == W25QXX_RCACHE_EMPTY) || (set[w].stamp < line->stamp))
+			line = &set[w];
+	}
+
+	return line;
+}
+
+
+/* Load a missed page, on a sequential miss also the window of pages after it */
+static w25qxx_rcache_line_t* w25qxx_rcache_fill(w25qxx_rcache_t *rc, uint32_t page)
+{
+	w25qxx_dev_t *dev = rc->dev;
+	w25qxx_rcache_line_t *first = NULL;
+	w25qxx_rcache_line_t *line;
+	uint32_t ahead = 0;
+
+	if ((page == rc->next_page) && rc->ahead_max){
+		ahead = rc->window ? (uint32_t)rc->window * 2 : 1;
+		if (ahead > rc->ahead_max)
+			ahead = rc->ahead_max;
+	}
+	rc->window = ahead;
+
+	for (uint32_t i = 0; (i <= ahead) && ((page + i) < dev->page_count); ++i){
+		if (i && w25qxx_rcache_find(rc, page + i))
+			continue;
+
+		line = w25qxx_rcache_victim(rc, page + i);
+		line->page = W25QXX_RCACHE_EMPTY;
+
+		if (!w25qxx_dev_read(dev, (page + i) * dev->page_size, line->data, dev->page_size))
+			return NULL;
+
+		line->page = page + i;
+		line->stamp = ++rc->clock;
+
+		if (i)
+			rc->prefetched++;
+		else
+			first = line;
+	}
+
+	rc->next_page = page + ahead + 1;
+
+	return first;
+}
+
+
+/**
+  * @brief  read through the cache
+  * @param  addr: [in] byte address
+  * @param  *buff: [out] receive bytes
+  * @param  len: [in] byte number, clamped to the end of the chip
+  * @retval status 1:passed  0:failed
+  */
+bool w25qxx_rcache_read(w25qxx_rcache_t *rc, uint32_t addr, uint8_t *buff, uint32_t len)
+{
+	w25qxx_dev_t *dev = rc->dev;
+	uint32_t capacity = dev->capacity_kb * 1024;
+	w25qxx_rcache_line_t *line;
+	uint32_t offset;
+	uint32_t chunk;
+
+	if ((len == 0) || (addr >= capacity))
+		return false;
+
+	if (len > (capacity - addr))
+		len = capacity - addr;
+
+	while (len){
+		offset = addr % dev->page_size;
+		chunk = dev->page_size - offset;
+		if (chunk > len)
+			chunk = len;
+
+		line = w25qxx_rcache_find(rc, addr / dev->page_size);
+		if (line != NULL){
+			rc->hits++;
+		}else if ((offset == 0) && (len >= 2 * (uint32_t)dev->page_size)){
+			// whole uncached pages are merged into one chip read and not cached
+			while (((len - chunk) >= dev->page_size) && (w25qxx_rcache_find(rc, (addr + chunk) / dev->page_size) == NULL))
+				chunk += dev->page_size;
+
+			if (!w25qxx_dev_read(dev, addr, buff, chunk))
+				return false;
+
+			rc->next_page = (addr + chunk) / dev->page_size;
+
+			addr += chunk;
+			buff += chunk;
+			len -= chunk;
+			continue;
+		}else{
+			rc->misses++;
+			line = w25qxx_rcache_fill(rc, addr / dev->page_size);
+			if (line == NULL)
+				return false;
+		}
+
+		line->stamp = ++rc->clock;
+		memcpy(buff, line->data + offset, chunk);
+
+		addr += chunk;
+		buff += chunk;
+		len -= chunk;
+	}
+
+	return true;
+}
+
+
+void w25qxx_rcache_invalidate(w25qxx_rcache_t *rc)
+{
+	for (uint8_t i = 0; i < rc->set_count * rc->ways; ++i)
+		rc->line[i].page = W25QXX_RCACHE_EMPTY;
+
+	rc->next_page = W25QXX_RCACHE_EMPTY;
+	rc->window = 0;
+}
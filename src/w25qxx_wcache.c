@@ -0,0 +1,267 @@
+#include <stdint.h>
+#include <string.h>
+#include "w25qxx_wcache.h"
+
+
+/* Listener: programs and erases of other code drop the clean lines in [addr, addr + len) */
+static void w25qxx_wcache_changed(w25qxx_notify_t *n, uint32_t addr, uint32_t len, bool erase)
+{
+	w25qxx_wcache_t *wc = (w25qxx_wcache_t *)n->user;
+	uint32_t first = addr / wc->dev->sector_size;
+	uint32_t last = (addr + len - 1) / wc->dev->sector_size;
+
+	(void)erase;
+
+	if ((len == 0) || wc->writing)
+		return;
+
+	for (uint8_t i = 0; i < wc->line_count; ++i){
+		w25qxx_wcache_line_t *line = &wc->line[i];
+
+		if ((line->sector == W25QXX_WCACHE_EMPTY) || (line->sector < first) || (line->sector > last))
+			continue;
+
+		// a dirty line holds writes that are not on the chip yet, it cannot be dropped
+		if (line->dirty)
+			wc->conflicts++;
+		else
+			line->sector = W25QXX_WCACHE_EMPTY;
+	}
+}
+
+
+/**
+  * @brief  set up a cache over an initialized device and attach it
+  * @param  *wc: [out] cache
+  * @param  *dev: [in] device after w25qxx_dev_init
+  * @param  *pool: [in] line_count * sector_size bytes of line storage
+  * @param  line_count: [in] 1 ~ W25QXX_WCACHE_MAX_LINES
+  * @retval status 1:passed  0:failed
+  */
+bool w25qxx_wcache_init(w25qxx_wcache_t *wc, w25qxx_dev_t *dev, uint8_t *pool, uint8_t line_count)
+{
+	if ((pool == NULL) || (line_count == 0) || (line_count > W25QXX_WCACHE_MAX_LINES))
+		return false;
+
+	memset(wc, 0, sizeof(*wc));
+	wc->dev = dev;
+	wc->line_count = line_count;
+
+	for (uint8_t i = 0; i < line_count; ++i){
+		wc->line[i].sector = W25QXX_WCACHE_EMPTY;
+		wc->line[i].data = pool + (uint32_t)i * dev->sector_size;
+	}
+
+	wc->notify.changed = w25qxx_wcache_changed;
+	wc->notify.user = wc;
+	w25qxx_dev_addNotify(dev, &wc->notify);
+
+	return true;
+}
+
+
+void w25qxx_wcache_deinit(w25qxx_wcache_t *wc)
+{
+	w25qxx_dev_removeNotify(wc->dev, &wc->notify);
+}
+
+
+static w25qxx_wcache_line_t* w25qxx_wcache_find(w25qxx_wcache_t *wc, uint32_t sector)
+{
+	for (uint8_t i = 0; i < wc->line_count; ++i){
+		if (wc->line[i].sector == sector)
+			return &wc->line[i];
+	}
+
+	return NULL;
+}
+
+
+/* Erase the sector and program the pages that are not blank */
+static bool w25qxx_wcache_program(w25qxx_wcache_t *wc, w25qxx_wcache_line_t *line)
+{
+	w25qxx_dev_t *dev = wc->dev;
+	uint32_t first_page = line->sector * (dev->sector_size / dev->page_size);
+
+	if (!w25qxx_dev_eraseSector(dev, line->sector))
+		return false;
+
+	for (uint32_t off = 0; off < dev->sector_size; off += dev->page_size){
+		const uint8_t *page = line->data + off;
+		uint32_t i;
+
+		for (i = 0; (i < dev->page_size) && (page[i] == 0xFF); ++i)
+			;
+		if (i == dev->page_size)
+			continue;
+
+		if (!w25qxx_dev_writePage(dev, page, first_page + off / dev->page_size, 0, dev->page_size))
+			return false;
+	}
+
+	return true;
+}
+
+
+static bool w25qxx_wcache_writeBack(w25qxx_wcache_t *wc, w25qxx_wcache_line_t *line)
+{
+	bool res;
+
+	if (!line->dirty)
+		return true;
+
+	wc->writing = true;
+	res = w25qxx_wcache_program(wc, line);
+	wc->writing = false;
+
+	if (res)
+		line->dirty = false;
+
+	return res;
+}
+
+
+/* Line for a sector, evicting the least recently used one on a miss */
+static w25qxx_wcache_line_t* w25qxx_wcache_get(w25qxx_wcache_t *wc, uint32_t sector, bool load)
+{
+	w25qxx_wcache_line_t *line = w25qxx_wcache_find(wc, sector);
+
+	if (line == NULL){
+		line = &wc->line[0];
+		for (uint8_t i = 1; i < wc->line_count; ++i){
+			if (line->sector == W25QXX_WCACHE_EMPTY)
+				break;
+			if ((wc->line[i].sector == W25QXX_WCACHE_EMPTY) || (wc->line[i].stamp < line->stamp))
+				line = &wc->line[i];
+		}
+
+		if (!w25qxx_wcache_writeBack(wc, line))
+			return NULL;
+
+		line->sector = W25QXX_WCACHE_EMPTY;
+		if (load && !w25qxx_dev_read(wc->dev, sector * wc->dev->sector_size, line->data, wc->dev->sector_size))
+			return NULL;
+
+		line->sector = sector;
+	}
+
+	line->stamp = ++wc->clock;
+
+	return line;
+}
+
+
+/**
+  * @brief  read through the cache
+  * @param  addr: [in] byte address
+  * @param  *buff: [out] receive bytes
+  * @param  len: [in] byte number, clamped to the end of the chip
+  * @retval status 1:passed  0:failed
+  */
+bool w25qxx_wcache_read(w25qxx_wcache_t *wc, uint32_t addr, uint8_t *buff, uint32_t len)
+{
+	w25qxx_dev_t *dev = wc->dev;
+	uint32_t capacity = dev->capacity_kb * 1024;
+	w25qxx_wcache_line_t *line;
+	uint32_t offset;
+	uint32_t chunk;
+
+	if ((len == 0) || (addr >= capacity))
+		return false;
+
+	if (len > (capacity - addr))
+		len = capacity - addr;
+
+	while (len){
+		offset = addr % dev->sector_size;
+		chunk = dev->sector_size - offset;
+		if (chunk > len)
+			chunk = len;
+
+		line = w25qxx_wcache_find(wc, addr / dev->sector_size);
+		if (line != NULL){
+			memcpy(buff, line->data + offset, chunk);
+		}else{
+			// uncached sectors are merged into one chip read
+			while ((chunk < len) && (w25qxx_wcache_find(wc, (addr + chunk) / dev->sector_size) == NULL))
+				chunk += ((len - chunk) < dev->sector_size) ? (len - chunk) : dev->sector_size;
+
+			if (!w25qxx_dev_read(dev, addr, buff, chunk))
+				return false;
+		}
+
+		addr += chunk;
+		buff += chunk;
+		len -= chunk;
+	}
+
+	return true;
+}
+
+
+/**
+  * @brief  update bytes in the cache, erase/program is deferred to eviction or flush
+  * @param  addr: [in] byte address
+  * @param  *buff: [in] data
+  * @param  len: [in] byte number, clamped to the end of the chip
+  * @retval status 1:passed  0:failed
+  */
+bool w25qxx_wcache_write(w25qxx_wcache_t *wc, uint32_t addr, const uint8_t *buff, uint32_t len)
+{
+	w25qxx_dev_t *dev = wc->dev;
+	uint32_t capacity = dev->capacity_kb * 1024;
+	w25qxx_wcache_line_t *line;
+	uint32_t offset;
+	uint32_t chunk;
+
+	if ((len == 0) || (addr >= capacity))
+		return false;
+
+	if (len > (capacity - addr))
+		len = capacity - addr;
+
+	while (len){
+		offset = addr % dev->sector_size;
+		chunk = dev->sector_size - offset;
+		if (chunk > len)
+			chunk = len;
+
+		// a fully overwritten sector does not need its old contents
+		line = w25qxx_wcache_get(wc, addr / dev->sector_size, chunk != dev->sector_size);
+		if (line == NULL)
+			return false;
+
+		memcpy(line->data + offset, buff, chunk);
+		line->dirty = true;
+
+		addr += chunk;
+		buff += chunk;
+		len -= chunk;
+	}
+
+	return true;
+}
+
+
+/**
+  * @brief  write back every dirty line
+  * @retval status 1:passed  0:failed
+  */
+bool w25qxx_wcache_flush(w25qxx_wcache_t *wc)
+{
+	for (uint8_t i = 0; i < wc->line_count; ++i){
+		if (!w25qxx_wcache_writeBack(wc, &wc->line[i]))
+			return false;
+	}
+
+	return true;
+}
+
+
+void w25qxx_wcache_invalidate(w25qxx_wcache_t *wc)
+{
+	for (uint8_t i = 0; i < wc->line_count; ++i){
+		wc->line[i].sector = W25QXX_WCACHE_EMPTY;
+		wc->line[i].dirty = false;
+	}
+}
@@ -0,0 +1,321 @@
+#include <stdint.h>
+#include <string.h>
+#include "w25qxx_wqueue.h"
+
+
+/**
+  * @brief  set up a write queue over an initialized device
+  * @param  *q: [out] queue
+  * @param  *dev: [in] device after w25qxx_dev_init
+  * @param  *pool: [in] storage of the queued bytes
+  * @param  pool_size: [in] byte number of pool, a flush runs when it is full
+  * @param  *scratch: [in] sector_size bytes used by the flush
+  * @param  max_age_ms: [in] flush limit of the oldest queued write, 0: none
+  * @retval status 1:passed  0:failed
+  */
+bool w25qxx_wqueue_init(w25qxx_wqueue_t *q, w25qxx_dev_t *dev, uint8_t *pool, uint32_t pool_size,
+							uint8_t *scratch, uint32_t max_age_ms)
+{
+	// changed pages of a sector are tracked in a 32 bit mask
+	if ((pool == NULL) || (pool_size == 0) || (scratch == NULL) || ((dev->sector_size / dev->page_size) > 32))
+		return false;
+
+	memset(q, 0, sizeof(*q));
+	q->dev = dev;
+	q->pool = pool;
+	q->pool_size = pool_size;
+	q->scratch = scratch;
+	q->max_age_ms = max_age_ms;
+
+	return true;
+}
+
+
+/* Move the extent data to the start of the pool, dropping the holes left by merges */
+static void w25qxx_wqueue_compact(w25qxx_wqueue_t *q)
+{
+	uint32_t cursor = 0;
+
+	// data below cursor is placed, the lowest extent above it goes next
+	for (uint8_t n = 0; n < q->count; ++n){
+		w25qxx_wqueue_extent_t *next = NULL;
+
+		for (uint8_t i = 0; i < q->count; ++i){
+			if ((q->extent[i].offset >= cursor) && ((next == NULL) || (q->extent[i].offset < next->offset)))
+				next = &q->extent[i];
+		}
+
+		memmove(q->pool + cursor, q->pool + next->offset, next->len);
+		next->offset = cursor;
+		cursor += next->len;
+	}
+
+	q->used = cursor;
+}
+
+
+/* Apply the extents touching sector to scratch and program it, erasing only if needed */
+static bool w25qxx_wqueue_flushSector(w25qxx_wqueue_t *q, uint32_t sector, uint8_t first)
+{
+	w25qxx_dev_t *dev = q->dev;
+	uint32_t base = sector * dev->sector_size;
+	uint32_t first_page = base / dev->page_size;
+	uint32_t changed = 0;
+	bool erase = false;
+
+	if (!w25qxx_dev_read(dev, base, q->scratch, dev->sector_size))
+		return false;
+
+	for (uint8_t i = first; (i < q->count) && (q->extent[i].addr < (base + dev->sector_size)); ++i){
+		w25qxx_wqueue_extent_t *e = &q->extent[i];
+		uint32_t start = (e->addr > base) ? e->addr : base;
+		uint32_t end = e->addr + e->len;
+		const uint8_t *src;
+
+		if (end > (base + dev->sector_size))
+			end = base + dev->sector_size;
+
+		src = q->pool + e->offset + (start - e->addr);
+		for (uint32_t a = start - base; a < end - base; ++a, ++src){
+			if (q->scratch[a] == *src)
+				continue;
+
+			// NOR programming only clears bits
+			if ((q->scratch[a] & *src) != *src)
+				erase = true;
+
+			q->scratch[a] = *src;
+			changed |= 1ul << (a / dev->page_size);
+		}
+	}
+
+	if (changed == 0)
+		return true;
+
+	if (erase){
+		if (!w25qxx_dev_eraseSector(dev, sector))
+			return false;
+		q->erases++;
+	}
+
+	for (uint32_t p = 0; p < (dev->sector_size / dev->page_size); ++p){
+		const uint8_t *page = q->scratch + p * dev->page_size;
+
+		if (erase){
+			uint32_t i;
+
+			// after the erase every page that is not blank is rewritten
+			for (i = 0; (i < dev->page_size) && (page[i] == 0xFF); ++i)
+				;
+			if (i == dev->page_size)
+				continue;
+		}else if (!(changed & (1ul << p))){
+			continue;
+		}
+
+		if (!w25qxx_dev_writePage(dev, page, first_page + p, 0, dev->page_size))
+			return false;
+		q->programs++;
+	}
+
+	return true;
+}
+
+
+/* Write every queued extent in address order, one pass per touched sector */
+static bool w25qxx_wqueue_flush(w25qxx_wqueue_t *q)
+{
+	w25qxx_dev_t *dev = q->dev;
+	uint32_t sector;
+	uint8_t i = 0;
+
+	if (q->count == 0)
+		return true;
+
+	sector = q->extent[0].addr / dev->sector_size;
+	while (i < q->count){
+		// an extent crossing a sector boundary is revisited for the next sector
+		if ((q->extent[i].addr / dev->sector_size) > sector)
+			sector = q->extent[i].addr / dev->sector_size;
+
+		if (!w25qxx_wqueue_flushSector(q, sector, i))
+			return false;
+
+		while ((i < q->count) && ((q->extent[i].addr + q->extent[i].len) <= ((sector + 1) * dev->sector_size)))
+			++i;
+		sector++;
+	}
+
+	q->count = 0;
+	q->used = 0;
+	q->queued = 0;
+	q->flushes++;
+
+	return true;
+}
+
+
+/* Queue one piece of at most pool_size bytes */
+static bool w25qxx_wqueue_insert(w25qxx_wqueue_t *q, uint32_t addr, const uint8_t *buff, uint32_t len)
+{
+	w25qxx_wqueue_extent_t *e;
+	uint32_t lo, hi;
+	uint8_t i, j;
+
+	for (;;){
+		// extents i .. j-1 overlap or touch [addr, addr + len)
+		for (i = 0; (i < q->count) && ((q->extent[i].addr + q->extent[i].len) < addr); ++i)
+			;
+		for (j = i; (j < q->count) && (q->extent[j].addr <= (addr + len)); ++j)
+			;
+
+		if (i == j){
+			if ((q->count < W25QXX_WQUEUE_MAX_EXTENTS) && ((q->pool_size - q->used) >= len))
+				break;
+		}else{
+			e = &q->extent[i];
+			if ((j == (i + 1)) && (e->addr <= addr) && ((e->addr + e->len) >= (addr + len))){
+				memcpy(q->pool + e->offset + (addr - e->addr), buff, len);
+				return true;
+			}
+
+			lo = (e->addr < addr) ? e->addr : addr;
+			hi = q->extent[j - 1].addr + q->extent[j - 1].len;
+			if (hi < (addr + len))
+				hi = addr + len;
+			if ((q->pool_size - q->used) >= (hi - lo))
+				break;
+		}
+
+		if (q->used > q->queued)
+			w25qxx_wqueue_compact(q);
+		else if (!w25qxx_wqueue_flush(q))
+			return false;
+	}
+
+	if (q->count == 0)
+		q->first_time = q->dev->get_time();
+
+	if (i == j){
+		memmove(&q->extent[i + 1], &q->extent[i], (q->count - i) * sizeof(q->extent[0]));
+		q->count++;
+
+		e = &q->extent[i];
+		e->addr = addr;
+		e->len = len;
+		e->offset = q->used;
+		memcpy(q->pool + q->used, buff, len);
+		q->used += len;
+		q->queued += len;
+
+		return true;
+	}
+
+	// merge into a fresh region: old data first, the new write on top
+	for (uint8_t k = i; k < j; ++k){
+		e = &q->extent[k];
+		memcpy(q->pool + q->used + (e->addr - lo), q->pool + e->offset, e->len);
+		q->queued -= e->len;
+	}
+	memcpy(q->pool + q->used + (addr - lo), buff, len);
+
+	e = &q->extent[i];
+	e->addr = lo;
+	e->len = hi - lo;
+	e->offset = q->used;
+	q->used += hi - lo;
+	q->queued += hi - lo;
+
+	memmove(&q->extent[i + 1], &q->extent[j], (q->count - j) * sizeof(q->extent[0]));
+	q->count -= j - i - 1;
+
+	return true;
+}
+
+
+/**
+  * @brief  queue bytes for writing, any alignment
+  * @param  addr: [in] byte address
+  * @param  *buff: [in] data, copied
+  * @param  len: [in] byte number, clamped to the end of the chip
+  * @retval status 1:passed  0:failed
+  */
+bool w25qxx_wqueue_write(w25qxx_wqueue_t *q, uint32_t addr, const uint8_t *buff, uint32_t len)
+{
+	uint32_t capacity = q->dev->capacity_kb * 1024;
+	uint32_t chunk;
+
+	if ((len == 0) || (addr >= capacity))
+		return false;
+
+	if (len > (capacity - addr))
+		len = capacity - addr;
+
+	while (len){
+		chunk = (len < q->pool_size) ? len : q->pool_size;
+
+		if (!w25qxx_wqueue_insert(q, addr, buff, chunk))
+			return false;
+
+		addr += chunk;
+		buff += chunk;
+		len -= chunk;
+	}
+
+	return w25qxx_wqueue_poll(q);
+}
+
+
+/**
+  * @brief  read the chip with queued writes applied
+  * @param  addr: [in] byte address
+  * @param  *buff: [out] receive bytes
+  * @param  len: [in] byte number, clamped to the end of the chip
+  * @retval status 1:passed  0:failed
+  */
+bool w25qxx_wqueue_read(w25qxx_wqueue_t *q, uint32_t addr, uint8_t *buff, uint32_t len)
+{
+	uint32_t capacity = q->dev->capacity_kb * 1024;
+
+	if ((len == 0) || (addr >= capacity))
+		return false;
+
+	if (len > (capacity - addr))
+		len = capacity - addr;
+
+	if (!w25qxx_dev_read(q->dev, addr, buff, len))
+		return false;
+
+	for (uint8_t i = 0; (i < q->count) && (q->extent[i].addr < (addr + len)); ++i){
+		w25qxx_wqueue_extent_t *e = &q->extent[i];
+		uint32_t start = (e->addr > addr) ? e->addr : addr;
+		uint32_t end = e->addr + e->len;
+
+		if (end <= addr)
+			continue;
+		if (end > (addr + len))
+			end = addr + len;
+
+		memcpy(buff + (start - addr), q->pool + e->offset + (start - e->addr), end - start);
+	}
+
+	return true;
+}
+
+
+bool w25qxx_wqueue_poll(w25qxx_wqueue_t *q)
+{
+	if ((q->count == 0) || (q->max_age_ms == 0))
+		return true;
+
+	if ((uint32_t)(q->dev->get_time() - q->first_time) < q->max_age_ms)
+		return true;
+
+	return w25qxx_wqueue_flush(q);
+}
+
+
+bool w25qxx_wqueue_sync(w25qxx_wqueue_t *q)
+{
+	return w25qxx_wqueue_flush(q);
+}
@@ -0,0 +1,111 @@
+#ifndef __W25QXX_TEST__
+#define __W25QXX_TEST__
+
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "w25qxx.h"
+#include "w25qxx_sim.h"
+
+/*
+    Helpers of the simulator driven behaviour tests. A test is one executable
+    registered with ctest, it exits 0 on success, 1 on the first failed CHECK
+    and W25QXX_TEST_SKIP when the build cannot run it (fixed part builds).
+*/
+
+#define W25QXX_TEST_SKIP    77
+
+#define CHECK(x)    do{ \
+                        if (!(x)){ \
+                            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #x); \
+                            exit(1); \
+                        } \
+                    }while(0)
+
+
+/* Open an erased simulated part and initialize dev on it, skips when a fixed build excludes type */
+static inline void test_open(w25qxx_sim_t *sim, w25qxx_dev_t *dev, w25qxx_t type)
+{
+#ifdef W25QXX_FIXED_TYPE
+    if (type != W25QXX_FIXED_TYPE)
+        exit(W25QXX_TEST_SKIP);
+#endif
+
+    CHECK(w25qxx_sim_open(sim, type, NULL, NULL));
+    memset(dev, 0, sizeof(*dev));
+    w25qxx_sim_attach(sim, dev);
+    CHECK(w25qxx_dev_init(dev));
+}
+
+
+/* Power up again: a fresh handle on the same chip contents */
+static inline void test_reboot(w25qxx_sim_t *sim, w25qxx_dev_t *dev)
+{
+    memset(dev, 0, sizeof(*dev));
+    w25qxx_sim_attach(sim, dev);
+    CHECK(w25qxx_dev_init(dev));
+}
+
+
+/* Fill buff with a pattern derived from seed */
+static inline void test_pattern(uint8_t *buff, uint32_t len, uint32_t seed)
+{
+    for (uint32_t i = 0; i < len; ++i){
+        seed = seed * 1103515245u + 12345u;
+        buff[i] = (uint8_t)(seed >> 16);
+    }
+}
+
+
+static int test_cut_budget = -1;
+static w25qxx_interface_transfer_t test_cut_next;
+static uint32_t test_programs, test_erases;     // commands that reached the chip
+static jmp_buf *test_cut_jump;                  // not NULL: power loss returns there
+
+static inline uint8_t test_cutTransfer(const w25qxx_transfer_t *xfer)
+{
+    uint32_t *count;
+
+    switch (xfer->header_len ? xfer->header[0] : 0){
+        case 0x02: case 0x12: case 0x32: case 0x34:
+            count = &test_programs;
+            break;
+        case 0x20: case 0x21: case 0x52: case 0x5C: case 0xD8: case 0xDC:
+        case 0x60: case 0xC7:
+            count = &test_erases;
+            break;
+        default:
+            return test_cut_next(xfer);
+    }
+
+    if (test_cut_budget == 0){
+        // power is gone, the chip never sees it and the caller stops here
+        if (test_cut_jump)
+            longjmp(*test_cut_jump, 1);
+        return 0;
+    }
+    if (test_cut_budget > 0)
+        test_cut_budget--;
+    (*count)++;
+
+    return test_cut_next(xfer);
+}
+
+
+/*
+    Lose power after n more program/erase commands, -1: never (only counts them).
+    Later commands are dropped, or with test_cut_jump set the code running at
+    that moment is abandoned with a longjmp, as a real power loss would.
+*/
+static inline void test_cutAfter(w25qxx_dev_t *dev, int n)
+{
+    if (dev->interface_transfer != test_cutTransfer){
+        test_cut_next = dev->interface_transfer;
+        dev->interface_transfer = test_cutTransfer;
+    }
+    test_cut_budget = n;
+}
+
+#endif
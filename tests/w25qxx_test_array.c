@@ -0,0 +1,84 @@
+#include "w25qxx_test.h"
+#include "w25qxx_array.h"
+
+/* Multi-chip array: striped page layout and parallel erases, mirrored copies and reads during erases */
+
+static w25qxx_sim_t sim[2];
+static w25qxx_dev_t dev[2];
+static uint8_t data[0x10000], back[0x10000];
+
+
+static void arrayOpen(w25qxx_array_t *arr, w25qxx_array_mode_t mode)
+{
+    w25qxx_dev_t *members[2] = {&dev[0], &dev[1]};
+
+    for (int i = 0; i < 2; ++i){
+        test_open(&sim[i], &dev[i], W25Q32);
+        if (i)
+            w25qxx_sim_shareClock(&sim[i], &sim[0]);
+    }
+
+    CHECK(w25qxx_array_init(arr, mode, members, 2));
+}
+
+
+static void arrayClose(void)
+{
+    for (int i = 0; i < 2; ++i)
+        w25qxx_sim_close(&sim[i]);
+}
+
+
+int main(void)
+{
+    w25qxx_array_t arr;
+    uint32_t ps;
+    uint64_t t;
+
+    test_pattern(data, sizeof(data), 1);
+
+    // striped: page P is page P / 2 of member P % 2, sectors erase on both chips at once
+    arrayOpen(&arr, W25QXX_ARRAY_STRIPED);
+    ps = arr.page_size;
+    CHECK(arr.capacity_kb == 2 * dev[0].capacity_kb);
+    CHECK(arr.sector_size == 2 * dev[0].sector_size);
+    CHECK(w25qxx_array_write(&arr, 0, data, sizeof(data)));
+    CHECK(w25qxx_array_read(&arr, 0, back, sizeof(back)));
+    CHECK(memcmp(back, data, sizeof(data)) == 0);
+    for (uint32_t p = 0; p < (sizeof(data) / ps); ++p)
+        CHECK(memcmp(sim[p % 2].mem + (p / 2) * ps, data + p * ps, ps) == 0);
+
+    t = w25qxx_sim_nowNs(&sim[0]);
+    CHECK(w25qxx_array_eraseSector(&arr, 1));
+    CHECK(w25qxx_array_sync(&arr));
+    t = w25qxx_sim_nowNs(&sim[0]) - t;
+    CHECK(t < (2ull * sim[0].timing.t_se_us * 1000));
+    CHECK(w25qxx_array_read(&arr, 0, back, 2 * arr.sector_size));
+    CHECK(memcmp(back, data, arr.sector_size) == 0);
+    for (uint32_t i = arr.sector_size; i < 2 * arr.sector_size; ++i)
+        CHECK(back[i] == 0xFF);
+    arrayClose();
+
+    // mirrored: both chips hold the volume, an erase on one leaves the other to serve reads
+    arrayOpen(&arr, W25QXX_ARRAY_MIRRORED);
+    CHECK(arr.capacity_kb == dev[0].capacity_kb);
+    CHECK(w25qxx_array_write(&arr, 0, data, sizeof(data)));
+    CHECK(memcmp(sim[0].mem, data, sizeof(data)) == 0);
+    CHECK(memcmp(sim[1].mem, data, sizeof(data)) == 0);
+
+    CHECK(w25qxx_array_eraseSector(&arr, 0));
+    t = w25qxx_sim_nowNs(&sim[0]);
+    CHECK(w25qxx_array_read(&arr, 0, back, 2 * arr.sector_size));
+    CHECK((w25qxx_sim_nowNs(&sim[0]) - t) < (sim[0].timing.t_se_us * 1000ull / 2));
+    for (uint32_t i = 0; i < arr.sector_size; ++i)
+        CHECK(back[i] == 0xFF);
+    CHECK(memcmp(back + arr.sector_size, data + arr.sector_size, arr.sector_size) == 0);
+    CHECK(w25qxx_array_sync(&arr));
+    for (int m = 0; m < 2; ++m){
+        for (uint32_t i = 0; i < arr.sector_size; ++i)
+            CHECK(sim[m].mem[i] == 0xFF);
+    }
+    arrayClose();
+
+    return 0;
+}
@@ -0,0 +1,166 @@
+#include <pthread.h>
+
+#include "w25qxx_test.h"
+#include "w25qxx_bus.h"
+
+/* Shared bus: submission order of overlapping requests, callbacks, combining and dedicated executors */
+
+static w25qxx_sim_t sim;
+static w25qxx_bus_t bus;
+static uint8_t image[0x10000];
+
+static w25qxx_op_status_t cb_status;
+static uint32_t cb_done;
+
+
+static void callback(w25qxx_bus_req_t *req)
+{
+    cb_status = req->status;
+    cb_done = req->done;
+}
+
+
+static void request(w25qxx_bus_req_t *req, w25qxx_bus_kind_t kind, uint32_t addr, uint8_t *rx,
+                    const uint8_t *tx, uint32_t len, w25qxx_bus_callback_t cb)
+{
+    memset(req, 0, sizeof(*req));
+    req->kind = kind;
+    req->addr = addr;
+    req->rx = rx;
+    req->tx = tx;
+    req->len = len;
+    req->callback = cb;
+    CHECK(w25qxx_bus_submit(&bus, req));
+}
+
+
+/* The simulator context is per thread, bind it before touching the bus */
+static void bind(void)
+{
+    w25qxx_dev_t tmp;
+
+    memset(&tmp, 0, sizeof(tmp));
+    w25qxx_sim_attach(&sim, &tmp);
+}
+
+
+static void *writer(void *arg)
+{
+    uint32_t base = 0x10000 * (uint32_t)(long)(arg);
+
+    bind();
+    for (int r = 0; r < 3; ++r){
+        CHECK(w25qxx_bus_erase(&bus, base, 0x10000));
+        CHECK(w25qxx_bus_write(&bus, base + 7, image, 5000));
+    }
+
+    return NULL;
+}
+
+
+static void *reader(void *arg)
+{
+    uint8_t b[300];
+
+    (void)arg;
+    bind();
+    for (uint32_t a = 4096; a < 44096; a += 100){      // sector 0 was rewritten above
+        CHECK(w25qxx_bus_read(&bus, a, b, sizeof(b)));
+        CHECK(memcmp(b, image + a, sizeof(b)) == 0);
+    }
+
+    return NULL;
+}
+
+
+static void *runner(void *arg)
+{
+    (void)arg;
+    bind();
+    w25qxx_bus_run(&bus);
+
+    return NULL;
+}
+
+
+/* Four writers and four readers, served by the waiting threads or by a dedicated one */
+static void threads(w25qxx_dev_t *dev, bool dedicated)
+{
+    pthread_t th[8], rt;
+
+    CHECK(w25qxx_bus_init(&bus, dev, NULL));
+    if (dedicated)
+        CHECK(pthread_create(&rt, NULL, runner, NULL) == 0);
+    for (long i = 0; i < 8; ++i)
+        CHECK(pthread_create(&th[i], NULL, (i < 4) ? writer : reader, (void *)(i + 1)) == 0);
+    for (int i = 0; i < 8; ++i)
+        pthread_join(th[i], NULL);
+    if (dedicated){
+        w25qxx_bus_stop(&bus);
+        pthread_join(rt, NULL);
+    }
+    w25qxx_bus_deinit(&bus);
+
+    for (uint32_t i = 1; i <= 4; ++i){
+        uint8_t *m = sim.mem + 0x10000 * i;
+
+        CHECK(memcmp(m + 7, image, 5000) == 0);
+        CHECK((m[6] == 0xFF) && (m[5007] == 0xFF));
+    }
+}
+
+
+int main(void)
+{
+    w25qxx_dev_t dev;
+    w25qxx_bus_req_t before, erase, write, after, far, bad;
+    uint8_t old[16], fresh[16], b_before[16], b_after[16], b_far[16];
+
+    test_open(&sim, &dev, W25Q128);
+    test_pattern(image, sizeof(image), 1);
+    test_pattern(fresh, sizeof(fresh), 2);
+    CHECK(w25qxx_dev_write(&dev, 0, image, sizeof(image)));
+    memcpy(old, image, sizeof(old));
+
+    CHECK(w25qxx_bus_init(&bus, &dev, NULL));
+    memset(&bad, 0, sizeof(bad));
+    bad.kind = W25QXX_BUS_ERASE;
+    bad.addr = 100;
+    bad.len = 4096;
+    CHECK(!w25qxx_bus_submit(&bus, &bad));         // erases are sector aligned
+
+    // a read sees the writes/erases submitted before it and only those, disjoint reads go first
+    request(&before, W25QXX_BUS_READ, 0, b_before, NULL, sizeof(b_before), NULL);
+    request(&erase, W25QXX_BUS_ERASE, 0, NULL, NULL, 4096, NULL);
+    request(&write, W25QXX_BUS_WRITE, 0, NULL, fresh, sizeof(fresh), callback);
+    request(&after, W25QXX_BUS_READ, 0, b_after, NULL, sizeof(b_after), NULL);
+    request(&far, W25QXX_BUS_READ, 0x8000, b_far, NULL, sizeof(b_far), NULL);
+
+    CHECK(w25qxx_bus_process(&bus));
+    CHECK(w25qxx_bus_process(&bus));
+    CHECK(w25qxx_bus_poll(&bus, &before) == W25QXX_OP_DONE);
+    CHECK(w25qxx_bus_poll(&bus, &far) == W25QXX_OP_DONE);
+    CHECK(w25qxx_bus_poll(&bus, &after) == W25QXX_OP_BUSY);
+    CHECK(memcmp(b_before, old, sizeof(old)) == 0);
+    CHECK(memcmp(b_far, image + 0x8000, sizeof(b_far)) == 0);
+
+    CHECK(w25qxx_bus_process(&bus));
+    CHECK(w25qxx_bus_poll(&bus, &erase) == W25QXX_OP_BUSY);
+    CHECK(w25qxx_bus_poll(&bus, &after) == W25QXX_OP_BUSY);
+
+    CHECK(w25qxx_bus_wait(&bus, &after));
+    CHECK(w25qxx_bus_poll(&bus, &erase) == W25QXX_OP_DONE);
+    CHECK(w25qxx_bus_poll(&bus, &write) == W25QXX_OP_DONE);
+    CHECK(memcmp(b_after, fresh, sizeof(fresh)) == 0);
+
+    // the callback runs before the status is published
+    CHECK(cb_status == W25QXX_OP_BUSY);
+    CHECK(cb_done == sizeof(fresh));
+    CHECK(!w25qxx_bus_process(&bus));
+    w25qxx_bus_deinit(&bus);
+
+    threads(&dev, false);
+    threads(&dev, true);
+
+    return 0;
+}
@@ -0,0 +1,69 @@
+#include "w25qxx_test.h"
+
+/* Flash CRC-32 against a bitwise reference, verified programs */
+
+static uint8_t data[1 << 18];
+
+
+static uint32_t reference(uint32_t crc, const uint8_t *d, uint32_t n)
+{
+    crc = ~crc;
+    while (n--){
+        crc ^= *d++;
+        for (int i = 0; i < 8; ++i)
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+    }
+
+    return ~crc;
+}
+
+
+int main(void)
+{
+    w25qxx_sim_t sim;
+    w25qxx_dev_t dev;
+    uint32_t seed = 1;
+    uint32_t crc, a;
+    uint8_t ones[16];
+
+    CHECK(w25qxx_crc32Update(0, (const uint8_t *)"123456789", 9) == 0xCBF43926);
+
+    // any split of the input gives the same result
+    test_pattern(data, sizeof(data), 1);
+    for (int k = 0; k < 200; ++k){
+        uint32_t off, n;
+
+        seed = seed * 1103515245u + 12345u;
+        off = (seed >> 4) % 1000;
+        n = (seed >> 16) % 3000;
+        a = w25qxx_crc32Update(0, data + off, n / 3);
+        a = w25qxx_crc32Update(a, data + off + n / 3, n - n / 3);
+        CHECK(a == reference(0, data + off, n));
+    }
+
+    // the flash CRC streams the chip through a small buffer, at any alignment
+    test_open(&sim, &dev, W25Q64);
+    memcpy(sim.mem + 1000, data, sizeof(data));
+    CHECK(w25qxx_dev_crc32(&dev, 1000, sizeof(data), &crc));
+    CHECK(crc == reference(0, data, sizeof(data)));
+    CHECK(w25qxx_dev_crc32(&dev, 1013, 777, &crc));
+    CHECK(crc == reference(0, data + 13, 777));
+    CHECK(!w25qxx_dev_crc32(&dev, 8u << 20, 1, &crc));
+
+    // verify mode reads every blocking program back
+    w25qxx_dev_setVerify(&dev, true);
+    CHECK(w25qxx_dev_erase(&dev, 0, 8192));
+    CHECK(w25qxx_dev_writeSector(&dev, data, 0, 0, 4096));
+    CHECK(memcmp(sim.mem, data, 4096) == 0);
+    memset(ones, 0xFF, sizeof(ones));
+    ones[3] = 0x5A;
+    CHECK(!w25qxx_dev_writePage(&dev, ones, 0, 0, sizeof(ones)));      // programs cannot set bits
+    CHECK(w25qxx_dev_writeSector(&dev, data, 1, 0, 4096));
+    CHECK(w25qxx_dev_verify(&dev, 4096, data, 4096));
+    CHECK(!w25qxx_dev_verify(&dev, 4096, data + 1, 4096));
+
+    w25qxx_dev_setVerify(&dev, false);
+    CHECK(w25qxx_dev_writePage(&dev, ones, 0, 0, sizeof(ones)));
+
+    return 0;
+}
@@ -0,0 +1,125 @@
+#include "w25qxx_test.h"
+#include "w25qxx_emap.h"
+
+/* Erase map: blank scan, discard, background erase, prepare skipping erased sectors, saved and stale copies, failed erases */
+
+static uint8_t map[W25QXX_EMAP_BYTES(2048)], saved[sizeof(map)];
+static uint8_t data[0x10000];
+
+static bool stuck;
+static w25qxx_interface_transfer_t next;
+
+
+/* A chip that never leaves busy once stuck is set: erases time out */
+static uint8_t stuckTransfer(const w25qxx_transfer_t *xfer)
+{
+    uint8_t res = next(xfer);
+
+    if (stuck && xfer->header_len && (xfer->header[0] == 0x05) && xfer->rx)
+        xfer->rx[0] |= 0x01;
+
+    return res;
+}
+
+
+static void idle(w25qxx_emap_t *m, w25qxx_dev_t *dev)
+{
+    w25qxx_op_status_t status;
+
+    while ((status = w25qxx_emap_idle(m)) == W25QXX_OP_BUSY)
+        dev->delay(1);
+    CHECK(status == W25QXX_OP_DONE);
+}
+
+
+int main(void)
+{
+    w25qxx_sim_t sim;
+    w25qxx_dev_t dev;
+    w25qxx_emap_t m;
+    uint32_t skipped;
+    w25qxx_op_status_t status;
+
+    test_open(&sim, &dev, W25Q64);
+    test_pattern(data, sizeof(data), 1);
+    CHECK(w25qxx_dev_write(&dev, 3 * 4096 + 4000, data, 200));     // sectors 3 and 4
+    CHECK(w25qxx_dev_write(&dev, 100 * 4096 + 4095, data, 1));
+
+    CHECK(w25qxx_emap_mount(&m, &dev, map, NULL));
+    for (uint32_t s = 0; s < dev.sector_count; ++s)
+        CHECK(w25qxx_emap_state(&m, s) == (((s == 3) || (s == 4) || (s == 100)) ? W25QXX_EMAP_DIRTY : W25QXX_EMAP_ERASED));
+
+    // programs through the driver mark sectors dirty, discard only takes whole sectors
+    CHECK(w25qxx_dev_write(&dev, 32 * 4096, data, 16 * 4096));
+    CHECK(w25qxx_dev_write(&dev, 200 * 4096, data, 10));
+    CHECK(w25qxx_emap_state(&m, 40) == W25QXX_EMAP_DIRTY);
+    CHECK(w25qxx_emap_discard(&m, 32 * 4096 - 100, 16 * 4096 + 200));
+    CHECK(m.free_count == 16);
+    CHECK(w25qxx_emap_discard(&m, 200 * 4096, 4096));
+    CHECK(m.free_count == 17);
+    CHECK(w25qxx_emap_state(&m, 3) == W25QXX_EMAP_DIRTY);
+    w25qxx_emap_save(&m, saved);
+    CHECK(!m.changed);
+
+    // the background erase takes the 64KB block in one erase
+    idle(&m, &dev);
+    CHECK((m.pre_erased == 17) && (m.free_count == 0));
+    for (uint32_t i = 0; i < 16 * 4096; ++i)
+        CHECK(sim.mem[32 * 4096 + i] == 0xFF);
+    CHECK(sim.mem[200 * 4096] == 0xFF);
+
+    // prepare erases only what is not erased yet
+    skipped = m.erases_skipped;
+    CHECK(w25qxx_emap_prepare(&m, 32 * 4096, 16 * 4096));
+    CHECK((m.erases_skipped - skipped) == 16);
+    CHECK(w25qxx_emap_prepare(&m, 0, 8 * 4096));
+    CHECK((m.erases_skipped - skipped) == 22);
+    for (uint32_t i = 0; i < 8 * 4096; ++i)
+        CHECK(sim.mem[i] == 0xFF);
+    CHECK(!w25qxx_emap_prepare(&m, 5, 4096));
+
+    // a saved copy is taken as is, a corrupt one is rejected
+    CHECK(w25qxx_emap_unmount(&m));
+    CHECK(w25qxx_emap_mount(&m, &dev, map, saved));
+    CHECK((m.free_count == 17) && !m.changed);
+    CHECK(w25qxx_emap_unmount(&m));
+    saved[10] |= 0x03 << 4;
+    CHECK(!w25qxx_emap_mount(&m, &dev, map, saved));
+
+    // a stale copy calling a programmed sector erased: prepare still erases it
+    CHECK(w25qxx_emap_mount(&m, &dev, map, NULL));
+    w25qxx_emap_save(&m, saved);
+    CHECK(w25qxx_emap_unmount(&m));
+    CHECK(w25qxx_dev_write(&dev, 150 * 4096 + 4000, data, 10));
+    CHECK(w25qxx_emap_mount(&m, &dev, map, saved));
+    CHECK(w25qxx_emap_state(&m, 150) == W25QXX_EMAP_ERASED);
+    skipped = m.erases_skipped;
+    CHECK(w25qxx_emap_prepare(&m, 149 * 4096, 3 * 4096));
+    CHECK((m.stale_erased == 1) && ((m.erases_skipped - skipped) == 2));
+    for (uint32_t i = 0; i < 4096; ++i)
+        CHECK(sim.mem[150 * 4096 + i] == 0xFF);
+    CHECK(w25qxx_emap_unmount(&m));
+
+    // an erase that times out puts its sector back to dirty
+    CHECK(w25qxx_emap_mount(&m, &dev, map, NULL));
+    CHECK(w25qxx_dev_write(&dev, 64 * 4096, data, 4096));
+    CHECK(w25qxx_emap_discard(&m, 64 * 4096, 4096));
+    CHECK(m.free_count == 1);
+
+    next = dev.interface_transfer;
+    dev.interface_transfer = stuckTransfer;
+    CHECK(w25qxx_emap_idle(&m) == W25QXX_OP_BUSY);
+    CHECK(w25qxx_emap_state(&m, 64) == W25QXX_EMAP_ERASED);
+    stuck = true;
+    while ((status = w25qxx_emap_idle(&m)) == W25QXX_OP_BUSY)
+        dev.delay(1);
+    stuck = false;
+    CHECK(status == W25QXX_OP_ERROR);
+    CHECK(m.erase_errors == 1);
+    CHECK(w25qxx_emap_state(&m, 64) == W25QXX_EMAP_DIRTY);
+    CHECK(m.free_count == 0);
+    CHECK(w25qxx_emap_idle(&m) == W25QXX_OP_DONE);
+    CHECK(w25qxx_emap_unmount(&m));
+
+    return 0;
+}
@@ -0,0 +1,67 @@
+#include "w25qxx_test.h"
+
+/* Range erase planner: 64KB middles, 32KB and 4KB edges, chip erase for the whole device */
+
+static uint32_t opcodes[256];
+static w25qxx_interface_transfer_t next;
+
+
+static uint8_t countTransfer(const w25qxx_transfer_t *xfer)
+{
+    if (xfer->header_len)
+        opcodes[xfer->header[0]]++;
+
+    return next(xfer);
+}
+
+
+static bool erased(w25qxx_sim_t *sim, uint32_t addr, uint32_t len)
+{
+    for (uint32_t i = 0; i < len; ++i){
+        if (sim->mem[addr + i] != 0xFF)
+            return false;
+    }
+
+    return true;
+}
+
+
+int main(void)
+{
+    w25qxx_sim_t sim;
+    w25qxx_dev_t dev;
+    uint32_t addr = 3 * 4096;
+    uint32_t end = 5 * 65536 + 9 * 4096;
+
+    test_open(&sim, &dev, W25Q64);
+    memset(sim.mem, 0x00, sim.capacity);
+    next = dev.interface_transfer;
+    dev.interface_transfer = countTransfer;
+
+    // sectors 3-7, 32KB at 8, blocks 1-4, 32KB at block 5, sector 88
+    CHECK(w25qxx_dev_erase(&dev, addr, end - addr));
+    CHECK(opcodes[0x20] == 6);
+    CHECK(opcodes[0x52] == 2);
+    CHECK(opcodes[0xD8] == 4);
+    CHECK(erased(&sim, addr, end - addr));
+    CHECK((sim.mem[addr - 1] == 0x00) && (sim.mem[end] == 0x00));
+    CHECK(!w25qxx_dev_erase(&dev, 100, 4096));
+    CHECK(!w25qxx_dev_erase(&dev, 0, 100));
+
+    // one sector short of the whole device: 127 blocks, 32KB and 7 sectors at the end
+    memset(sim.mem, 0x00, sim.capacity);
+    memset(opcodes, 0, sizeof(opcodes));
+    CHECK(w25qxx_dev_erase(&dev, 0, sim.capacity - 4096));
+    CHECK((opcodes[0xD8] == 127) && (opcodes[0x52] == 1) && (opcodes[0x20] == 7));
+    CHECK((opcodes[0x60] == 0) && (opcodes[0xC7] == 0));
+    CHECK(erased(&sim, 0, sim.capacity - 4096) && (sim.mem[sim.capacity - 1] == 0x00));
+
+    // the whole device is one chip erase
+    memset(opcodes, 0, sizeof(opcodes));
+    CHECK(w25qxx_dev_erase(&dev, 0, sim.capacity));
+    CHECK((opcodes[0x60] + opcodes[0xC7]) == 1);
+    CHECK((opcodes[0xD8] == 0) && (opcodes[0x52] == 0) && (opcodes[0x20] == 0));
+    CHECK(erased(&sim, 0, sim.capacity));
+
+    return 0;
+}
@@ -0,0 +1,135 @@
+#include "w25qxx_test.h"
+#include "w25qxx_ftl.h"
+
+/* Wear leveling: random writes against a reference across remounts, wear spread, power cuts */
+
+#define SECTORS     64
+#define FIRST       16
+
+static uint32_t map[W25QXX_FTL_MAP_ENTRIES(SECTORS)];
+static w25qxx_ftl_sector_t sectors[SECTORS];
+static uint8_t ref[SECTORS * 4096], back[SECTORS * 4096], old[SECTORS * 4096];
+
+static w25qxx_sim_t sim;
+static w25qxx_dev_t dev;
+static w25qxx_ftl_t ftl;
+static uint32_t capacity;
+
+
+static void compare(void)
+{
+    CHECK(w25qxx_ftl_read(&ftl, 0, back, capacity));
+    CHECK(memcmp(back, ref, capacity) == 0);
+}
+
+
+/* Power up again with garbage in the RAM tables */
+static void remount(void)
+{
+    test_reboot(&sim, &dev);
+    memset(map, 0xAA, sizeof(map));
+    memset(sectors, 0x55, sizeof(sectors));
+    CHECK(w25qxx_ftl_mount(&ftl, &dev, FIRST, SECTORS, map, sectors));
+}
+
+
+int main(void)
+{
+    uint32_t seed = 7;
+    uint32_t min = W25QXX_FTL_NONE, max = 0;
+    uint32_t pages, landed;
+    uint8_t b[300];
+    jmp_buf power;
+
+    test_open(&sim, &dev, W25Q16);
+    CHECK(w25qxx_ftl_format(&ftl, &dev, FIRST, SECTORS, map, sectors));
+    capacity = ftl.capacity_kb * 1024;
+    memset(ref, 0xFF, capacity);
+    compare();
+
+    test_pattern(ref, capacity, 1);
+    CHECK(w25qxx_ftl_write(&ftl, 0, ref, capacity));
+    compare();
+
+    // hot spot writes, remounted from a checkpoint, by replaying the heads and by a full scan
+    for (int round = 0; round < 6; ++round){
+        for (int it = 0; it < 2000; ++it){
+            uint32_t addr, len;
+
+            seed = seed * 1103515245u + 12345u;
+            addr = ((seed % 10) ? ((seed >> 8) % 8192) : ((seed >> 8) % capacity));
+            len = 1 + (seed >> 20) % sizeof(b);
+            if (len > (capacity - addr))
+                len = capacity - addr;
+            test_pattern(b, len, seed);
+            CHECK(w25qxx_ftl_write(&ftl, addr, b, len));
+            memcpy(ref + addr, b, len);
+
+            if ((it % 500) == 0){
+                while (w25qxx_ftl_idle(&ftl))
+                    ;
+            }
+        }
+        compare();
+
+        if ((round % 3) == 0){
+            CHECK(w25qxx_ftl_sync(&ftl));
+        }else if ((round % 3) == 2){
+            memset(sim.mem + (FIRST + ftl.data_sectors) * 4096, 0xFF, 2 * ftl.ckpt_sectors * 4096);
+        }
+        remount();
+        compare();
+    }
+
+    // erases spread over the region even with a hot spot
+    for (uint32_t s = 0; s < ftl.data_sectors; ++s){
+        if (sectors[s].erase_count < min)
+            min = sectors[s].erase_count;
+        if (sectors[s].erase_count > max)
+            max = sectors[s].erase_count;
+    }
+    CHECK((max - min) <= 2 * W25QXX_FTL_WEAR_DELTA);
+
+    // power lost in the middle of rewriting every page: each page is old or new, new ones in write order
+    pages = capacity / dev.page_size;
+    for (int cut = 1; cut < 400; cut = cut * 3 + 1){
+        memcpy(old, ref, capacity);
+        test_pattern(ref, capacity, 100 + cut);
+        test_cut_jump = &power;
+        test_cutAfter(&dev, cut);
+        if (setjmp(power) == 0){
+            w25qxx_ftl_write(&ftl, 0, ref, capacity);
+            CHECK(!"power loss");       // the cut always comes first
+        }
+        test_cut_jump = NULL;
+        remount();
+        CHECK(w25qxx_ftl_read(&ftl, 0, back, capacity));
+
+        landed = 0;
+        for (uint32_t p = 0; p < pages; ++p){
+            uint32_t off = p * dev.page_size;
+
+            if (memcmp(back + off, ref + off, dev.page_size) == 0){
+                CHECK(landed == p);
+                landed++;
+            }else{
+                CHECK(memcmp(back + off, old + off, dev.page_size) == 0);
+            }
+        }
+        CHECK(landed < pages);
+        memcpy(ref, back, capacity);
+
+        // and the layer keeps working from there
+        test_pattern(b, sizeof(b), cut + 1);
+        CHECK(w25qxx_ftl_write(&ftl, 1000, b, sizeof(b)));
+        memcpy(ref + 1000, b, sizeof(b));
+        remount();
+        compare();
+    }
+
+    // nothing outside the region was touched
+    for (uint32_t a = 0; a < FIRST * 4096; ++a)
+        CHECK(sim.mem[a] == 0xFF);
+
+    return 0;
+}
@@ -0,0 +1,153 @@
+#include "w25qxx_test.h"
+#include "w25qxx_kv.h"
+
+/* Key-value store: random sets and deletes against a reference, compaction, remounts, torn records, read errors */
+
+#define KEYS        200
+#define SEGMENTS    6
+#define FIRST       10
+
+static w25qxx_sim_t sim;
+static w25qxx_dev_t dev;
+static w25qxx_kv_t kv;
+static w25qxx_kv_entry_t index_[512];
+
+static uint8_t ref_value[KEYS][100];
+static int ref_len[KEYS];
+
+static uint32_t compactions;
+static bool failing;
+static w25qxx_interface_transfer_t next;
+
+
+/* Data reads fail while failing is set, status register reads still work */
+static uint8_t failTransfer(const w25qxx_transfer_t *xfer)
+{
+    if (failing && xfer->rx && (xfer->len > 1))
+        return 1;
+
+    return next(xfer);
+}
+
+
+static void key(int i, char *k)
+{
+    sprintf(k, "key/%d/%.*s", i, i % 20, "abcdefghijklmnopqrstuvwxyz");
+}
+
+
+static void compare(void)
+{
+    uint32_t live = 0;
+
+    for (int i = 0; i < KEYS; ++i){
+        char k[80];
+        uint8_t v[200];
+        uint16_t len = sizeof(v);
+
+        key(i, k);
+        if (ref_len[i] < 0){
+            CHECK(w25qxx_kv_get(&kv, k, v, &len) == W25QXX_KV_NOT_FOUND);
+            continue;
+        }
+
+        live++;
+        CHECK(w25qxx_kv_get(&kv, k, v, &len) == W25QXX_KV_OK);
+        CHECK((len == ref_len[i]) && (memcmp(v, ref_value[i], len) == 0));
+    }
+
+    CHECK(kv.count == live);
+}
+
+
+static void remount(void)
+{
+    compactions += kv.compactions;
+    test_reboot(&sim, &dev);
+    CHECK(w25qxx_kv_mount(&kv, &dev, FIRST, SEGMENTS, index_, 512));
+}
+
+
+int main(void)
+{
+    uint32_t seed = 3;
+    uint8_t v[100];
+    uint16_t len;
+    uint32_t count;
+
+    test_open(&sim, &dev, W25Q16);
+    CHECK(w25qxx_kv_format(&kv, &dev, FIRST, SEGMENTS, index_, 512));
+    for (int i = 0; i < KEYS; ++i)
+        ref_len[i] = -1;
+    compare();
+
+    // enough traffic for many compactions, the store survives every remount
+    for (int it = 0; it < 8000; ++it){
+        char k[80];
+        int i;
+
+        seed = seed * 1103515245u + 12345u;
+        i = (seed >> 16) % KEYS;
+        key(i, k);
+
+        if ((seed % 5) == 0){
+            CHECK(w25qxx_kv_delete(&kv, k) == ((ref_len[i] >= 0) ? W25QXX_KV_OK : W25QXX_KV_NOT_FOUND));
+            ref_len[i] = -1;
+        }else{
+            len = (seed >> 8) % 100;
+            test_pattern(v, len, seed);
+            CHECK(w25qxx_kv_set(&kv, k, v, len));
+            memcpy(ref_value[i], v, len);
+            ref_len[i] = len;
+        }
+
+        if ((it % 2000) == 1999){
+            compare();
+            remount();
+            compare();
+        }
+    }
+    CHECK(compactions > 0);
+
+    // a torn append is dropped at mount and appends continue after it
+    memset(v, 0xAA, 50);
+    CHECK(w25qxx_kv_set(&kv, "torn", v, 50));
+    sim.mem[kv.write_addr - 10] &= 0x0F;
+    remount();
+    len = 50;
+    CHECK(w25qxx_kv_get(&kv, "torn", v, &len) == W25QXX_KV_NOT_FOUND);
+    CHECK(w25qxx_kv_set(&kv, "after", v, 10));
+    remount();
+    len = 50;
+    CHECK(w25qxx_kv_get(&kv, "after", v, &len) == W25QXX_KV_OK);
+    CHECK(w25qxx_kv_delete(&kv, "after") == W25QXX_KV_OK);
+    compare();
+
+    // read errors are errors, not missing keys: no duplicate from set, no lost key from get
+    next = dev.interface_transfer;
+    dev.interface_transfer = failTransfer;
+    count = kv.count;
+    failing = true;
+    for (int i = 0; i < KEYS; ++i){
+        char k[80];
+
+        if (ref_len[i] < 0)
+            continue;
+        key(i, k);
+        len = sizeof(v);
+        CHECK(w25qxx_kv_get(&kv, k, v, &len) == W25QXX_KV_ERROR);
+        CHECK(!w25qxx_kv_set(&kv, k, v, 1));
+        CHECK(w25qxx_kv_delete(&kv, k) == W25QXX_KV_ERROR);
+    }
+    CHECK(!w25qxx_kv_mount(&kv, &dev, FIRST, SEGMENTS, index_, 512));
+    failing = false;
+    CHECK(w25qxx_kv_mount(&kv, &dev, FIRST, SEGMENTS, index_, 512));
+    CHECK(kv.count == count);
+    compare();
+
+    // nothing outside the region was touched
+    for (uint32_t a = 0; a < FIRST * dev.sector_size; ++a)
+        CHECK(sim.mem[a] == 0xFF);
+
+    return 0;
+}
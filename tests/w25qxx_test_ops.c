@@ -0,0 +1,75 @@
+#include "w25qxx_test.h"
+
+/* Non-blocking operations: erase and multi-page program through opPoll, callbacks, one operation at a time, deferred starts */
+
+static uint8_t data[10000], back[10000];
+static int callbacks;
+
+
+static void callback(w25qxx_op_t *op)
+{
+    (void)op;
+    callbacks++;
+}
+
+
+static bool erased(w25qxx_sim_t *sim, uint32_t addr, uint32_t len)
+{
+    for (uint32_t i = 0; i < len; ++i){
+        if (sim->mem[addr + i] != 0xFF)
+            return false;
+    }
+
+    return true;
+}
+
+
+int main(void)
+{
+    w25qxx_sim_t sim;
+    w25qxx_dev_t dev;
+    w25qxx_op_t op, op2;
+
+    test_open(&sim, &dev, W25Q64);
+
+    // erase and program run to completion through opPoll, once callback each
+    test_pattern(data, sizeof(data), 1);
+    memset(sim.mem + 65536, 0x00, 65536);
+    CHECK(w25qxx_dev_eraseBlockStart(&dev, &op, 1, callback));
+    while (w25qxx_opPoll(&op) == W25QXX_OP_BUSY)
+        dev.delay(1);
+    CHECK((op.status == W25QXX_OP_DONE) && (callbacks == 1) && (dev.pending == NULL));
+    CHECK(erased(&sim, 65536, 65536));
+
+    CHECK(w25qxx_dev_writeStart(&dev, &op, 65536 + 77, data, sizeof(data), callback));
+    CHECK(w25qxx_opPoll(&op) == W25QXX_OP_BUSY);
+    while (w25qxx_opPoll(&op) == W25QXX_OP_BUSY)
+        dev.delay(1);
+    CHECK((op.status == W25QXX_OP_DONE) && (callbacks == 2));
+    CHECK(w25qxx_dev_read(&dev, 65536 + 77, back, sizeof(back)));
+    CHECK(memcmp(back, data, sizeof(data)) == 0);
+
+    // a second start while one is running is refused and leaves the first alone
+    memset(sim.mem + 100 * 4096, 0x00, 4096);
+    CHECK(w25qxx_dev_eraseSectorStart(&dev, &op, 100, NULL));
+    CHECK(!w25qxx_dev_writePageStart(&dev, &op2, data, 100 * 16, 0, 16, NULL));
+    CHECK(!w25qxx_dev_eraseSectorStart(&dev, &op2, 101, NULL));
+    CHECK(dev.pending == &op);
+    while (w25qxx_opPoll(&op) == W25QXX_OP_BUSY)
+        dev.delay(1);
+    CHECK((op.status == W25QXX_OP_DONE) && (dev.pending == NULL));
+    CHECK(erased(&sim, 100 * 4096, 4096));
+
+    // a start while the chip is busy (another master) is deferred until it is idle
+    sim.sr[0] |= 0x01;
+    sim.busy_until_ns = w25qxx_sim_nowNs(&sim) + 5000000;
+    CHECK(w25qxx_dev_writePageStart(&dev, &op2, data, 100 * 16, 0, 16, NULL));
+    CHECK(erased(&sim, 100 * 4096, 16));
+    while (w25qxx_opPoll(&op2) == W25QXX_OP_BUSY)
+        dev.delay(1);
+    CHECK(op2.status == W25QXX_OP_DONE);
+    CHECK(memcmp(sim.mem + 100 * 4096, data, 16) == 0);
+    CHECK(erased(&sim, 100 * 4096 + 16, 4096 - 16));
+
+    return 0;
+}
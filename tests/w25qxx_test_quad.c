@@ -0,0 +1,110 @@
+#include "w25qxx_test.h"
+
+/* Quad wiring: init sets QE for Quad I/O reads, Quad Page Program clocks 32h/34h on four lines */
+
+static w25qxx_interface_transfer_t next;
+static uint8_t program_cmd, program_lines;
+static uint8_t data[256], back[256];
+
+
+/* Record the opcode and data lines of page programs */
+static uint8_t spyTransfer(const w25qxx_transfer_t *xfer)
+{
+    if (xfer->header_len && xfer->tx){
+        switch (xfer->header[0])
+        {
+            case 0x02: case 0x12: case 0x32: case 0x34:
+                program_cmd = xfer->header[0];
+                program_lines = xfer->data_lines;
+                break;
+            default:
+                break;
+        }
+    }
+
+    return next(xfer);
+}
+
+
+/* Open an erased part wired with lines data lines */
+static void openWired(w25qxx_sim_t *sim, w25qxx_dev_t *dev, w25qxx_t type, uint8_t lines)
+{
+#ifdef W25QXX_FIXED_TYPE
+    if (type != W25QXX_FIXED_TYPE)
+        exit(W25QXX_TEST_SKIP);
+#endif
+
+    CHECK(w25qxx_sim_open(sim, type, NULL, NULL));
+    memset(dev, 0, sizeof(*dev));
+    w25qxx_sim_attach(sim, dev);
+    dev->bus_lines = lines;
+    CHECK(w25qxx_dev_init(dev));
+    next = dev->interface_transfer;
+    dev->interface_transfer = spyTransfer;
+}
+
+
+/* Program page through the driver, returns the opcode it used */
+static uint8_t program(w25qxx_sim_t *sim, w25qxx_dev_t *dev, uint32_t page, uint32_t seed)
+{
+    test_pattern(data, sizeof(data), seed);
+    program_cmd = 0;
+    program_lines = 0;
+    CHECK(w25qxx_dev_writePage(dev, data, page, 0, sizeof(data)));
+    CHECK(memcmp(&sim->mem[page * sizeof(data)], data, sizeof(data)) == 0);
+    CHECK(w25qxx_dev_read(dev, page * sizeof(data), back, sizeof(back)));
+    CHECK(memcmp(back, data, sizeof(data)) == 0);
+
+    return program_cmd;
+}
+
+
+int main(void)
+{
+    w25qxx_sim_t sim;
+    w25qxx_dev_t dev;
+
+    // single line wiring leaves QE alone and programs with 02h
+    openWired(&sim, &dev, W25Q64, 1);
+    CHECK((sim.sr[1] & 0x02) == 0);
+    CHECK(dev.read_mode == W25QXX_READ_FAST);
+    CHECK(program(&sim, &dev, 0, 1) == 0x02);
+    CHECK(program_lines == 1);
+    w25qxx_sim_close(&sim);
+
+    // four lines: init sets QE and picks Quad I/O reads, page programs stay 02h until asked
+    openWired(&sim, &dev, W25Q64, 4);
+    CHECK((sim.sr[1] & 0x02) != 0);
+    CHECK(dev.read_mode == W25QXX_READ_QUAD_IO);
+    CHECK(program(&sim, &dev, 0, 2) == 0x02);
+
+    CHECK(w25qxx_dev_setQuadProgram(&dev, true));
+    CHECK(program(&sim, &dev, 1, 3) == 0x32);
+    CHECK((program_lines == 4) && ((sim.sr[1] & 0x02) != 0));
+
+    // QE cleared behind the driver: a quad program sets it again before 32h
+    CHECK(w25qxx_dev_setReadMode(&dev, W25QXX_READ_FAST));
+    CHECK(w25qxx_dev_setQuadEnable(&dev, false));
+    CHECK((sim.sr[1] & 0x02) == 0);
+    CHECK(w25qxx_dev_setQuadProgram(&dev, true));
+    CHECK((sim.sr[1] & 0x02) != 0);
+    CHECK(program(&sim, &dev, 2, 4) == 0x32);
+
+    // back to single line programs, QE stays set for the quad reads
+    CHECK(w25qxx_dev_setQuadProgram(&dev, false));
+    CHECK(program(&sim, &dev, 3, 5) == 0x02);
+    CHECK((program_lines == 1) && ((sim.sr[1] & 0x02) != 0));
+    w25qxx_sim_close(&sim);
+
+#ifndef W25QXX_FIXED_TYPE
+    // 4-byte address parts use the 34h form
+    openWired(&sim, &dev, W25Q256, 4);
+    CHECK((sim.sr[1] & 0x02) != 0);
+    CHECK(w25qxx_dev_setQuadProgram(&dev, true));
+    CHECK(program(&sim, &dev, dev.page_count - 1, 6) == 0x34);
+    CHECK(program_lines == 4);
+    w25qxx_sim_close(&sim);
+#endif
+
+    return 0;
+}
@@ -0,0 +1,76 @@
+#include "w25qxx_test.h"
+#include "w25qxx_rcache.h"
+
+/* Read cache: hits, read-ahead, invalidation by programs and erases, single byte reads */
+
+static uint8_t data[8192], back[8192];
+static uint8_t pool[16 * 256];
+
+
+int main(void)
+{
+    w25qxx_sim_t sim;
+    w25qxx_dev_t dev;
+    w25qxx_rcache_t rc;
+    w25qxx_op_t op;
+    uint64_t tx;
+    uint8_t b;
+
+    test_open(&sim, &dev, W25Q64);
+    test_pattern(data, sizeof(data), 1);
+    CHECK(w25qxx_dev_write(&dev, 0, data, sizeof(data)));
+
+    CHECK(!w25qxx_rcache_init(&rc, &dev, pool, 3, 4, 4));      // set count must be a power of two
+    CHECK(w25qxx_rcache_init(&rc, &dev, pool, 4, 4, 8));
+
+    // 4096 field by field reads of a stream cost about one read per page
+    tx = sim.stats.transactions;
+    for (uint32_t a = 0; a < sizeof(data); a += 2)
+        CHECK(w25qxx_rcache_read(&rc, a, back + a, 2));
+    CHECK(memcmp(back, data, sizeof(data)) == 0);
+    CHECK((sim.stats.transactions - tx) < 64);
+    CHECK(rc.misses < 8);
+    CHECK(rc.prefetched > 0);
+
+    // programs and erases through the driver drop the lines they touch
+    CHECK(w25qxx_rcache_read(&rc, 4096, back, 16));
+    b = 0x00;
+    CHECK(w25qxx_dev_writeByte(&dev, &b, 4096 + 3));
+    CHECK(w25qxx_rcache_read(&rc, 4096, back, 16));
+    CHECK(back[3] == 0x00);
+    CHECK(w25qxx_dev_eraseSector(&dev, 1));
+    CHECK(w25qxx_rcache_read(&rc, 4096, back, 16));
+    for (int i = 0; i < 16; ++i)
+        CHECK(back[i] == 0xFF);
+
+    // a miss during a non-blocking erase of that sector caches the erased contents, not stale data
+    CHECK(w25qxx_rcache_read(&rc, 0, back, 16));
+    CHECK(w25qxx_dev_eraseSectorStart(&dev, &op, 0, NULL));
+    CHECK(w25qxx_rcache_read(&rc, 0, back, 16));
+    for (int i = 0; i < 16; ++i)
+        CHECK(back[i] == 0xFF);
+    while (w25qxx_opPoll(&op) == W25QXX_OP_BUSY)
+        dev.delay(1);
+    CHECK(w25qxx_rcache_read(&rc, 0, back, 16));
+    for (int i = 0; i < 16; ++i)
+        CHECK(back[i] == 0xFF);
+    w25qxx_rcache_deinit(&rc);
+
+    // single byte reads: one transaction, and they suspend like any other read
+    CHECK(w25qxx_dev_write(&dev, 0x20000, data, sizeof(data)));
+    tx = sim.stats.transactions;
+    CHECK(w25qxx_dev_readByte(&dev, &b, 0x20000 + 8191));
+    CHECK(b == data[8191]);
+    CHECK((sim.stats.transactions - tx) == 1);
+
+    w25qxx_dev_setSuspendLimit(&dev, 4);
+    CHECK(w25qxx_dev_eraseSectorStart(&dev, &op, 0, NULL));
+    CHECK(w25qxx_dev_readByte(&dev, &b, 0x20000 + 8000));
+    CHECK(b == data[8000]);
+    CHECK(op.suspends == 1);
+    while (w25qxx_opPoll(&op) == W25QXX_OP_BUSY)
+        dev.delay(1);
+    CHECK(!w25qxx_dev_readByte(&dev, &b, 8u << 20));
+
+    return 0;
+}
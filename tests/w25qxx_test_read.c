@@ -0,0 +1,32 @@
+#include "w25qxx_test.h"
+
+/* Linear reads: one command for any range, clamped at the end of the chip */
+
+static uint8_t back[100000];
+
+
+int main(void)
+{
+    w25qxx_sim_t sim;
+    w25qxx_dev_t dev;
+    uint64_t tx;
+
+    test_open(&sim, &dev, W25Q64);
+    test_pattern(sim.mem, sim.capacity, 1);
+
+    // across pages, sectors and blocks in a single transaction
+    tx = sim.stats.transactions;
+    CHECK(w25qxx_dev_read(&dev, 65536 - 1234, back, sizeof(back)));
+    CHECK((sim.stats.transactions - tx) == 1);
+    CHECK(memcmp(back, sim.mem + 65536 - 1234, sizeof(back)) == 0);
+
+    memset(back, 0, sizeof(back));
+    CHECK(w25qxx_dev_read(&dev, sim.capacity - 10, back, sizeof(back)));
+    CHECK(memcmp(back, sim.mem + sim.capacity - 10, 10) == 0);
+    CHECK(back[10] == 0);
+
+    CHECK(!w25qxx_dev_read(&dev, sim.capacity, back, 1));
+    CHECK(!w25qxx_dev_read(&dev, 0, back, 0));
+
+    return 0;
+}
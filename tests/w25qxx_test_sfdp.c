@@ -0,0 +1,90 @@
+#include "w25qxx_test.h"
+
+/* SFDP discovery: a full BFPT is decoded, restricted tables are honoured, no table falls back to the JEDEC ID */
+
+#ifndef W25QXX_FIXED_TYPE
+static uint32_t bfptDword(w25qxx_sim_t *sim, uint8_t n)
+{
+    uint32_t v;
+
+    memcpy(&v, &sim->sfdp[0x80 + 4 * n], sizeof(v));
+    return v;
+}
+
+
+static void bfptSet(w25qxx_sim_t *sim, uint8_t n, uint32_t v)
+{
+    memcpy(&sim->sfdp[0x80 + 4 * n], &v, sizeof(v));
+}
+
+
+static void openRaw(w25qxx_sim_t *sim, w25qxx_dev_t *dev, w25qxx_t type)
+{
+    CHECK(w25qxx_sim_open(sim, type, NULL, NULL));
+    memset(dev, 0, sizeof(*dev));
+    w25qxx_sim_attach(sim, dev);
+}
+#endif
+
+
+int main(void)
+{
+#ifdef W25QXX_FIXED_TYPE
+    return W25QXX_TEST_SKIP;        // discovery is compiled out
+#else
+    w25qxx_sim_t sim;
+    w25qxx_dev_t dev;
+    uint32_t dw11;
+
+    // the simulator serves a complete Winbond style table, first/additional byte times included
+    openRaw(&sim, &dev, W25Q64);
+    dw11 = bfptDword(&sim, 10);
+    CHECK(((dw11 >> 14) & 0x3FF) != 0);
+    CHECK(w25qxx_dev_init(&dev));
+    CHECK(dev.sfdp);
+    CHECK(dev.type == W25Q64);
+    CHECK(dev.capacity_kb == 8192);
+    CHECK(dev.page_size == 256);
+    CHECK(dev.addr_mode == W25QXX_ADDR_3BYTE);
+    CHECK(dev.erase_sizes == (W25QXX_ERASE_4K | W25QXX_ERASE_32K | W25QXX_ERASE_64K));
+    CHECK(dev.read_modes & (1 << W25QXX_READ_QUAD_IO));
+    CHECK(dev.timing.t_pp_us == (((dw11 >> 8) & 0x1F) + 1) * (((dw11 >> 13) & 1) ? 64 : 8));
+    CHECK(dev.timing.t_pp_us >= sim.timing.t_pp_us);
+    CHECK(dev.timing.t_se_ms * 1000 >= sim.timing.t_se_us);
+    w25qxx_sim_close(&sim);
+
+    // every first/additional byte time bit set must not change the page program time
+    openRaw(&sim, &dev, W25Q64);
+    dw11 = bfptDword(&sim, 10);
+    bfptSet(&sim, 10, dw11 | (0x3FFu << 14));
+    CHECK(w25qxx_dev_init(&dev));
+    CHECK(dev.timing.t_pp_us == (((dw11 >> 8) & 0x1F) + 1) * (((dw11 >> 13) & 1) ? 64 : 8));
+    w25qxx_sim_close(&sim);
+
+    // parts above 16MB use the 4-byte opcodes announced in the 16th dword
+    openRaw(&sim, &dev, W25Q256);
+    CHECK(w25qxx_dev_init(&dev));
+    CHECK(dev.capacity_kb == 32768);
+    CHECK(dev.addr_mode == W25QXX_ADDR_4BYTE_OPCODES);
+    w25qxx_sim_close(&sim);
+
+    // a table without the 32KB erase type restricts the erase planner
+    openRaw(&sim, &dev, W25Q64);
+    bfptSet(&sim, 7, (bfptDword(&sim, 7) & 0x0000FFFF) | 0xFF000000);
+    CHECK(w25qxx_dev_init(&dev));
+    CHECK(dev.erase_sizes == (W25QXX_ERASE_4K | W25QXX_ERASE_64K));
+    CHECK(!w25qxx_dev_eraseBlock32K(&dev, 0));
+    w25qxx_sim_close(&sim);
+
+    // no signature: JEDEC ID defaults
+    openRaw(&sim, &dev, W25Q32);
+    sim.sfdp[0] = 0;
+    CHECK(w25qxx_dev_init(&dev));
+    CHECK(!dev.sfdp);
+    CHECK(dev.type == W25Q32);
+    CHECK(dev.capacity_kb == 4096);
+    w25qxx_sim_close(&sim);
+
+    return 0;
+#endif
+}
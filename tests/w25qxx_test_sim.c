@@ -0,0 +1,66 @@
+#include <unistd.h>
+#include "w25qxx_test.h"
+
+/* Simulator backend: identification, NOR program/erase rules, virtual time, image files */
+
+static uint8_t data[4096], back[4096];
+
+
+int main(void)
+{
+    w25qxx_sim_t sim;
+    w25qxx_dev_t dev;
+    char path[] = "/tmp/w25qxx_test_simXXXXXX";
+    uint64_t t0;
+    int fd;
+
+    test_open(&sim, &dev, W25Q64);
+    CHECK(dev.type == W25Q64);
+    CHECK(dev.capacity_kb == 8192);
+    CHECK(dev.sector_count == 2048);
+
+    // programs clear bits only, erases set them again
+    memset(data, 0xF0, 16);
+    CHECK(w25qxx_dev_writePage(&dev, data, 0, 0, 16));
+    memset(data, 0x3C, 16);
+    CHECK(w25qxx_dev_writePage(&dev, data, 0, 0, 16));
+    CHECK(w25qxx_dev_read(&dev, 0, back, 16));
+    for (int i = 0; i < 16; ++i)
+        CHECK(back[i] == 0x30);
+
+    t0 = w25qxx_sim_nowNs(&sim);
+    CHECK(w25qxx_dev_eraseSector(&dev, 0));
+    CHECK((w25qxx_sim_nowNs(&sim) - t0) >= (uint64_t)sim.timing.t_se_us * 1000);
+    CHECK(w25qxx_dev_read(&dev, 0, back, sizeof(back)));
+    for (uint32_t i = 0; i < sizeof(back); ++i)
+        CHECK(back[i] == 0xFF);
+
+    // page writes stop at the page end
+    test_pattern(data, 32, 1);
+    CHECK(w25qxx_dev_writePage(&dev, data, 1, 240, 32));
+    CHECK(w25qxx_dev_read(&dev, 256 + 240, back, 32));
+    CHECK(memcmp(back, data, 16) == 0);
+    for (int i = 16; i < 32; ++i)
+        CHECK(back[i] == 0xFF);
+    w25qxx_sim_close(&sim);
+
+    // image files keep the contents across open/close
+    fd = mkstemp(path);
+    CHECK(fd >= 0);
+    close(fd);
+
+    CHECK(w25qxx_sim_open(&sim, W25Q64, path, NULL));
+    test_reboot(&sim, &dev);
+    test_pattern(data, sizeof(data), 2);
+    CHECK(w25qxx_dev_writeSector(&dev, data, 5, 0, sizeof(data)));
+    w25qxx_sim_close(&sim);
+
+    CHECK(w25qxx_sim_open(&sim, W25Q64, path, NULL));
+    test_reboot(&sim, &dev);
+    CHECK(w25qxx_dev_read(&dev, 5 * 4096, back, sizeof(back)));
+    CHECK(memcmp(back, data, sizeof(data)) == 0);
+    w25qxx_sim_close(&sim);
+    unlink(path);
+
+    return 0;
+}
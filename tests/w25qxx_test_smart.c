@@ -0,0 +1,74 @@
+#include "w25qxx_test.h"
+
+/* Smart write: unchanged pages are skipped, 1 -> 0 changes program in place, 0 -> 1 changes erase */
+
+#define BASE    1000
+#define SPAN    (64 * 1024 + 2 * 4096)
+
+static uint8_t ref[SPAN + 2 * 4096], image[SPAN], scratch[4096];
+
+
+int main(void)
+{
+    w25qxx_sim_t sim;
+    w25qxx_dev_t dev;
+    uint8_t p[100];
+
+    test_open(&sim, &dev, W25Q32);
+    test_pattern(sim.mem, sizeof(ref), 3);         // chip holding old data everywhere
+    memcpy(ref, sim.mem, sizeof(ref));
+    test_pattern(image, sizeof(image), 4);
+    image[5000] = 0xFF;
+    w25qxx_dev_setSmartWrite(&dev, scratch);
+    test_cutAfter(&dev, -1);
+
+    // bytes around the range survive the erases
+    CHECK(w25qxx_dev_writeSmart(&dev, BASE, image, SPAN));
+    memcpy(ref + BASE, image, SPAN);
+    CHECK(memcmp(sim.mem, ref, sizeof(ref)) == 0);
+    CHECK(dev.smart_stats.sectors_erased == ((BASE + SPAN - 1) / 4096 - BASE / 4096 + 1));
+
+    // the same data again costs no program and no erase
+    memset(&dev.smart_stats, 0, sizeof(dev.smart_stats));
+    test_programs = test_erases = 0;
+    CHECK(w25qxx_dev_writeSmart(&dev, BASE, image, SPAN));
+    CHECK((test_programs == 0) && (test_erases == 0));
+    CHECK(dev.smart_stats.pages_unchanged == ((BASE + SPAN - 1) / 256 - BASE / 256 + 1));
+
+    // clearing bits programs the one page in place
+    memset(&dev.smart_stats, 0, sizeof(dev.smart_stats));
+    image[5000] &= 0x0F;
+    CHECK(w25qxx_dev_writeSmart(&dev, BASE, image, SPAN));
+    CHECK((dev.smart_stats.pages_programmed == 1) && (dev.smart_stats.sectors_erased == 0));
+
+    // setting a bit needs the sector erased, its other pages are written back
+    memset(&dev.smart_stats, 0, sizeof(dev.smart_stats));
+    image[5000] |= 0xF0;
+    CHECK(w25qxx_dev_writeSmart(&dev, BASE, image, SPAN));
+    memcpy(ref + BASE, image, SPAN);
+    CHECK(memcmp(sim.mem, ref, sizeof(ref)) == 0);
+    CHECK(dev.smart_stats.sectors_erased == 1);
+    CHECK(dev.smart_stats.pages_rewritten == 16);
+
+    // with a scratch set, page, sector and block writes go through the smart path over old data
+    memset(p, 0x11, sizeof(p));
+    CHECK(w25qxx_dev_writePage(&dev, p, 2, 10, sizeof(p)));
+    memcpy(ref + 2 * 256 + 10, p, sizeof(p));
+    CHECK(w25qxx_dev_writeSector(&dev, image, 17, 100, 5000));
+    memcpy(ref + 17 * 4096 + 100, image, 4096 - 100);
+    CHECK(memcmp(sim.mem, ref, sizeof(ref)) == 0);
+
+    // a block write over old data erases each of its sectors once
+    test_pattern(sim.mem + 3 * 65536, 65536, 5);
+    memset(&dev.smart_stats, 0, sizeof(dev.smart_stats));
+    CHECK(w25qxx_dev_writeBlock(&dev, image, 3, 0, 65536));
+    CHECK(memcmp(sim.mem + 3 * 65536, image, 65536) == 0);
+    CHECK(dev.smart_stats.sectors_erased == 16);
+
+    memset(&dev.smart_stats, 0, sizeof(dev.smart_stats));
+    CHECK(w25qxx_dev_writeBlock(&dev, image + 1, 3, 100, 10000));
+    CHECK(memcmp(sim.mem + 3 * 65536 + 100, image + 1, 10000) == 0);
+    CHECK(dev.smart_stats.sectors_erased == 3);
+
+    return 0;
+}
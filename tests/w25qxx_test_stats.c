@@ -0,0 +1,83 @@
+#include "w25qxx_test.h"
+
+/* Instrumentation: opcode, transaction and byte counters, latency buckets, snapshot and reset */
+
+static uint8_t data[1000];
+
+
+/* Bucket of the only latency counted in h, -1 when there is not exactly one */
+static int bucket(const uint32_t *h)
+{
+    int found = -1;
+    uint32_t total = 0;
+
+    for (int i = 0; i < W25QXX_HIST_BUCKETS; ++i){
+        total += h[i];
+        if (h[i])
+            found = i;
+    }
+
+    return (total == 1) ? found : -1;
+}
+
+
+static int log2u(uint32_t v)
+{
+    int r = 0;
+
+    while (v >>= 1)
+        r++;
+
+    return r;
+}
+
+
+int main(void)
+{
+    w25qxx_sim_t sim;
+    w25qxx_dev_t dev;
+    w25qxx_stats_t s, zero;
+    uint64_t tx;
+
+    test_open(&sim, &dev, W25Q64);
+    test_pattern(data, sizeof(data), 1);
+    CHECK(w25qxx_dev_setReadMode(&dev, W25QXX_READ_FAST));
+
+    memset(&zero, 0, sizeof(zero));
+    w25qxx_dev_resetStats(&dev);
+    CHECK(w25qxx_dev_getStats(&dev, &s));
+    CHECK(memcmp(&s, &zero, sizeof(s)) == 0);
+
+    // one Fast Read: one transaction, the data phase in bytes_read, one read latency
+    tx = sim.stats.transactions;
+    CHECK(w25qxx_dev_read(&dev, 0, data, sizeof(data)));
+    CHECK(w25qxx_dev_getStats(&dev, &s));
+    CHECK((s.commands[0x0B] == 1) && (s.transactions == 1) && (s.transactions == sim.stats.transactions - tx));
+    CHECK((s.bytes_read == sizeof(data)) && (s.bytes_written == 0));
+    CHECK(bucket(s.latency[W25QXX_LAT_READ]) >= 0);
+
+    // page program: WREN, 02h and SR1 polls, tPP lands in its log2 bucket
+    w25qxx_dev_resetStats(&dev);
+    tx = sim.stats.transactions;
+    CHECK(w25qxx_dev_writePage(&dev, data, 0, 0, 256));
+    CHECK(w25qxx_dev_getStats(&dev, &s));
+    CHECK((s.commands[0x06] == 1) && (s.commands[0x02] == 1));
+    CHECK((s.sr1_polls >= 1) && (s.sr1_polls == s.commands[0x05]));
+    CHECK(s.transactions == sim.stats.transactions - tx);
+    CHECK((s.bytes_written == 256) && (s.bytes_read == s.sr1_polls));
+    CHECK(bucket(s.latency[W25QXX_LAT_PAGE_PROGRAM]) == log2u(sim.timing.t_pp_us));
+
+    // a snapshot is a copy, later operations add to the device counters only
+    CHECK(w25qxx_dev_eraseSector(&dev, 1));
+    CHECK(w25qxx_dev_getStats(&dev, &zero));
+    CHECK((s.commands[0x20] == 0) && (zero.commands[0x20] == 1));
+    CHECK(bucket(zero.latency[W25QXX_LAT_SECTOR_ERASE]) == log2u(sim.timing.t_se_us));
+    CHECK((zero.timeouts == 0) && (zero.verify_errors == 0));
+
+    memset(&zero, 0, sizeof(zero));
+    w25qxx_dev_resetStats(&dev);
+    CHECK(w25qxx_dev_getStats(&dev, &s));
+    CHECK(memcmp(&s, &zero, sizeof(s)) == 0);
+
+    return 0;
+}
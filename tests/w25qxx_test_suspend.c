@@ -0,0 +1,70 @@
+#include "w25qxx_test.h"
+
+/* Reads during non-blocking erase/program: suspend outside the target range, wait inside it, timeout accounting */
+
+static uint8_t data[4096], back[4096];
+
+
+static void finish(w25qxx_dev_t *dev, w25qxx_op_t *op)
+{
+    w25qxx_op_status_t status;
+
+    while ((status = w25qxx_opPoll(op)) == W25QXX_OP_BUSY)
+        dev->delay(1);
+    CHECK(status == W25QXX_OP_DONE);
+}
+
+
+int main(void)
+{
+    w25qxx_sim_t sim;
+    w25qxx_dev_t dev;
+    w25qxx_op_t op;
+    int32_t start;
+
+    test_open(&sim, &dev, W25Q64);
+    w25qxx_dev_setSuspendLimit(&dev, 8);
+
+    test_pattern(data, sizeof(data), 1);
+    CHECK(w25qxx_dev_writeSector(&dev, data, 10, 0, sizeof(data)));
+    CHECK(w25qxx_dev_writeSector(&dev, data, 20, 0, sizeof(data)));
+
+    // outside the erased sector: suspended, old data intact
+    CHECK(w25qxx_dev_eraseSectorStart(&dev, &op, 10, NULL));
+    dev.delay(5);
+    start = op.start_time;
+    CHECK(w25qxx_dev_read(&dev, 20 * 4096, back, sizeof(back)));
+    CHECK(memcmp(back, data, sizeof(data)) == 0);
+    CHECK(op.suspends == 1);
+    CHECK(w25qxx_opPoll(&op) == W25QXX_OP_BUSY);
+
+    // only the suspended interval is added to the timeout window
+    CHECK(op.start_time == start + (dev.resume_time - dev.suspend_time));
+    CHECK(op.start_time < dev.resume_time);
+
+    // inside the erased sector: no suspend, the read waits and sees the erased cells
+    CHECK(w25qxx_dev_read(&dev, 10 * 4096 + 100, back, 64));
+    CHECK(op.suspends == 1);
+    for (int i = 0; i < 64; ++i)
+        CHECK(back[i] == 0xFF);
+    finish(&dev, &op);
+
+    // a multi page program: reads of its range wait for the page in flight
+    test_pattern(data, sizeof(data), 2);
+    CHECK(w25qxx_dev_writeStart(&dev, &op, 10 * 4096, data, 1024, NULL));
+    CHECK(w25qxx_dev_read(&dev, 10 * 4096, back, 256));
+    CHECK(op.suspends == 0);
+    CHECK(memcmp(back, data, 256) == 0);
+    finish(&dev, &op);
+    CHECK(w25qxx_dev_read(&dev, 10 * 4096, back, 1024));
+    CHECK(memcmp(back, data, 1024) == 0);
+
+    // suspend limit reached: reads wait
+    w25qxx_dev_setSuspendLimit(&dev, 0);
+    CHECK(w25qxx_dev_eraseBlockStart(&dev, &op, 1, NULL));
+    CHECK(w25qxx_dev_read(&dev, 20 * 4096, back, 16));
+    CHECK(op.suspends == 0);
+    finish(&dev, &op);
+
+    return 0;
+}
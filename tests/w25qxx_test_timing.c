@@ -0,0 +1,72 @@
+#include "w25qxx_test.h"
+
+/* Busy waits: no fixed delay per page, the learned estimate follows the part, polls back off */
+
+static uint32_t polls;
+static w25qxx_interface_transfer_t next;
+static uint8_t data[256];
+
+
+/* Count Read Status Register-1 commands */
+static uint8_t countTransfer(const w25qxx_transfer_t *xfer)
+{
+    if (xfer->header_len && (xfer->header[0] == 0x05))
+        polls++;
+
+    return next(xfer);
+}
+
+
+/* Program one page, returns its virtual time in us */
+static uint32_t program(w25qxx_sim_t *sim, w25qxx_dev_t *dev, uint32_t page)
+{
+    uint64_t t0 = w25qxx_sim_nowNs(sim);
+
+    polls = 0;
+    CHECK(w25qxx_dev_writePage(dev, data, page, 0, sizeof(data)));
+
+    return (uint32_t)((w25qxx_sim_nowNs(sim) - t0) / 1000);
+}
+
+
+int main(void)
+{
+    w25qxx_sim_t sim;
+    w25qxx_dev_t dev;
+    uint32_t page = 0;
+    uint32_t us, t_pp;
+    uint64_t t0;
+
+    test_open(&sim, &dev, W25Q64);
+    test_pattern(data, sizeof(data), 1);
+    next = dev.interface_transfer;
+    dev.interface_transfer = countTransfer;
+
+    // a page costs tPP plus the bus, a few polls and no whole millisecond on top
+    t_pp = sim.timing.t_pp_us;
+    for (int i = 0; i < 8; ++i){
+        us = program(&sim, &dev, page++);
+        CHECK((us >= t_pp) && (us < t_pp + t_pp / 2));
+        CHECK((polls >= 1) && (polls <= 6));
+    }
+
+    // a part twice as slow moves the estimate there, the polls per page settle again
+    sim.timing.t_pp_us = t_pp = 2 * sim.timing.t_pp_us;
+    us = program(&sim, &dev, page++);
+    CHECK((us >= t_pp) && (us < t_pp + t_pp / 4) && (polls <= 20));
+    for (int i = 0; i < 64; ++i)
+        us = program(&sim, &dev, page++);
+    CHECK((dev.busy_est_us[W25QXX_OP_WRITE] > t_pp - t_pp / 10) && (dev.busy_est_us[W25QXX_OP_WRITE] < t_pp + t_pp / 10));
+    CHECK((us >= t_pp) && (us < t_pp + t_pp / 4) && (polls <= 6));
+
+    // an erase three times longer than expected: doubling poll intervals, not one poll per millisecond
+    sim.timing.t_se_us *= 3;
+    t0 = w25qxx_sim_nowNs(&sim);
+    polls = 0;
+    CHECK(w25qxx_dev_eraseSector(&dev, 0));
+    us = (uint32_t)((w25qxx_sim_nowNs(&sim) - t0) / 1000);
+    CHECK((us >= sim.timing.t_se_us) && (us < sim.timing.t_se_us + sim.timing.t_se_us / 10));
+    CHECK(polls <= 40);
+
+    return 0;
+}
@@ -0,0 +1,79 @@
+#include "w25qxx_test.h"
+#include "w25qxx_wcache.h"
+
+/* Write-back sector cache: random unaligned writes against a reference, one erase per flushed sector, outside changes */
+
+#define SPAN    (10 * 4096)
+
+static uint8_t ref[SPAN], back[SPAN], pool[4 * 4096];
+
+
+int main(void)
+{
+    w25qxx_sim_t sim;
+    w25qxx_dev_t dev;
+    w25qxx_wcache_t wc;
+    uint32_t seed = 1;
+    uint8_t b[300];
+
+    test_open(&sim, &dev, W25Q32);
+    test_pattern(ref, SPAN, 7);
+    memcpy(sim.mem, ref, SPAN);
+    CHECK(!w25qxx_wcache_init(&wc, &dev, pool, W25QXX_WCACHE_MAX_LINES + 1));
+    CHECK(w25qxx_wcache_init(&wc, &dev, pool, 4));
+
+    // more sectors than lines: evictions write back, reads always see the latest data
+    for (int it = 0; it < 2000; ++it){
+        uint32_t addr, len;
+
+        seed = seed * 1103515245u + 12345u;
+        addr = (seed >> 8) % (SPAN - sizeof(b));
+        len = 1 + (seed >> 20) % sizeof(b);
+        test_pattern(b, len, seed);
+        CHECK(w25qxx_wcache_write(&wc, addr, b, len));
+        memcpy(ref + addr, b, len);
+
+        addr = (seed >> 4) % (SPAN / 2);
+        CHECK(w25qxx_wcache_read(&wc, addr, back, SPAN / 2));
+        CHECK(memcmp(back, ref + addr, SPAN / 2) == 0);
+    }
+    CHECK(w25qxx_wcache_flush(&wc));
+    CHECK(memcmp(sim.mem, ref, SPAN) == 0);
+
+    // many small updates of one sector cost a single erase at the flush
+    test_cutAfter(&dev, -1);
+    for (int i = 0; i < 100; ++i){
+        memset(b, i, 10);
+        CHECK(w25qxx_wcache_write(&wc, 100000 + i * 10, b, 10));
+    }
+    CHECK(test_erases == 0);
+    CHECK(w25qxx_wcache_flush(&wc));
+    CHECK(test_erases == 1);
+    for (int i = 0; i < 100; ++i)
+        CHECK(sim.mem[100000 + i * 10 + 9] == i);
+
+    // dropped lines are not written back
+    memset(b, 0x55, 10);
+    CHECK(w25qxx_wcache_write(&wc, 100000, b, 10));
+    w25qxx_wcache_invalidate(&wc);
+    CHECK(w25qxx_wcache_flush(&wc));
+    CHECK(sim.mem[100000] == 0);
+    CHECK(w25qxx_wcache_read(&wc, 100000, back, 1));
+    CHECK(back[0] == 0);
+
+    // changes made around the cache drop its clean lines, dirty ones are kept and counted
+    memset(b, 0x22, 10);
+    CHECK(w25qxx_wcache_write(&wc, 30 * 4096, b, 10));
+    CHECK(w25qxx_wcache_flush(&wc));
+    CHECK(w25qxx_wcache_write(&wc, 31 * 4096, b, 10));
+    CHECK(w25qxx_dev_eraseSector(&dev, 30));
+    CHECK(w25qxx_dev_eraseSector(&dev, 31));
+    CHECK(wc.conflicts == 1);
+    CHECK(w25qxx_wcache_read(&wc, 30 * 4096, back, 1));
+    CHECK(back[0] == 0xFF);
+    CHECK(w25qxx_wcache_read(&wc, 31 * 4096, back, 1));
+    CHECK(back[0] == 0x22);
+    w25qxx_wcache_deinit(&wc);
+
+    return 0;
+}
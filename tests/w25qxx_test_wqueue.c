@@ -0,0 +1,76 @@
+#include "w25qxx_test.h"
+#include "w25qxx_wqueue.h"
+
+/* Write queue: random writes against a reference read back before and after flushes, age limit, erase avoidance */
+
+#define SPAN    (64 * 4096)
+
+static uint8_t ref[SPAN], back[SPAN], pool[8192], scratch[4096], data[5000];
+
+
+int main(void)
+{
+    w25qxx_sim_t sim;
+    w25qxx_dev_t dev;
+    w25qxx_wqueue_t q;
+    uint32_t seed = 3;
+    uint8_t x = 0;
+
+    test_open(&sim, &dev, W25Q64);
+    memset(ref, 0xFF, SPAN);
+    CHECK(!w25qxx_wqueue_init(&q, &dev, pool, sizeof(pool), NULL, 50));
+    CHECK(w25qxx_wqueue_init(&q, &dev, pool, sizeof(pool), scratch, 50));
+
+    // hot sectors, small and large writes, some only clearing bits
+    for (int it = 0; it < 10000; ++it){
+        uint32_t addr, len;
+
+        seed = seed * 1103515245u + 12345u;
+        len = 1 + (seed >> 8) % ((it % 97) ? 40 : sizeof(data));
+        addr = (seed >> 4) % (SPAN - len);
+        if ((it % 3) == 0){
+            addr = ((seed >> 20) % 8) * 4096 + (seed >> 2) % 4000;
+            len = (len > 90) ? 90 : len;
+        }
+
+        test_pattern(data, len, seed);
+        if (it & 1){
+            for (uint32_t k = 0; k < len; ++k)
+                data[k] &= ref[addr + k];
+        }
+        memcpy(ref + addr, data, len);
+        CHECK(w25qxx_wqueue_write(&q, addr, data, len));
+
+        if ((it % 1000) == 0){
+            CHECK(w25qxx_wqueue_read(&q, 0, back, SPAN));
+            CHECK(memcmp(back, ref, SPAN) == 0);
+        }
+    }
+    CHECK(q.flushes > 0);
+    CHECK(w25qxx_wqueue_sync(&q));
+    CHECK(q.count == 0);
+    CHECK(memcmp(sim.mem, ref, SPAN) == 0);
+    CHECK(w25qxx_wqueue_read(&q, 0, back, SPAN));
+    CHECK(memcmp(back, ref, SPAN) == 0);
+
+    // the oldest queued write is flushed by poll once it reaches the age limit
+    CHECK(w25qxx_wqueue_write(&q, 100, &x, 1));
+    CHECK(q.count == 1);
+    CHECK(w25qxx_wqueue_poll(&q));
+    CHECK(q.count == 1);
+    dev.delay(60);
+    CHECK(w25qxx_wqueue_poll(&q));
+    CHECK((q.count == 0) && (sim.mem[100] == 0));
+
+    // writes into erased space or only clearing bits program without an erase
+    q.erases = 0;
+    memset(data, 0x11, sizeof(data));
+    CHECK(w25qxx_wqueue_write(&q, 4096 * 100 - 100, data, sizeof(data)));
+    memset(data, 0x01, sizeof(data));
+    CHECK(w25qxx_wqueue_write(&q, 4096 * 100, data, 10));
+    CHECK(w25qxx_wqueue_sync(&q));
+    CHECK(q.erases == 0);
+    CHECK((sim.mem[4096 * 100 - 100] == 0x11) && (sim.mem[4096 * 100] == 0x01) && (sim.mem[4096 * 100 + 10] == 0x11));
+
+    return 0;
+}
@@ -0,0 +1,61 @@
+#include "w25qxx_test.h"
+
+/* Wrapped line fills: critical byte first in every read mode, linear reads in between still linear */
+
+static void fills(w25qxx_sim_t *sim, w25qxx_dev_t *dev, w25qxx_read_mode_t mode)
+{
+    static const uint8_t lens[4] = {8, 16, 32, 64};
+    uint32_t seed = 9;
+    uint8_t b[300];
+
+    CHECK(w25qxx_dev_setReadMode(dev, mode));
+
+    for (int it = 0; it < 500; ++it){
+        uint8_t len;
+        uint32_t addr, base;
+
+        seed = seed * 1103515245u + 12345u;
+        len = (it < 250) ? 32 : lens[(seed >> 24) % 4];
+        addr = (seed >> 4) % sim->capacity;
+        base = addr & ~(uint32_t)(len - 1);
+
+        CHECK(w25qxx_dev_readWrap(dev, addr, b, len));
+        for (uint32_t i = 0; i < len; ++i)
+            CHECK(b[i] == sim->mem[base + ((addr - base + i) % len)]);
+
+        if ((it % 7) == 0){
+            addr = (seed >> 8) % 100000;
+            CHECK(w25qxx_dev_read(dev, addr, b, sizeof(b)));
+            CHECK(memcmp(b, sim->mem + addr, sizeof(b)) == 0);
+        }
+    }
+
+    CHECK(!w25qxx_dev_readWrap(dev, 0, b, 12));
+    CHECK(!w25qxx_dev_readWrap(dev, sim->capacity, b, 8));
+}
+
+
+int main(void)
+{
+    w25qxx_sim_t sim;
+    w25qxx_dev_t dev;
+    uint64_t tx;
+    uint8_t b[64];
+
+    test_open(&sim, &dev, W25Q64);
+    test_pattern(sim.mem, sim.capacity, 1);
+
+    fills(&sim, &dev, W25QXX_READ_FAST);
+    fills(&sim, &dev, W25QXX_READ_QUAD_IO);
+    fills(&sim, &dev, W25QXX_READ_QUAD_IO_CONTINUOUS);
+
+    // with Quad I/O a fill is a single read once the wrap length is set
+    CHECK(w25qxx_dev_setReadMode(&dev, W25QXX_READ_QUAD_IO));
+    CHECK(w25qxx_dev_readWrap(&dev, 1000 + 5, b, 32));
+    tx = sim.stats.transactions;
+    CHECK(w25qxx_dev_readWrap(&dev, 5000 + 7, b, 32));
+    CHECK((sim.stats.transactions - tx) == 1);
+    CHECK(b[0] == sim.mem[5000 + 7]);
+
+    return 0;
+}
@@ -0,0 +1,61 @@
+#include "w25qxx_test.h"
+
+/* Linear writes across pages and sectors, page buffered stream writer, block write offsets */
+
+static uint8_t data[1 << 17];
+
+
+int main(void)
+{
+    w25qxx_sim_t sim;
+    w25qxx_dev_t dev;
+    w25qxx_writer_t w;
+    uint32_t seed = 5;
+    uint32_t base = 0x40000 + 13;
+    uint32_t pos = 0;
+    uint32_t programs;
+
+    test_open(&sim, &dev, W25Q64);
+    test_pattern(data, sizeof(data), 1);
+    test_cutAfter(&dev, -1);
+
+    // the offset is within the block, not within the page
+    CHECK(w25qxx_dev_writeBlock(&dev, data, 1, 1000, 3000));
+    CHECK(memcmp(sim.mem + 0x10000 + 1000, data, 3000) == 0);
+    CHECK(sim.mem[0x10000 + 999] == 0xFF);
+
+    CHECK(w25qxx_dev_write(&dev, 0x20000 - 77, data, 9000));
+    CHECK(memcmp(sim.mem + 0x20000 - 77, data, 9000) == 0);
+    CHECK(w25qxx_dev_write(&dev, (8u << 20) - 3, data, 4));       // clamped to the end of the chip
+    CHECK(memcmp(sim.mem + (8u << 20) - 3, data, 3) == 0);
+    CHECK(!w25qxx_dev_write(&dev, 8u << 20, data, 1));
+
+    // small records cost one program per page
+    CHECK(w25qxx_dev_writerOpen(&dev, &w, base));
+    programs = test_programs;
+    while (pos < 60000){
+        uint32_t n;
+
+        seed = seed * 1103515245u + 12345u;
+        n = ((seed >> 8) % 50) ? (1 + (seed >> 16) % 30) : 700;
+        CHECK(w25qxx_dev_writerAppend(&w, data + pos, n));
+        pos += n;
+    }
+    CHECK(w25qxx_dev_writerClose(&w));
+    CHECK(w.addr == base + pos);
+    CHECK((test_programs - programs) == ((base + pos - 1) / 256 - base / 256 + 1));
+    CHECK(memcmp(sim.mem + base, data, pos) == 0);
+    CHECK((sim.mem[base + pos] == 0xFF) && (sim.mem[base - 1] == 0xFF));
+
+    // reopening continues in the middle of a page
+    CHECK(w25qxx_dev_writerOpen(&dev, &w, w.addr));
+    CHECK(w25qxx_dev_writerAppend(&w, data, 5));
+    CHECK(w25qxx_dev_writerClose(&w));
+    CHECK(memcmp(sim.mem + base + pos, data, 5) == 0);
+
+    CHECK(!w25qxx_dev_writerOpen(&dev, &w, 8u << 20));
+    CHECK(w25qxx_dev_writerOpen(&dev, &w, (8u << 20) - 3));
+    CHECK(!w25qxx_dev_writerAppend(&w, data, 4));
+
+    return 0;
+}